@@ -72,6 +72,21 @@
 #define CHANNELS 8
 #define CDEPTH 4
 
+/*
+  Vectors per segment of the striped query used for single targets:
+  the score profile for the 16 target symbols, the query gap penalties,
+  two masks for the rows beyond the query and four work vectors.
+*/
+
+#define SSTRIDE 24
+
+/*
+  Offset in vectors of the match profile from the score profile,
+  used by the aligner that counts instead of tracing back.
+*/
+
+#define MPROFILE (16 * CDEPTH)
+
 /*
   Due to memory usage, limit the product of the length of the sequences.
   If the product of the query length and any target sequence length
@@ -127,7 +142,10 @@ const __vector unsigned char perm_merge_long_high =
 #define v_zero vec_splat_s16(0)
 #define v_and(a, b) vec_and((a), (b))
 #define v_xor(a, b) vec_xor((a), (b))
+#define v_or(a, b) vec_or((a), (b))
+#define v_select(m, a, b) vec_sel((b), (a), (__vector bool short) (m))
 #define v_shift_left(a) vec_sld((a), v_zero, 2)
+#define v_cmp_gt(a, b) ((VECTOR_SHORT) vec_cmpgt((a), (b)))
 
 #elif defined __aarch64__
 
@@ -154,8 +172,25 @@ const uint16x8_t neon_mask =
 #define v_zero v_dup(0)
 #define v_and(a, b) vandq_s16((a), (b))
 #define v_xor(a, b) veorq_s16((a), (b))
+#define v_or(a, b) vorrq_s16((a), (b))
+#define v_select(m, a, b) vbslq_s16(vreinterpretq_u16_s16(m), (a), (b))
 #define v_shift_left(a) vextq_s16((v_zero), (a), 7)
 #define v_mask_gt(a, b) vaddvq_u16(vandq_u16((vcgtq_s16((a), (b))), neon_mask))
+#define v_cmp_gt(a, b) vreinterpretq_s16_u16(vcgtq_s16((a), (b)))
+#define v_mask_pack(a, b) neon_mask_pack((a), (b))
+
+const uint8x16_t neon_bits =
+  {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+
+/* one bit per channel of two comparison results, as on x86_64 */
+
+inline unsigned short neon_mask_pack(VECTOR_SHORT a, VECTOR_SHORT b)
+{
+  uint8x16_t t = vandq_u8(vcombine_u8(vmovn_u16(vreinterpretq_u16_s16(a)),
+                                      vmovn_u16(vreinterpretq_u16_s16(b))),
+                          neon_bits);
+  return vaddv_u8(vget_low_u8(t)) | (vaddv_u8(vget_high_u8(t)) << 8);
+}
 
 #elif __x86_64__
 
@@ -179,8 +214,13 @@ typedef __m128i VECTOR_SHORT;
 #define v_zero v_dup(0)
 #define v_and(a, b) _mm_and_si128((a), (b))
 #define v_xor(a, b) _mm_xor_si128((a), (b))
+#define v_or(a, b) _mm_or_si128((a), (b))
+#define v_select(m, a, b) _mm_or_si128(_mm_and_si128((m), (a)),        \
+                                       _mm_andnot_si128((m), (b)))
 #define v_shift_left(a) _mm_slli_si128((a), 2)
 #define v_mask_gt(a, b) _mm_movemask_epi8(_mm_cmpgt_epi16((a), (b)))
+#define v_cmp_gt(a, b) _mm_cmpgt_epi16((a), (b))
+#define v_mask_pack(a, b) _mm_movemask_epi8(_mm_packs_epi16((a), (b)))
 
 #else
 
@@ -188,14 +228,35 @@ typedef __m128i VECTOR_SHORT;
 
 #endif
 
+/*
+  Number of shorts of direction bits stored per cell for the eight
+  channels. On x86_64 the comparison results are packed to one bit
+  per channel (two shorts), elsewhere there are two bits per channel
+  (four shorts).
+*/
+
+#ifdef __x86_64__
+#define DIRSHORTS 2
+#else
+#define DIRSHORTS 4
+#endif
+
 struct s16info_s
 {
   VECTOR_SHORT matrix[32];
+  VECTOR_SHORT mmatrix[32];   /* -1 for matching symbols, 0 otherwise */
   VECTOR_SHORT * hearray;
-  VECTOR_SHORT * dprofile;
-  VECTOR_SHORT ** qtable;
+  VECTOR_SHORT * carray;      /* counters of the last column, per row */
+  VECTOR_SHORT * dprofile;    /* score profile, then match profile */
+  VECTOR_SHORT * sarray;      /* striped profile and work area */
+  int sseglen;                /* its segments, 0 until prepared */
+  VECTOR_SHORT ** qtable;     /* profile of the selected query part */
+  VECTOR_SHORT ** qtable_fwd; /* profile of the prepared query */
+  VECTOR_SHORT ** qtable_rev; /* profile of its reverse complement */
   unsigned short * dir;
-  char * qseq;
+  char * qseq;                /* selected query part */
+  char * qseq_fwd;            /* prepared query */
+  char * qseq_rev;            /* its reverse complement */
   uint64_t diralloc;
 
   char * cigar;
@@ -205,6 +266,7 @@ struct s16info_s
   char op;
 
   int qlen;
+  int qalloc;
   int maxdlen;
   CELL penalty_gap_open_query_left;
   CELL penalty_gap_open_target_left;
@@ -462,9 +524,7 @@ const __vector unsigned char perm  = { 120, 112, 104,  96,  88,  80,  72,  64,
     RES = (__vector unsigned long long) vec_mergeh(WX, YZ);             \
   }
 
-#else
-
-/* x86_64 & aarch64 */
+#elif defined __aarch64__
 
 #define ALIGNCORE(H, N, F, V, PATH, QR_q, R_q, QR_t, R_t, H_MIN, H_MAX) \
   H = v_add(H, V);                                                      \
@@ -484,6 +544,36 @@ const __vector unsigned char perm  = { 120, 112, 104,  96,  88,  80,  72,  64,
   *(PATH+3) = v_mask_gt(E, HE);                                         \
   E = v_max(E, HE);
 
+#else
+
+/*
+  x86_64: the two comparisons of each pair are packed into one short
+  with one bit per channel, halving the direction buffer writes.
+*/
+
+#define ALIGNCORE(H, N, F, V, PATH, QR_q, R_q, QR_t, R_t, H_MIN, H_MAX) \
+  {                                                                     \
+    VECTOR_SHORT W, X;                                                  \
+    H = v_add(H, V);                                                    \
+    W = v_cmp_gt(F, H);                                                 \
+    H = v_max(H, F);                                                    \
+    X = v_cmp_gt(E, H);                                                 \
+    H = v_max(H, E);                                                    \
+    *(PATH+0) = v_mask_pack(W, X);                                      \
+    H_MIN = v_min(H_MIN, H);                                            \
+    H_MAX = v_max(H_MAX, H);                                            \
+    N = H;                                                              \
+    HF = v_sub(H, QR_t);                                                \
+    F = v_sub(F, R_t);                                                  \
+    W = v_cmp_gt(F, HF);                                                \
+    F = v_max(F, HF);                                                   \
+    HE = v_sub(H, QR_q);                                                \
+    E = v_sub(E, R_q);                                                  \
+    X = v_cmp_gt(E, HE);                                                \
+    E = v_max(E, HE);                                                   \
+    *(PATH+1) = v_mask_pack(W, X);                                      \
+  }
+
 #endif
 
 void aligncolumns_first(VECTOR_SHORT * Sm,
@@ -577,13 +667,13 @@ void aligncolumns_first(VECTOR_SHORT * Sm,
       RES = vec_perm(RES1, RES2, perm_merge_long_low);
       v_store((dir + 16*i + 8), RES);
 #else
-      ALIGNCORE(h0, h5, f0, vp[0], dir+16*i+0,
+      ALIGNCORE(h0, h5, f0, vp[0], dir+DIRSHORTS*(4*i+0),
                 QR_q_i, R_q_i, QR_t_0, R_t_0, h_min, h_max);
-      ALIGNCORE(h1, h6, f1, vp[1], dir+16*i+4,
+      ALIGNCORE(h1, h6, f1, vp[1], dir+DIRSHORTS*(4*i+1),
                 QR_q_i, R_q_i, QR_t_1, R_t_1, h_min, h_max);
-      ALIGNCORE(h2, h7, f2, vp[2], dir+16*i+8,
+      ALIGNCORE(h2, h7, f2, vp[2], dir+DIRSHORTS*(4*i+2),
                 QR_q_i, R_q_i, QR_t_2, R_t_2, h_min, h_max);
-      ALIGNCORE(h3, h8, f3, vp[3], dir+16*i+12,
+      ALIGNCORE(h3, h8, f3, vp[3], dir+DIRSHORTS*(4*i+3),
                 QR_q_i, R_q_i, QR_t_3, R_t_3, h_min, h_max);
 #endif
 
@@ -621,13 +711,13 @@ void aligncolumns_first(VECTOR_SHORT * Sm,
   RES = vec_perm(RES1, RES2, perm_merge_long_low);
   v_store((dir + 16*i + 8), RES);
 #else
-  ALIGNCORE(h0, h5, f0, vp[0], dir+16*i+ 0,
+  ALIGNCORE(h0, h5, f0, vp[0], dir+DIRSHORTS*(4*i+0),
             QR_q_r, R_q_r, QR_t_0, R_t_0, h_min, h_max);
-  ALIGNCORE(h1, h6, f1, vp[1], dir+16*i+ 4,
+  ALIGNCORE(h1, h6, f1, vp[1], dir+DIRSHORTS*(4*i+1),
             QR_q_r, R_q_r, QR_t_1, R_t_1, h_min, h_max);
-  ALIGNCORE(h2, h7, f2, vp[2], dir+16*i+ 8,
+  ALIGNCORE(h2, h7, f2, vp[2], dir+DIRSHORTS*(4*i+2),
             QR_q_r, R_q_r, QR_t_2, R_t_2, h_min, h_max);
-  ALIGNCORE(h3, h8, f3, vp[3], dir+16*i+12,
+  ALIGNCORE(h3, h8, f3, vp[3], dir+DIRSHORTS*(4*i+3),
             QR_q_r, R_q_r, QR_t_3, R_t_3, h_min, h_max);
 #endif
 
@@ -711,13 +801,13 @@ void aligncolumns_rest(VECTOR_SHORT * Sm,
       RES = vec_perm(RES1, RES2, perm_merge_long_low);
       v_store((dir + 16*i + 8), RES);
 #else
-      ALIGNCORE(h0, h5, f0, vp[0], dir+16*i+ 0,
+      ALIGNCORE(h0, h5, f0, vp[0], dir+DIRSHORTS*(4*i+0),
                 QR_q_i, R_q_i, QR_t_0, R_t_0, h_min, h_max);
-      ALIGNCORE(h1, h6, f1, vp[1], dir+16*i+ 4,
+      ALIGNCORE(h1, h6, f1, vp[1], dir+DIRSHORTS*(4*i+1),
                 QR_q_i, R_q_i, QR_t_1, R_t_1, h_min, h_max);
-      ALIGNCORE(h2, h7, f2, vp[2], dir+16*i+ 8,
+      ALIGNCORE(h2, h7, f2, vp[2], dir+DIRSHORTS*(4*i+2),
                 QR_q_i, R_q_i, QR_t_2, R_t_2, h_min, h_max);
-      ALIGNCORE(h3, h8, f3, vp[3], dir+16*i+12,
+      ALIGNCORE(h3, h8, f3, vp[3], dir+DIRSHORTS*(4*i+3),
                 QR_q_i, R_q_i, QR_t_3, R_t_3, h_min, h_max);
 #endif
 
@@ -750,13 +840,13 @@ void aligncolumns_rest(VECTOR_SHORT * Sm,
   RES = vec_perm(RES1, RES2, perm_merge_long_low);
   v_store((dir + 16*i + 8), RES);
 #else
-  ALIGNCORE(h0, h5, f0, vp[0], dir+16*i+ 0,
+  ALIGNCORE(h0, h5, f0, vp[0], dir+DIRSHORTS*(4*i+0),
             QR_q_r, R_q_r, QR_t_0, R_t_0, h_min, h_max);
-  ALIGNCORE(h1, h6, f1, vp[1], dir+16*i+ 4,
+  ALIGNCORE(h1, h6, f1, vp[1], dir+DIRSHORTS*(4*i+1),
             QR_q_r, R_q_r, QR_t_1, R_t_1, h_min, h_max);
-  ALIGNCORE(h2, h7, f2, vp[2], dir+16*i+ 8,
+  ALIGNCORE(h2, h7, f2, vp[2], dir+DIRSHORTS*(4*i+2),
             QR_q_r, R_q_r, QR_t_2, R_t_2, h_min, h_max);
-  ALIGNCORE(h3, h8, f3, vp[3], dir+16*i+12,
+  ALIGNCORE(h3, h8, f3, vp[3], dir+DIRSHORTS*(4*i+3),
             QR_q_r, R_q_r, QR_t_3, R_t_3, h_min, h_max);
 #endif
 
@@ -772,6 +862,253 @@ void aligncolumns_rest(VECTOR_SHORT * Sm,
   *_h_max = h_max;
 }
 
+/*
+  Counters of the alignment that backtrack16() would trace back from
+  a cell, for runs that need the numbers but no alignment string. The
+  traceback from a cell depends on the operation by which it was
+  entered, so there is one set for each state: entered diagonally (or
+  at the end), from the right (I, gap in the query) or from below (D,
+  gap in the target). match counts the matches, diag the aligned
+  columns, gaps the gap openings. trim is the terminal gap at the
+  left end of the alignment, positive for a gap in the target (D) and
+  negative for one in the query (I). run is the number of I or D
+  operations the traceback would add in a row from the cell in that
+  state; for the last row it holds the terminal gap at the right end
+  instead.
+*/
+
+struct count16_s
+{
+  VECTOR_SHORT match;
+  VECTOR_SHORT diag;
+  VECTOR_SHORT gaps;
+  VECTOR_SHORT trim;
+  VECTOR_SHORT run;
+};
+
+/*
+  Align one cell as ALIGNCORE does and derive the counters of its three
+  states in the same order of preference as backtrack16(): an extended
+  gap first, then a gap in the query, then one in the target, then the
+  diagonal. On entry cm holds the counters of the cell on the diagonal,
+  cd those of the cell above and ci those of the cell to the left.
+  The runs are only kept up to date if runs is set.
+*/
+
+inline void aligncount(VECTOR_SHORT * h,
+                       VECTOR_SHORT * f,
+                       VECTOR_SHORT * e,
+                       VECTOR_SHORT v,
+                       VECTOR_SHORT mt,
+                       VECTOR_SHORT QR_q,
+                       VECTOR_SHORT R_q,
+                       VECTOR_SHORT QR_t,
+                       VECTOR_SHORT R_t,
+                       VECTOR_SHORT * h_min,
+                       VECTOR_SHORT * h_max,
+                       struct count16_s * cm,
+                       struct count16_s * cd,
+                       struct count16_s * ci,
+                       bool runs)
+{
+  VECTOR_SHORT one = v_dup(1);
+
+  VECTOR_SHORT H = v_add(*h, v);
+  VECTOR_SHORT W = v_cmp_gt(*f, H);
+  H = v_max(H, *f);
+  VECTOR_SHORT X = v_cmp_gt(*e, H);
+  H = v_max(H, *e);
+  *h_min = v_min(*h_min, H);
+  *h_max = v_max(*h_max, H);
+  *h = H;
+  VECTOR_SHORT HF = v_sub(H, QR_t);
+  VECTOR_SHORT F = v_sub(*f, R_t);
+  VECTOR_SHORT Y = v_cmp_gt(F, HF);
+  *f = v_max(F, HF);
+  VECTOR_SHORT HE = v_sub(H, QR_q);
+  VECTOR_SHORT E = v_sub(*e, R_q);
+  VECTOR_SHORT Z = v_cmp_gt(E, HE);
+  *e = v_max(E, HE);
+
+  /* G: any gap, X: gap in the query, U: gap in the target */
+  VECTOR_SHORT G = v_or(W, X);
+  VECTOR_SHORT U = v_xor(G, X);
+
+  struct count16_s b;
+  b.match = v_select(X, ci->match, v_select(W, cd->match, cm->match));
+  b.diag = v_select(X, ci->diag, v_select(W, cd->diag, cm->diag));
+  b.gaps = v_select(X, ci->gaps, v_select(W, cd->gaps, cm->gaps));
+  b.trim = v_select(X, ci->trim, v_select(W, cd->trim, cm->trim));
+
+  struct count16_s m;
+  m.match = v_select(G, b.match, v_sub(b.match, mt));
+  m.diag = v_add(b.diag, v_add(G, one));
+  m.gaps = v_sub(b.gaps, G);
+  m.trim = b.trim;
+
+  ci->match = v_select(Z, ci->match, m.match);
+  ci->diag = v_select(Z, ci->diag, m.diag);
+  ci->gaps = v_select(Z, ci->gaps, v_sub(b.gaps, U));
+  ci->trim = v_select(Z, ci->trim, m.trim);
+
+  cd->match = v_select(Y, cd->match, m.match);
+  cd->diag = v_select(Y, cd->diag, m.diag);
+  cd->gaps = v_select(Y, cd->gaps, v_sub(b.gaps, X));
+  cd->trim = v_select(Y, cd->trim, m.trim);
+
+  if (runs)
+    {
+      ci->run = v_and(v_or(Z, X), v_add(ci->run, one));
+      cd->run = v_and(v_or(Y, U), v_add(cd->run, one));
+
+      /* the terminal gap at the right end, if this is the last cell */
+      m.run = v_select(X, v_sub(v_zero, ci->run), v_and(U, cd->run));
+    }
+
+  *cm = m;
+}
+
+/*
+  Align four columns like aligncolumns_first(), which with zero masks
+  works like aligncolumns_rest(), without writing direction bits. J
+  holds the position in its target of the first column in each
+  channel, Sc receives the counters of the last row. The runs are only
+  needed for the terminal gaps at the right end, so they are tracked
+  along the last row, and along the columns if any target ends in
+  them.
+*/
+
+void aligncolumns_count(VECTOR_SHORT * Sm,
+                        struct count16_s * Sc,
+                        VECTOR_SHORT * hep,
+                        struct count16_s * cep,
+                        VECTOR_SHORT ** qp,
+                        VECTOR_SHORT QR_q_i,
+                        VECTOR_SHORT R_q_i,
+                        VECTOR_SHORT QR_q_r,
+                        VECTOR_SHORT R_q_r,
+                        VECTOR_SHORT * QR_t,
+                        VECTOR_SHORT * R_t,
+                        VECTOR_SHORT * hh,
+                        VECTOR_SHORT * ff,
+                        VECTOR_SHORT J,
+                        VECTOR_SHORT * _h_min,
+                        VECTOR_SHORT * _h_max,
+                        VECTOR_SHORT Mm,
+                        VECTOR_SHORT M_QR_t_left,
+                        VECTOR_SHORT M_R_t_left,
+                        VECTOR_SHORT M_QR_q_interior,
+                        VECTOR_SHORT M_QR_q_right,
+                        int64_t ql,
+                        bool ends)
+{
+  VECTOR_SHORT h[CDEPTH];
+  VECTOR_SHORT f[CDEPTH];
+  struct count16_s cm[CDEPTH];
+  struct count16_s cd[CDEPTH];
+
+  VECTOR_SHORT h_min = v_zero;
+  VECTOR_SHORT h_max = v_zero;
+  VECTOR_SHORT one = v_dup(1);
+
+  /* row -1: gaps in the query up to each column */
+
+  for(int t = 0; t < CDEPTH; t++)
+    {
+      VECTOR_SHORT j = v_add(J, v_dup(t));
+      h[t] = hh[t];
+      f[t] = v_sub(ff[t], QR_t[t]);
+      cm[t].match = v_zero;
+      cm[t].diag = v_zero;
+      cm[t].gaps = v_min(j, one);
+      cm[t].trim = v_sub(v_zero, j);
+      cm[t].run = v_zero;
+      cd[t].match = v_zero;
+      cd[t].diag = v_zero;
+      cd[t].gaps = one;
+      cd[t].trim = v_sub(v_zero, v_add(j, one));
+      cd[t].run = v_zero;
+    }
+
+  /* column -1 of new targets: gaps in the target up to each row */
+
+  struct count16_s left;
+  left.match = v_zero;
+  left.diag = v_zero;
+  left.gaps = one;
+  left.run = v_zero;
+
+  for(int64_t i = 0; i < ql; i++)
+    {
+      VECTOR_SHORT * vp = qp[i];
+      VECTOR_SHORT * mp = qp[i] + MPROFILE;
+      VECTOR_SHORT QR_q = (i < ql - 1) ? QR_q_i : QR_q_r;
+      VECTOR_SHORT R_q = (i < ql - 1) ? R_q_i : R_q_r;
+      VECTOR_SHORT M_QR_q = (i < ql - 1) ? M_QR_q_interior : M_QR_q_right;
+      bool runs = ends || (i == ql - 1);
+
+      VECTOR_SHORT h4 = hep[2*i+0];
+      VECTOR_SHORT E = hep[2*i+1];
+
+      h4 = v_sub_unsigned(h4, Mm);
+      h4 = v_sub(h4, M_QR_t_left);
+
+      E = v_sub_unsigned(E, Mm);
+      E = v_sub(E, M_QR_t_left);
+      E = v_sub(E, M_QR_q);
+
+      M_QR_t_left = v_add(M_QR_t_left, M_R_t_left);
+
+      left.trim = v_dup(i + 1);
+
+      struct count16_s ci = cep[2*i+0];
+      struct count16_s cl = cep[2*i+1];
+      ci.match = v_select(Mm, left.match, ci.match);
+      ci.diag = v_select(Mm, left.diag, ci.diag);
+      ci.gaps = v_select(Mm, left.gaps, ci.gaps);
+      ci.trim = v_select(Mm, left.trim, ci.trim);
+      ci.run = v_select(Mm, left.run, ci.run);
+      cl.match = v_select(Mm, left.match, cl.match);
+      cl.diag = v_select(Mm, left.diag, cl.diag);
+      cl.gaps = v_select(Mm, left.gaps, cl.gaps);
+      cl.trim = v_select(Mm, left.trim, cl.trim);
+
+      for(int t = 0; t < CDEPTH; t++)
+        {
+          VECTOR_SHORT hd = h[t];
+          struct count16_s cn = cm[t];
+          aligncount(& hd, f + t, & E, vp[t], mp[t],
+                     QR_q, R_q, QR_t[t], R_t[t],
+                     & h_min, & h_max,
+                     & cn, cd + t, & ci, runs);
+          h[t] = h4;
+          cm[t] = cl;
+          h4 = hd;
+          cl = cn;
+        }
+
+      hep[2*i+0] = h4;
+      hep[2*i+1] = E;
+      cep[2*i+0] = ci;
+      cep[2*i+1] = cl;
+
+      if (i == ql - 1)
+        {
+          /* h[t] and cm[t] now hold the last row of column t-1 */
+          for(int t = 0; t < CDEPTH - 1; t++)
+            {
+              Sm[t] = h[t+1];
+              Sc[t] = cm[t+1];
+            }
+          Sm[CDEPTH-1] = h4;
+          Sc[CDEPTH-1] = cl;
+        }
+    }
+
+  *_h_min = h_min;
+  *_h_max = h_max;
+}
+
 inline void pushop(s16info_s * s, char newop)
 {
   if (newop == s->op)
@@ -812,25 +1149,76 @@ inline void finishop(s16info_s * s)
     }
 }
 
+inline uint64_t backtrack16_dir(unsigned short * dirbuffer,
+                                uint64_t dirbuffersize,
+                                uint64_t offset,
+                                uint64_t qlen,
+                                uint64_t i,
+                                uint64_t j)
+{
+  /* direction bits of all channels for query position i, target j */
+  unsigned short * p = dirbuffer + (offset + DIRSHORTS * (4 * qlen * (j/4) +
+                                                          4 * i + (j&3)))
+    % dirbuffersize;
+#ifdef __x86_64__
+  return *((uint32_t *) p);
+#else
+  return *((uint64_t *) p);
+#endif
+}
+
+inline uint64_t backtrack16_striped_dir(unsigned short * dirbuffer,
+                                        uint64_t seglen,
+                                        uint64_t i,
+                                        uint64_t j)
+{
+  /* direction bits of query position i, target j, in the striped
+     layout of search16_striped(), shifted down to channel 0 */
+  unsigned short * p = dirbuffer + 2 * (seglen * j + i % seglen);
+  return (*((uint32_t *) p)) >> (i / seglen);
+}
+
+/*
+  Trace back the alignment in the given channel. With seglen zero the
+  direction bits are those of the inter-sequence aligner, otherwise
+  those of the striped aligner with seglen segments.
+*/
+
 void backtrack16(s16info_s * s,
                  char * dseq,
                  uint64_t dlen,
                  uint64_t offset,
                  uint64_t channel,
+                 uint64_t seglen,
                  unsigned short * paligned,
                  unsigned short * pmatches,
                  unsigned short * pmismatches,
                  unsigned short * pgaps)
 {
   unsigned short * dirbuffer = s->dir;
-  uint64_t dirbuffersize = s->qlen * s->maxdlen * 4;
+  uint64_t dirbuffersize = s->qlen * s->maxdlen * DIRSHORTS;
   uint64_t qlen = s->qlen;
   char * qseq = s->qseq;
 
+#ifdef __x86_64__
+  uint64_t maskup      = 1ULL << (channel+ 0);
+  uint64_t maskleft    = 1ULL << (channel+ 8);
+  uint64_t maskextup   = 1ULL << (channel+16);
+  uint64_t maskextleft = 1ULL << (channel+24);
+#else
   uint64_t maskup      = 3ULL << (2*channel+ 0);
   uint64_t maskleft    = 3ULL << (2*channel+16);
   uint64_t maskextup   = 3ULL << (2*channel+32);
   uint64_t maskextleft = 3ULL << (2*channel+48);
+#endif
+
+  if (seglen)
+    {
+      maskup      = 1ULL <<  0;
+      maskleft    = 1ULL <<  8;
+      maskextup   = 1ULL << 16;
+      maskextleft = 1ULL << 24;
+    }
 
 #if 0
 
@@ -840,9 +1228,8 @@ void backtrack16(s16info_s * s,
     {
       for(uint64_t j=0; j<dlen; j++)
         {
-          uint64_t d = *((uint64_t *) (dirbuffer +
-                                       (offset + 16*s->qlen*(j/4) +
-                                        16*i + 4*(j&3)) % dirbuffersize));
+          uint64_t d = backtrack16_dir(dirbuffer, dirbuffersize,
+                                       offset, qlen, i, j);
           if (d & maskup)
             {
               if (d & maskleft)
@@ -868,9 +1255,8 @@ void backtrack16(s16info_s * s,
     {
       for(uint64_t j=0; j<dlen; j++)
         {
-          uint64_t d = *((uint64_t *) (dirbuffer +
-                                       (offset + 16*s->qlen*(j/4) +
-                                        16*i + 4*(j&3)) % dirbuffersize));
+          uint64_t d = backtrack16_dir(dirbuffer, dirbuffersize,
+                                       offset, qlen, i, j);
           if (d & maskextup)
             {
               if (d & maskextleft)
@@ -908,9 +1294,9 @@ void backtrack16(s16info_s * s,
     {
       aligned++;
 
-      uint64_t d = *((uint64_t *) (dirbuffer +
-                                   (offset + 16*s->qlen*(j/4) +
-                                    16*i + 4*(j&3)) % dirbuffersize));
+      uint64_t d = seglen ?
+        backtrack16_striped_dir(dirbuffer, seglen, i, j) :
+        backtrack16_dir(dirbuffer, dirbuffersize, offset, qlen, i, j);
 
       if ((s->op == 'I') && (d & maskextleft))
         {
@@ -1012,14 +1398,22 @@ struct s16info_s * search16_init(CELL score_match,
   auto * s = (struct s16info_s *)
     xmalloc(sizeof(struct s16info_s));
 
-  s->dprofile = (VECTOR_SHORT *) xmalloc(2*4*8*16);
+  s->dprofile = (VECTOR_SHORT *) xmalloc(2 * MPROFILE * sizeof(VECTOR_SHORT));
   s->qlen = 0;
+  s->qalloc = 0;
   s->qseq = nullptr;
   s->maxdlen = 0;
   s->dir = nullptr;
   s->diralloc = 0;
   s->hearray = nullptr;
+  s->carray = nullptr;
+  s->sarray = nullptr;
+  s->sseglen = 0;
   s->qtable = nullptr;
+  s->qtable_fwd = nullptr;
+  s->qtable_rev = nullptr;
+  s->qseq_fwd = nullptr;
+  s->qseq_rev = nullptr;
   s->cigar = nullptr;
   s->cigarend = nullptr;
   s->cigaralloc = 0;
@@ -1042,6 +1436,7 @@ struct s16info_s * search16_init(CELL score_match,
               value = opt_mismatch;
             }
           ((CELL*)(&s->matrix))[16*i+j] = value;
+          ((CELL*)(&s->mmatrix))[16*i+j] = (i & j) ? -1 : 0;
           scorematrix[i][j] = value;
         }
     }
@@ -1088,14 +1483,18 @@ void search16_exit(s16info_s * s)
   if (s->hearray)
     {
       xfree(s->hearray);
+      xfree(s->carray);
+      xfree(s->sarray);
     }
   if (s->dprofile)
     {
       xfree(s->dprofile);
     }
-  if (s->qtable)
+  if (s->qtable_fwd)
     {
-      xfree(s->qtable);
+      xfree(s->qtable_fwd);
+      xfree(s->qtable_rev);
+      xfree(s->qseq_rev);
     }
   if (s->cigar)
     {
@@ -1104,39 +1503,485 @@ void search16_exit(s16info_s * s)
   xfree(s);
 }
 
-void search16_qprep(s16info_s * s, char * qseq, int qlen)
+/*
+  The query profile is a table with a pointer into the score profile
+  for each query position. search16_qprep() prepares the profile of a
+  query, search16_qprep_strands() also that of its reverse complement
+  in the same pass. search16_qselect() then selects a strand and a
+  part of the query for the following calls to search16(), without
+  preparing it again, e.g. for each strand of a query or for the
+  parts and the whole query in chimera detection.
+*/
+
+static void search16_qalloc(s16info_s * s, int qlen)
 {
-  s->qlen = qlen;
-  s->qseq = qseq;
+  /* the query buffers only grow, they are reused for shorter queries */
 
-  if (s->hearray)
+  if ((qlen > s->qalloc) || (! s->hearray))
     {
-      xfree(s->hearray);
+      s->qalloc = qlen;
+      if (s->hearray)
+        {
+          xfree(s->hearray);
+          xfree(s->carray);
+          xfree(s->sarray);
+          xfree(s->qtable_fwd);
+          xfree(s->qtable_rev);
+          xfree(s->qseq_rev);
+        }
+      s->hearray = (VECTOR_SHORT *) xmalloc(2 * s->qalloc * sizeof(VECTOR_SHORT));
+      s->carray = (VECTOR_SHORT *)
+        xmalloc(2 * s->qalloc * sizeof(struct count16_s));
+      memset(s->carray, 0, 2 * s->qalloc * sizeof(struct count16_s));
+      s->sarray = (VECTOR_SHORT *)
+        xmalloc(SSTRIDE * ((s->qalloc + CHANNELS - 1) / CHANNELS) *
+                sizeof(VECTOR_SHORT));
+      s->qtable_fwd = (VECTOR_SHORT **) xmalloc(s->qalloc * sizeof(VECTOR_SHORT*));
+      s->qtable_rev = (VECTOR_SHORT **) xmalloc(s->qalloc * sizeof(VECTOR_SHORT*));
+      s->qseq_rev = (char *) xmalloc(s->qalloc + 1);
     }
-  s->hearray = (VECTOR_SHORT *) xmalloc(2 * s->qlen * sizeof(VECTOR_SHORT));
+}
+
+void search16_qselect(s16info_s * s, int strand, int offset, int len)
+{
+  s->qtable = (strand ? s->qtable_rev : s->qtable_fwd) + offset;
+  s->qseq = (strand ? s->qseq_rev : s->qseq_fwd) + offset;
+  s->qlen = len;
+  s->sseglen = 0;
+
   memset(s->hearray, 0, 2 * s->qlen * sizeof(VECTOR_SHORT));
+}
 
-  if (s->qtable)
+void search16_qprep(s16info_s * s, char * qseq, int qlen)
+{
+  search16_qalloc(s, qlen);
+  s->qseq_fwd = qseq;
+
+  for(int i = 0; i < qlen; i++)
     {
-      xfree(s->qtable);
+      s->qtable_fwd[i] = s->dprofile + 4 * chrmap_4bit[(int)(qseq[i])];
     }
-  s->qtable = (VECTOR_SHORT **) xmalloc(s->qlen * sizeof(VECTOR_SHORT*));
+
+  search16_qselect(s, 0, 0, qlen);
+}
+
+void search16_qprep_strands(s16info_s * s, char * qseq, int qlen)
+{
+  search16_qalloc(s, qlen);
+  s->qseq_fwd = qseq;
 
   for(int i = 0; i < qlen; i++)
     {
-      s->qtable[i] = s->dprofile + 4 * chrmap_4bit[(int)(qseq[i])];
+      const unsigned char c = qseq[i];
+      const unsigned char r = chrmap_complement[c];
+      s->qtable_fwd[i] = s->dprofile + 4 * chrmap_4bit[c];
+      s->qtable_rev[qlen - 1 - i] = s->dprofile + 4 * chrmap_4bit[r];
+      s->qseq_rev[qlen - 1 - i] = r;
     }
+  s->qseq_rev[qlen] = 0;
+
+  search16_qselect(s, 0, 0, qlen);
 }
 
-void search16(s16info_s * s,
-              unsigned int sequences,
-              unsigned int * seqnos,
-              CELL * pscores,
-              unsigned short * paligned,
-              unsigned short * pmatches,
-              unsigned short * pmismatches,
-              unsigned short * pgaps,
-              char ** pcigar)
+/* scores at or below this limit may have overflowed in the next cell */
+
+static short search16_score_min(s16info_s * s)
+{
+  short gap_penalty_max = 0;
+
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_query_left +
+                        s->penalty_gap_extension_query_left);
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_query_interior +
+                        s->penalty_gap_extension_query_interior);
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_query_right +
+                        s->penalty_gap_extension_query_right);
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_target_left +
+                        s->penalty_gap_extension_target_left);
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_target_interior +
+                        s->penalty_gap_extension_target_interior);
+  gap_penalty_max = MAX(gap_penalty_max,
+                        s->penalty_gap_open_target_right +
+                        s->penalty_gap_extension_target_right);
+
+  return SHRT_MIN + gap_penalty_max;
+}
+
+#ifndef __PPC__
+
+/*
+  Striped alignment of the query with a single target, after Farrar
+  (2007), for calls with too few targets to fill the channels of the
+  inter-sequence aligner. Query position i is in channel i / seglen of
+  segment i % seglen, and the target is the outer loop. A first pass
+  over the segments of a column carries the vertical gaps (F) within
+  each channel only, a second ("lazy F") loop carries them on across
+  the channels until no value improves, and a final pass derives the
+  direction bits and the horizontal gaps (E) for the next column.
+  The gap model, the saturating arithmetic, the overflow check and the
+  direction bits are those of search16(), so the scores and alignments
+  are identical.
+*/
+
+inline CELL saturate16(int64_t x)
+{
+  return (CELL) MIN(MAX(x, SHRT_MIN), SHRT_MAX);
+}
+
+static void search16_sprep(s16info_s * s)
+{
+  /* prepare the striped score profile and query gap penalties */
+
+  int64_t qlen = s->qlen;
+  int64_t seglen = (qlen + CHANNELS - 1) / CHANNELS;
+  auto * matrix = (CELL *) s->matrix;
+  auto * profile = (CELL *) s->sarray;
+  CELL * qr = profile + CHANNELS * 16 * seglen;
+  CELL * r = qr + CHANNELS * seglen;
+  CELL * lo = r + CHANNELS * seglen;
+  CELL * hi = lo + CHANNELS * seglen;
+
+  for(int64_t k = 0; k < seglen; k++)
+    {
+      for(int64_t c = 0; c < CHANNELS; c++)
+        {
+          int64_t i = c * seglen + k;
+          int64_t x = CHANNELS * k + c;
+          int q = (i < qlen) ? chrmap_4bit[(int)(s->qseq[i])] : -1;
+
+          for(int d = 0; d < 16; d++)
+            {
+              profile[CHANNELS * seglen * d + x] =
+                (q >= 0) ? matrix[16 * d + q] : 0;
+            }
+
+          if (i == qlen - 1)
+            {
+              qr[x] = s->penalty_gap_open_query_right +
+                s->penalty_gap_extension_query_right;
+              r[x] = s->penalty_gap_extension_query_right;
+            }
+          else
+            {
+              qr[x] = s->penalty_gap_open_query_interior +
+                s->penalty_gap_extension_query_interior;
+              r[x] = s->penalty_gap_extension_query_interior;
+            }
+
+          /* keep rows beyond the query out of the overflow check */
+          lo[x] = (i < qlen) ? SHRT_MIN : 0;
+          hi[x] = (i < qlen) ? SHRT_MAX : 0;
+        }
+    }
+
+  s->sseglen = seglen;
+}
+
+static void search16_striped(s16info_s * s,
+                             unsigned int seqno,
+                             CELL * pscore,
+                             unsigned short * paligned,
+                             unsigned short * pmatches,
+                             unsigned short * pmismatches,
+                             unsigned short * pgaps,
+                             char ** pcigar)
+{
+  int64_t qlen = s->qlen;
+  int64_t dlen = db_getsequencelen(seqno);
+
+  if ((dlen == 0) || (qlen * dlen > MAXSEQLENPRODUCT))
+    {
+      * pscore = SHRT_MAX;
+      * paligned = 0;
+      * pmatches = 0;
+      * pmismatches = 0;
+      * pgaps = 0;
+      * pcigar = xstrdup("");
+      return;
+    }
+
+  if (! s->sseglen)
+    {
+      search16_sprep(s);
+    }
+
+  int64_t seglen = s->sseglen;
+  int64_t dpad = 4 * ((dlen + 3) / 4);
+
+  /* two shorts of direction bits per segment and column */
+
+  uint64_t dirbuffersize = 2 * seglen * dpad;
+  if (dirbuffersize > s->diralloc)
+    {
+      s->diralloc = dirbuffersize;
+      if (s->dir)
+        {
+          xfree(s->dir);
+        }
+      s->dir = (unsigned short*) xmalloc(dirbuffersize *
+                                         sizeof(unsigned short));
+    }
+
+  s->maxdlen = dpad;
+  if (s->qlen + s->maxdlen + 1 > s->cigaralloc)
+    {
+      s->cigaralloc = s->qlen + s->maxdlen + 1;
+      if (s->cigar)
+        {
+          xfree(s->cigar);
+        }
+      s->cigar = (char *) xmalloc(s->cigaralloc);
+    }
+
+  VECTOR_SHORT * profile = s->sarray;
+  VECTOR_SHORT * QR_query = profile + 16 * seglen;
+  VECTOR_SHORT * R_query = QR_query + seglen;
+  VECTOR_SHORT * Lo = R_query + seglen;
+  VECTOR_SHORT * Hi = Lo + seglen;
+  VECTOR_SHORT * Harray = Hi + seglen;
+  VECTOR_SHORT * Earray = Harray + seglen;
+  VECTOR_SHORT * Farray = Earray + seglen;
+  VECTOR_SHORT * Varray = Farray + seglen;
+
+  /* column -1: a gap in the target at its left end */
+
+  auto * h_init = (CELL *) Harray;
+  auto * e_init = (CELL *) Earray;
+  auto * qr = (CELL *) QR_query;
+  CELL m = s->penalty_gap_open_target_left +
+    s->penalty_gap_extension_target_left;
+  for(int64_t i = 0; i < CHANNELS * seglen; i++)
+    {
+      int64_t x = CHANNELS * (i % seglen) + i / seglen;
+      h_init[x] = saturate16(- m);
+      e_init[x] = saturate16(h_init[x] - qr[x]);
+      m = saturate16(m + s->penalty_gap_extension_target_left);
+    }
+
+  VECTOR_SHORT QR_target_interior =
+    v_dup((s->penalty_gap_open_target_interior +
+           s->penalty_gap_extension_target_interior));
+  VECTOR_SHORT R_target_interior =
+    v_dup(s->penalty_gap_extension_target_interior);
+  VECTOR_SHORT QR_target_right =
+    v_dup((s->penalty_gap_open_target_right +
+           s->penalty_gap_extension_target_right));
+  VECTOR_SHORT R_target_right =
+    v_dup(s->penalty_gap_extension_target_right);
+  CELL qr_target_interior = s->penalty_gap_open_target_interior +
+    s->penalty_gap_extension_target_interior;
+  CELL qr_target_right = s->penalty_gap_open_target_right +
+    s->penalty_gap_extension_target_right;
+  CELL r_query_left = s->penalty_gap_extension_query_left;
+
+  VECTOR_SHORT F_min = v_init(SHRT_MIN, 0, 0, 0, 0, 0, 0, 0);
+  VECTOR_SHORT h_min = v_zero;
+  VECTOR_SHORT h_max = v_zero;
+
+  auto * dseq = (unsigned char *) db_getsequence(seqno);
+  unsigned short * dir = s->dir;
+  int64_t last = qlen - 1;
+  CELL score = 0;
+
+  /* row -1, a gap in the query at its left end: h_diag is the score
+     diagonally above the first row, f_top the gap entering it */
+
+  CELL h_diag = 0;
+  CELL f_top = 0;
+
+  for(int64_t j = 0; j < dpad; j++)
+    {
+      if (j < 4)
+        {
+          h_diag = (j == 0) ? 0 : (- s->penalty_gap_open_query_left
+                                   - j * s->penalty_gap_extension_query_left);
+          f_top = - s->penalty_gap_open_query_left
+            - (j + 1) * s->penalty_gap_extension_query_left;
+        }
+      else
+        {
+          h_diag = saturate16(h_diag - r_query_left);
+          f_top = saturate16(f_top - r_query_left);
+        }
+
+      VECTOR_SHORT QR_target = QR_target_interior;
+      VECTOR_SHORT R_target = R_target_interior;
+      CELL qr_target = qr_target_interior;
+      if (j >= dlen - 1)
+        {
+          QR_target = QR_target_right;
+          R_target = R_target_right;
+          qr_target = qr_target_right;
+        }
+
+      int d = (j < dlen) ? chrmap_4bit[dseq[j]] : 0;
+      VECTOR_SHORT * vp = profile + seglen * d;
+
+      /* first pass, vertical gaps within each channel */
+
+      VECTOR_SHORT H = v_add(v_shift_left(Harray[seglen - 1]),
+                             v_init(h_diag, 0, 0, 0, 0, 0, 0, 0));
+      VECTOR_SHORT F = v_init(saturate16(f_top - qr_target),
+                              SHRT_MIN, SHRT_MIN, SHRT_MIN,
+                              SHRT_MIN, SHRT_MIN, SHRT_MIN, SHRT_MIN);
+
+      for(int64_t k = 0; k < seglen; k++)
+        {
+          VECTOR_SHORT V = v_add(H, vp[k]);
+          VECTOR_SHORT N = v_max(v_max(V, F), Earray[k]);
+          H = Harray[k];
+          Harray[k] = N;
+          Varray[k] = V;
+          Farray[k] = F;
+          F = v_max(v_sub(F, R_target), v_sub(N, QR_target));
+        }
+
+      /* lazy F loop, vertical gaps across the channels */
+
+      F = v_add(v_shift_left(F), F_min);
+      int64_t k = 0;
+      while (v_mask_gt(F, Farray[k]))
+        {
+          VECTOR_SHORT G = v_max(Farray[k], F);
+          VECTOR_SHORT N = v_max(Harray[k], G);
+          Farray[k] = G;
+          Harray[k] = N;
+          F = v_max(v_sub(G, R_target), v_sub(N, QR_target));
+          if (++k == seglen)
+            {
+              F = v_add(v_shift_left(F), F_min);
+              k = 0;
+            }
+        }
+
+      /* final pass, direction bits and horizontal gaps */
+
+      for(k = 0; k < seglen; k++)
+        {
+          VECTOR_SHORT V = Varray[k];
+          VECTOR_SHORT G = Farray[k];
+          VECTOR_SHORT E = Earray[k];
+          VECTOR_SHORT N = Harray[k];
+          VECTOR_SHORT W = v_cmp_gt(G, V);
+          VECTOR_SHORT X = v_cmp_gt(E, v_max(V, G));
+          dir[2*k+0] = v_mask_pack(W, X);
+          VECTOR_SHORT HF = v_sub(N, QR_target);
+          G = v_sub(G, R_target);
+          W = v_cmp_gt(G, HF);
+          VECTOR_SHORT HE = v_sub(N, QR_query[k]);
+          E = v_sub(E, R_query[k]);
+          X = v_cmp_gt(E, HE);
+          dir[2*k+1] = v_mask_pack(W, X);
+          Earray[k] = v_max(E, HE);
+          h_min = v_min(h_min, v_max(N, Lo[k]));
+          h_max = v_max(h_max, v_min(N, Hi[k]));
+        }
+
+      if (j == dlen - 1)
+        {
+          score = ((CELL *)(Harray + last % seglen))[last / seglen];
+        }
+
+      dir += 2 * seglen;
+    }
+
+  short score_min = search16_score_min(s);
+  bool overflow = false;
+  for(int c = 0; c < CHANNELS; c++)
+    {
+      if ((((CELL *)(& h_min))[c] <= score_min) ||
+          (((CELL *)(& h_max))[c] >= SHRT_MAX))
+        {
+          overflow = true;
+        }
+    }
+
+  if (overflow)
+    {
+      * pscore = SHRT_MAX;
+      * paligned = 0;
+      * pmatches = 0;
+      * pmismatches = 0;
+      * pgaps = 0;
+      * pcigar = xstrdup("");
+    }
+  else
+    {
+      * pscore = score;
+      backtrack16(s, (char *) dseq, dlen, 0, 0, seglen,
+                  paligned, pmatches, pmismatches, pgaps);
+      * pcigar = xstrdup(s->cigar);
+    }
+}
+
+#endif
+
+/*
+  The terminal gaps at both ends of an alignment, read from its cigar
+  string in the same way as align_trim() does, in the order of ptrims
+  below.
+*/
+
+static void search16_trims(char * cigar, unsigned short * trims)
+{
+  for(int k = 0; k < 4; k++)
+    {
+      trims[k] = 0;
+    }
+
+  char * e = cigar + strlen(cigar);
+  if (e == cigar)
+    {
+      return;
+    }
+
+  int64_t run = 1;
+  int scanlength = 0;
+  sscanf(cigar, "%" PRId64 "%n", &run, &scanlength);
+  char op = cigar[scanlength];
+  if (op != 'M')
+    {
+      trims[(op == 'D') ? 0 : 1] = run;
+    }
+
+  char * p = e - 1;
+  op = *p;
+  if (op != 'M')
+    {
+      while ((p > cigar) && (*(p-1) <= '9'))
+        {
+          p--;
+        }
+      run = 1;
+      sscanf(p, "%" PRId64, &run);
+      trims[(op == 'D') ? 2 : 3] = run;
+    }
+}
+
+/*
+  Align the query with the targets, eight at a time. With ptrims only
+  the numbers of each alignment are needed, and its four terminal gaps
+  are stored in ptrims instead of a cigar string in pcigar. They are
+  still traced back when the direction matrix can hold all targets, as
+  that is faster with SSE2, but if a target is too long for it they
+  are counted during the alignment itself (see aligncount()) and the
+  linear memory aligner is not needed.
+*/
+
+static void search16_align(s16info_s * s,
+                           unsigned int sequences,
+                           unsigned int * seqnos,
+                           CELL * pscores,
+                           unsigned short * paligned,
+                           unsigned short * pmatches,
+                           unsigned short * pmismatches,
+                           unsigned short * pgaps,
+                           char ** pcigar,
+                           unsigned short * ptrims)
 {
   CELL ** q_start = (CELL**) s->qtable;
   CELL * dprofile = (CELL*) s->dprofile;
@@ -1168,6 +2013,16 @@ void search16(s16info_s * s,
                     length * s->penalty_gap_extension_target_right);
             }
 
+          if (ptrims)
+            {
+              /* the whole alignment is a gap at both ends */
+              ptrims[4*cand_id+0] = 0;
+              ptrims[4*cand_id+1] = length;
+              ptrims[4*cand_id+2] = 0;
+              ptrims[4*cand_id+3] = length;
+              continue;
+            }
+
           char * cigar = nullptr;
           if (length > 0)
             {
@@ -1187,6 +2042,39 @@ void search16(s16info_s * s,
       return;
     }
 
+  bool count = false;
+  if (ptrims)
+    {
+      for(int64_t i = 0; i < sequences; i++)
+        {
+          if (qlen * db_getsequencelen(seqnos[i]) > MAXSEQLENPRODUCT)
+            {
+              count = true;
+            }
+        }
+    }
+
+#ifndef __PPC__
+  if ((sequences < CHANNELS / 2) && ! count)
+    {
+      /* too few targets to fill half of the channels */
+      for (unsigned int cand_id = 0; cand_id < sequences; cand_id++)
+        {
+          char * cigar = nullptr;
+          search16_striped(s, seqnos[cand_id], pscores + cand_id,
+                           paligned + cand_id, pmatches + cand_id,
+                           pmismatches + cand_id, pgaps + cand_id,
+                           ptrims ? & cigar : pcigar + cand_id);
+          if (ptrims)
+            {
+              search16_trims(cigar, ptrims + 4 * cand_id);
+              xfree(cigar);
+            }
+        }
+      return;
+    }
+#endif
+
   /* find longest target sequence and reallocate direction buffer */
   uint64_t maxdlen = 0;
   for(int64_t i = 0; i < sequences; i++)
@@ -1203,9 +2091,9 @@ void search16(s16info_s * s,
     }
   maxdlen = 4 * ((maxdlen + 3) / 4);
   s->maxdlen = maxdlen;
-  uint64_t dirbuffersize = s->qlen * s->maxdlen * 4;
+  uint64_t dirbuffersize = s->qlen * s->maxdlen * DIRSHORTS;
 
-  if (dirbuffersize > s->diralloc)
+  if ((dirbuffersize > s->diralloc) && ! count)
     {
       s->diralloc = dirbuffersize;
       if (s->dir)
@@ -1218,7 +2106,7 @@ void search16(s16info_s * s,
 
   unsigned short * dirbuffer = s->dir;
 
-  if (s->qlen + s->maxdlen + 1 > s->cigaralloc)
+  if ((s->qlen + s->maxdlen + 1 > s->cigaralloc) && ! count)
     {
       s->cigaralloc = s->qlen + s->maxdlen + 1;
       if (s->cigar)
@@ -1230,6 +2118,12 @@ void search16(s16info_s * s,
 
   VECTOR_SHORT M, T0;
 
+  /* for counting: target position of the first column of the block,
+     counters of the last row and of the last column */
+  VECTOR_SHORT J = v_zero;
+  struct count16_s Sc[CDEPTH];
+  auto * cep = (struct count16_s *) s->carray;
+
   VECTOR_SHORT M_QR_target_left, M_R_target_left;
   VECTOR_SHORT M_QR_query_interior;
   VECTOR_SHORT M_QR_query_right;
@@ -1299,28 +2193,7 @@ void search16(s16info_s * s,
       overflow[c] = false;
     }
 
-  short gap_penalty_max = 0;
-
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_query_left +
-                        s->penalty_gap_extension_query_left);
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_query_interior +
-                        s->penalty_gap_extension_query_interior);
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_query_right +
-                        s->penalty_gap_extension_query_right);
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_target_left +
-                        s->penalty_gap_extension_target_left);
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_target_interior +
-                        s->penalty_gap_extension_target_interior);
-  gap_penalty_max = MAX(gap_penalty_max,
-                        s->penalty_gap_open_target_right +
-                        s->penalty_gap_extension_target_right);
-
-  short score_min = SHRT_MIN + gap_penalty_max;
+  short score_min = search16_score_min(s);
   short score_max = SHRT_MAX;
 
   for(int i=0; i<4; i++)
@@ -1369,6 +2242,11 @@ void search16(s16info_s * s,
             }
 
           dprofile_fill16(dprofile, (CELL*) s->matrix, dseq);
+          if (count)
+            {
+              dprofile_fill16(dprofile + CHANNELS * MPROFILE,
+                              (CELL*) s->mmatrix, dseq);
+            }
 
           /* create vectors of gap penalties for target depending on whether
              any of the database sequences ended in these four columns */
@@ -1411,17 +2289,32 @@ void search16(s16info_s * s,
 
           VECTOR_SHORT h_min, h_max;
 
-          aligncolumns_rest(S, hep, qp,
-                            QR_query_interior, R_query_interior,
-                            QR_query_right, R_query_right,
-                            QR_target[0], R_target[0],
-                            QR_target[1], R_target[1],
-                            QR_target[2], R_target[2],
-                            QR_target[3], R_target[3],
-                            H0, H1, H2, H3,
-                            F0, F1, F2, F3,
-                            & h_min, & h_max,
-                            qlen, dir);
+          if (count)
+            {
+              VECTOR_SHORT hh[CDEPTH] = { H0, H1, H2, H3 };
+              VECTOR_SHORT ff[CDEPTH] = { F0, F1, F2, F3 };
+              aligncolumns_count(S, Sc, hep, cep, qp,
+                                 QR_query_interior, R_query_interior,
+                                 QR_query_right, R_query_right,
+                                 QR_target, R_target, hh, ff, J,
+                                 & h_min, & h_max,
+                                 v_zero, v_zero, v_zero, v_zero, v_zero,
+                                 qlen, ! easy);
+            }
+          else
+            {
+              aligncolumns_rest(S, hep, qp,
+                                QR_query_interior, R_query_interior,
+                                QR_query_right, R_query_right,
+                                QR_target[0], R_target[0],
+                                QR_target[1], R_target[1],
+                                QR_target[2], R_target[2],
+                                QR_target[3], R_target[3],
+                                H0, H1, H2, H3,
+                                F0, F1, F2, F3,
+                                & h_min, & h_max,
+                                qlen, dir);
+            }
 
           VECTOR_SHORT h_min_vector;
           VECTOR_SHORT h_max_vector;
@@ -1497,19 +2390,46 @@ void search16(s16info_s * s,
                           pmatches[cand_id] = 0;
                           pmismatches[cand_id] = 0;
                           pgaps[cand_id] = 0;
-                          pcigar[cand_id] = xstrdup("");
+                          if (! ptrims)
+                            {
+                              pcigar[cand_id] = xstrdup("");
+                            }
+                        }
+                      else if (count)
+                        {
+                          struct count16_s * sc = Sc + z;
+                          int64_t diag = ((CELL*)(& sc->diag))[c];
+                          int64_t match = ((CELL*)(& sc->match))[c];
+                          int64_t left = ((CELL*)(& sc->trim))[c];
+                          int64_t right = ((CELL*)(& sc->run))[c];
+                          pscores[cand_id] = score;
+                          paligned[cand_id] = s->qlen + dbseqlen - diag;
+                          pmatches[cand_id] = match;
+                          pmismatches[cand_id] = diag - match;
+                          pgaps[cand_id] = ((CELL*)(& sc->gaps))[c];
+                          ptrims[4*cand_id+0] = MAX(left, 0);
+                          ptrims[4*cand_id+1] = MAX(- left, 0);
+                          ptrims[4*cand_id+2] = MAX(right, 0);
+                          ptrims[4*cand_id+3] = MAX(- right, 0);
                         }
                       else
                         {
                           pscores[cand_id] = score;
-                          backtrack16(s, dbseq, dbseqlen, d_offset[c], c,
+                          backtrack16(s, dbseq, dbseqlen, d_offset[c], c, 0,
                                       paligned + cand_id,
                                       pmatches + cand_id,
                                       pmismatches + cand_id,
                                       pgaps + cand_id);
-                          pcigar[cand_id] =
-                            (char *) xmalloc(strlen(s->cigar)+1);
-                          strcpy(pcigar[cand_id], s->cigar);
+                          if (ptrims)
+                            {
+                              search16_trims(s->cigar, ptrims + 4 * cand_id);
+                            }
+                          else
+                            {
+                              pcigar[cand_id] =
+                                (char *) xmalloc(strlen(s->cigar)+1);
+                              strcpy(pcigar[cand_id], s->cigar);
+                            }
                         }
 
                       done++;
@@ -1523,14 +2443,20 @@ void search16(s16info_s * s,
                     {
                       cand_id = next_id++;
                       length = db_getsequencelen(seqnos[cand_id]);
-                      if ((length==0) || (s->qlen * length > MAXSEQLENPRODUCT))
+                      /* the counters are 16-bit, like the scores */
+                      if ((length==0) ||
+                          (count ? (s->qlen + length + CDEPTH > SHRT_MAX) :
+                           (s->qlen * length > MAXSEQLENPRODUCT)))
                         {
                           pscores[cand_id] = SHRT_MAX;
                           paligned[cand_id] = 0;
                           pmatches[cand_id] = 0;
                           pmismatches[cand_id] = 0;
                           pgaps[cand_id] = 0;
-                          pcigar[cand_id] = xstrdup("");
+                          if (! ptrims)
+                            {
+                              pcigar[cand_id] = xstrdup("");
+                            }
                           length = 0;
                           done++;
                         }
@@ -1618,6 +2544,11 @@ void search16(s16info_s * s,
           M_QR_query_right = v_and(M, QR_query_right);
 
           dprofile_fill16(dprofile, (CELL*) s->matrix, dseq);
+          if (count)
+            {
+              dprofile_fill16(dprofile + CHANNELS * MPROFILE,
+                              (CELL*) s->mmatrix, dseq);
+            }
 
           /* create vectors of gap penalties for target depending on whether
              any of the database sequences ended in these four columns */
@@ -1660,21 +2591,40 @@ void search16(s16info_s * s,
 
           VECTOR_SHORT h_min, h_max;
 
-          aligncolumns_first(S, hep, qp,
-                             QR_query_interior, R_query_interior,
-                             QR_query_right, R_query_right,
-                             QR_target[0], R_target[0],
-                             QR_target[1], R_target[1],
-                             QR_target[2], R_target[2],
-                             QR_target[3], R_target[3],
-                             H0, H1, H2, H3,
-                             F0, F1, F2, F3,
-                             & h_min, & h_max,
-                             M,
-                             M_QR_target_left, M_R_target_left,
-                             M_QR_query_interior,
-                             M_QR_query_right,
-                             qlen, dir);
+          if (count)
+            {
+              VECTOR_SHORT hh[CDEPTH] = { H0, H1, H2, H3 };
+              VECTOR_SHORT ff[CDEPTH] = { F0, F1, F2, F3 };
+              J = v_select(M, v_zero, J);
+              aligncolumns_count(S, Sc, hep, cep, qp,
+                                 QR_query_interior, R_query_interior,
+                                 QR_query_right, R_query_right,
+                                 QR_target, R_target, hh, ff, J,
+                                 & h_min, & h_max,
+                                 M,
+                                 M_QR_target_left, M_R_target_left,
+                                 M_QR_query_interior,
+                                 M_QR_query_right,
+                                 qlen, ! easy);
+            }
+          else
+            {
+              aligncolumns_first(S, hep, qp,
+                                 QR_query_interior, R_query_interior,
+                                 QR_query_right, R_query_right,
+                                 QR_target[0], R_target[0],
+                                 QR_target[1], R_target[1],
+                                 QR_target[2], R_target[2],
+                                 QR_target[3], R_target[3],
+                                 H0, H1, H2, H3,
+                                 F0, F1, F2, F3,
+                                 & h_min, & h_max,
+                                 M,
+                                 M_QR_target_left, M_R_target_left,
+                                 M_QR_query_interior,
+                                 M_QR_query_right,
+                                 qlen, dir);
+            }
 
           VECTOR_SHORT h_min_vector;
           VECTOR_SHORT h_max_vector;
@@ -1705,7 +2655,13 @@ void search16(s16info_s * s,
       F2 = v_sub(F1, R_query_left);
       F3 = v_sub(F2, R_query_left);
 
-      dir += 4 * 4 * s->qlen;
+      if (count)
+        {
+          J = v_add(J, v_dup(CDEPTH));
+          continue;
+        }
+
+      dir += 4 * DIRSHORTS * s->qlen;
 
       if (dir >= dirbuffer + dirbuffersize)
         {
@@ -1713,3 +2669,31 @@ void search16(s16info_s * s,
         }
     }
 }
+
+void search16(s16info_s * s,
+              unsigned int sequences,
+              unsigned int * seqnos,
+              CELL * pscores,
+              unsigned short * paligned,
+              unsigned short * pmatches,
+              unsigned short * pmismatches,
+              unsigned short * pgaps,
+              char ** pcigar)
+{
+  search16_align(s, sequences, seqnos, pscores,
+                 paligned, pmatches, pmismatches, pgaps, pcigar, nullptr);
+}
+
+void search16_counts(s16info_s * s,
+                     unsigned int sequences,
+                     unsigned int * seqnos,
+                     CELL * pscores,
+                     unsigned short * paligned,
+                     unsigned short * pmatches,
+                     unsigned short * pmismatches,
+                     unsigned short * pgaps,
+                     unsigned short * ptrims)
+{
+  search16_align(s, sequences, seqnos, pscores,
+                 paligned, pmatches, pmismatches, pgaps, nullptr, ptrims);
+}
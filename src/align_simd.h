@@ -85,6 +85,12 @@ search16_exit(s16info_s * s);
 void
 search16_qprep(s16info_s * s, char * qseq, int qlen);
 
+void
+search16_qprep_strands(s16info_s * s, char * qseq, int qlen);
+
+void
+search16_qselect(s16info_s * s, int strand, int offset, int len);
+
 void
 search16(s16info_s * s,
          unsigned int sequences,
@@ -95,3 +101,23 @@ search16(s16info_s * s,
          unsigned short * pmismatches,
          unsigned short * pgaps,
          char * * pcigar);
+
+/*
+  Like search16(), for callers that need no cigar string. Targets too
+  long for the direction matrix are counted while aligning instead of
+  traced back, so they do not need the linear memory aligner. The
+  terminal gaps at the left and right end of alignment i are stored in
+  ptrims[4*i] to ptrims[4*i+3]: query left, target left, query right
+  and target right.
+*/
+
+void
+search16_counts(s16info_s * s,
+                unsigned int sequences,
+                unsigned int * seqnos,
+                CELL * pscores,
+                unsigned short * paligned,
+                unsigned short * pmatches,
+                unsigned short * pmismatches,
+                unsigned short * pgaps,
+                unsigned short * ptrims);
@@ -374,6 +374,19 @@ void allpairs_thread_run(int64_t t)
   auto * finalhits
     = (struct hit *) xmalloc(sizeof(struct hit) * seqcount);
 
+  /* candidate pairs from the MinHash sketches */
+  unsigned int * seen = nullptr;
+  unsigned int * candidates = nullptr;
+  if (opt_sketch_size)
+    {
+      seen = (unsigned int *) xmalloc(sizeof(unsigned int) * seqcount);
+      candidates = (unsigned int *) xmalloc(sizeof(unsigned int) * seqcount);
+      for(int i = 0; i < seqcount; i++)
+        {
+          seen[i] = UINT_MAX;
+        }
+    }
+
   bool cont = true;
 
   while (cont)
@@ -400,12 +413,28 @@ void allpairs_thread_run(int64_t t)
           si->accepts = 0;
           si->hit_count = 0;
 
-          for(int target = si->query_no + 1;
-              target < seqcount; target++)
+          if (opt_sketch_size)
             {
-              if (opt_acceptall || search_acceptable_unaligned(si, target))
+              unsigned int candidate_count
+                = minhash_candidates(query_no, seen, candidates);
+              for(unsigned int c = 0; c < candidate_count; c++)
                 {
-                  pseqnos[si->hit_count++] = target;
+                  if (search_acceptable_unaligned(si, candidates[c]))
+                    {
+                      pseqnos[si->hit_count++] = candidates[c];
+                    }
+                }
+            }
+          else
+            {
+              for(int target = si->query_no + 1;
+                  target < seqcount; target++)
+                {
+                  if (opt_acceptall ||
+                      search_acceptable_unaligned(si, target))
+                    {
+                      pseqnos[si->hit_count++] = target;
+                    }
                 }
             }
 
@@ -555,6 +584,12 @@ void allpairs_thread_run(int64_t t)
         }
     }
 
+  if (opt_sketch_size)
+    {
+      xfree(candidates);
+      xfree(seen);
+    }
+
   xfree(finalhits);
 
   xfree(pcigar);
@@ -722,6 +757,25 @@ void allpairs_global(char * cmdline, char * progheader)
 
   seqcount = db_getsequencecount();
 
+  if (opt_sketch_size)
+    {
+      minhash_init(seqcount);
+
+      if (! opt_quiet)
+        {
+          fprintf(stderr,
+                  "MinHash sketches of %" PRId64 " values, %u bands of %u rows\n",
+                  opt_sketch_size, minhash_getbands(), minhash_getrows());
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "MinHash sketches of %" PRId64 " values, %u bands of %u rows\n\n",
+                  opt_sketch_size, minhash_getbands(), minhash_getrows());
+        }
+    }
+
   /* prepare reading of queries */
   qmatches = 0;
   queries = 0;
@@ -765,6 +819,10 @@ void allpairs_global(char * cmdline, char * progheader)
   xfree(pthread);
 
   /* clean up, global */
+  if (opt_sketch_size)
+    {
+      minhash_exit();
+    }
   db_free();
   if (opt_matched)
     {
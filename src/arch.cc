@@ -64,8 +64,59 @@
 #include <iostream>
 #include <fstream>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <cerrno>
+#include <csignal>
+#endif
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#elif __linux__
+#include <malloc.h>
+#elif __FreeBSD__
+#include <malloc_np.h>
+#endif
+
+#include <atomic>
+
 const int memalignment = 16;
 
+/* allocations checked against the memory budget (--max_memory) */
+const size_t budget_check_size = 1 << 20;
+
+/* bytes allocated through xmalloc and xrealloc, and not yet freed */
+static std::atomic<int64_t> allocated(0);
+
+static uint64_t arch_usable_size(void * ptr)
+{
+  /* size of an allocated block, zero where it is not known */
+#ifdef _WIN32
+  return _aligned_msize(ptr, memalignment, 0);
+#elif defined(__APPLE__)
+  return malloc_size(ptr);
+#elif defined(__linux__) || defined(__FreeBSD__)
+  return malloc_usable_size(ptr);
+#else
+  (void) ptr;
+  return 0;
+#endif
+}
+
+uint64_t arch_get_allocated()
+{
+  /*
+    Memory currently allocated through xmalloc and xrealloc. It is
+    only counted with a memory budget (--max_memory).
+  */
+
+  const int64_t n = allocated.load(std::memory_order_relaxed);
+  return (n > 0) ? n : 0;
+}
+
 uint64_t arch_get_memused()
 {
 #ifdef _WIN32
@@ -220,6 +271,10 @@ void * xmalloc(size_t size)
     {
       size = 1;
     }
+  if (opt_max_memory && (size >= budget_check_size))
+    {
+      budget_require(size);
+    }
   void * t = nullptr;
 #ifdef _WIN32
   t = _aligned_malloc(size, memalignment);
@@ -233,6 +288,10 @@ void * xmalloc(size_t size)
     {
       fatal("Unable to allocate enough memory.");
     }
+  if (opt_max_memory)
+    {
+      allocated += arch_usable_size(t);
+    }
   return t;
 }
 
@@ -242,6 +301,12 @@ void * xrealloc(void *ptr, size_t size)
     {
       size = 1;
     }
+  const uint64_t old_size = (opt_max_memory && ptr) ?
+    arch_usable_size(ptr) : 0;
+  if (opt_max_memory && (size >= old_size + budget_check_size))
+    {
+      budget_require(size - old_size);
+    }
 #ifdef _WIN32
   void * t = _aligned_realloc(ptr, size, memalignment);
 #else
@@ -251,6 +316,10 @@ void * xrealloc(void *ptr, size_t size)
     {
       fatal("Unable to reallocate enough memory.");
     }
+  if (opt_max_memory)
+    {
+      allocated += (int64_t) arch_usable_size(t) - (int64_t) old_size;
+    }
   return t;
 }
 
@@ -258,6 +327,10 @@ void xfree(void * ptr)
 {
   if (ptr)
     {
+      if (opt_max_memory)
+        {
+          allocated -= arch_usable_size(ptr);
+        }
 #ifdef _WIN32
       _aligned_free(ptr);
 #else
@@ -306,6 +379,33 @@ uint64_t xftello(FILE * stream)
 #endif
 }
 
+int xfseeko(FILE * stream, uint64_t offset, int whence)
+{
+#ifdef _WIN32
+  return _fseeki64(stream, offset, whence);
+#else
+  return fseeko(stream, offset, whence);
+#endif
+}
+
+int xftruncate(int fd, uint64_t length)
+{
+#ifdef _WIN32
+  return _chsize_s(fd, length);
+#else
+  return ftruncate(fd, length);
+#endif
+}
+
+int xfsync(int fd)
+{
+#ifdef _WIN32
+  return _commit(fd);
+#else
+  return fsync(fd);
+#endif
+}
+
 int xopen_read(const char * path)
 {
 #ifdef _WIN32
@@ -328,6 +428,164 @@ int xopen_write(const char * path)
 #endif
 }
 
+int arch_listen_unix(const char * path)
+{
+  /*
+    Create a Unix domain socket listening at the given path. A stale
+    socket left at the path is removed, other files are left alone.
+    Writes to clients that have gone away must not kill the process,
+    so SIGPIPE is ignored. Returns -1 on failure.
+  */
+
+#ifdef _WIN32
+  (void) path;
+  return -1;
+#else
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path))
+    {
+      return -1;
+    }
+
+  xstat_t fs;
+  if ((xstat(path, & fs) == 0) && S_ISSOCK(fs.st_mode))
+    {
+      unlink(path);
+    }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    {
+      return -1;
+    }
+
+  memset(& addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((bind(fd, (struct sockaddr *) & addr, sizeof(addr)) < 0) ||
+      (listen(fd, 16) < 0))
+    {
+      close(fd);
+      return -1;
+    }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  return fd;
+#endif
+}
+
+int arch_accept(int fd)
+{
+#ifdef _WIN32
+  (void) fd;
+  return -1;
+#else
+  int conn = -1;
+  do
+    {
+      conn = accept(fd, nullptr, nullptr);
+    }
+  while ((conn < 0) && ((errno == EINTR) || (errno == ECONNABORTED)));
+  return conn;
+#endif
+}
+
+int arch_set_timeout(int fd, int seconds)
+{
+  /*
+    Let blocking reads and writes on the socket fail after the given
+    number of seconds. Returns -1 on failure.
+  */
+
+#ifdef _WIN32
+  (void) fd;
+  (void) seconds;
+  return -1;
+#else
+  struct timeval tv;
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+  if ((setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, & tv, sizeof(tv)) < 0) ||
+      (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, & tv, sizeof(tv)) < 0))
+    {
+      return -1;
+    }
+  return 0;
+#endif
+}
+
+int64_t arch_write(int fd, const void * buf, uint64_t count)
+{
+  /* write all of the buffer, returns -1 on failure */
+#ifdef _WIN32
+  return _write(fd, buf, count) == (int64_t) count ? count : -1;
+#else
+  uint64_t done = 0;
+  while (done < count)
+    {
+      int64_t n = write(fd, (const char *) buf + done, count - done);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return -1;
+        }
+      done += n;
+    }
+  return count;
+#endif
+}
+
+int arch_mkstemp(char * name_template)
+{
+#ifdef _WIN32
+  if (_mktemp_s(name_template, strlen(name_template) + 1))
+    {
+      return -1;
+    }
+  return _open(name_template,
+               _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY,
+               _S_IREAD | _S_IWRITE);
+#else
+  return mkstemp(name_template);
+#endif
+}
+
+bool arch_input_ready(int fd)
+{
+  /* check, without blocking, if data or end of file can be read */
+#ifdef _WIN32
+  (void) fd;
+  return true;
+#else
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(& pfd, 1, 0) != 0;
+#endif
+}
+
+int64_t arch_read(int fd, void * buf, uint64_t count)
+{
+  /* read what is available, up to count bytes */
+#ifdef _WIN32
+  return _read(fd, buf, count);
+#else
+  int64_t n = -1;
+  do
+    {
+      n = read(fd, buf, count);
+    }
+  while ((n < 0) && (errno == EINTR));
+  return n;
+#endif
+}
+
 const char * xstrcasestr(const char * haystack, const char * needle)
 {
 #ifdef _WIN32
@@ -65,6 +65,7 @@ typedef struct stat xstat_t;
 #endif
 
 uint64_t arch_get_memused();
+uint64_t arch_get_allocated();
 uint64_t arch_get_memtotal();
 long arch_get_cores();
 void arch_get_user_system_time(double * user_time, double * system_time);
@@ -78,10 +79,21 @@ int xfstat(int fd, xstat_t * buf);
 int xstat(const char * path, xstat_t  * buf);
 uint64_t xlseek(int fd, uint64_t offset, int whence);
 uint64_t xftello(FILE * stream);
+int xfseeko(FILE * stream, uint64_t offset, int whence);
+int xftruncate(int fd, uint64_t length);
+int xfsync(int fd);
 
 int xopen_read(const char * path);
 int xopen_write(const char * path);
 
+int arch_listen_unix(const char * path);
+int arch_accept(int fd);
+int arch_set_timeout(int fd, int seconds);
+int arch_mkstemp(char * name_template);
+bool arch_input_ready(int fd);
+int64_t arch_read(int fd, void * buf, uint64_t count);
+int64_t arch_write(int fd, const void * buf, uint64_t count);
+
 const char * xstrcasestr(const char * haystack, const char * needle);
 
 #ifdef _WIN32
@@ -58,6 +58,13 @@
 
 */
 
+bool header_find_attribute(const char * header,
+                           int header_length,
+                           const char * attribute,
+                           int * start,
+                           int * end,
+                           bool allow_decimal);
+
 int64_t header_get_size(char * header, int header_length);
 
 void header_fprint_strip(FILE * fp,
@@ -0,0 +1,349 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+
+/*
+  Checkpointing of long-running search and clustering jobs.
+
+  All output files that are written while the queries are processed
+  are opened with checkpoint_fopen_output, so that their current
+  lengths can be recorded. At regular intervals, when all the work
+  started so far has been completed and written, the command records
+  its own state (e.g. the number of queries processed and the input
+  file offset) with checkpoint_put and calls checkpoint_commit. The
+  output files are then flushed and synced, and the state is written,
+  together with the output file offsets, to a temporary file that is
+  renamed to the checkpoint file. The checkpoint file is therefore
+  always consistent.
+
+  With --resume, the checkpoint is read by checkpoint_init. The output
+  files are then opened without truncation, cut back to the recorded
+  lengths and appended to, and the command restores its state with
+  checkpoint_get before continuing.
+
+  The checkpoint file is removed when the command completes.
+*/
+
+constexpr uint32_t checkpoint_magic = 0x56534350;
+constexpr uint32_t checkpoint_version = 1;
+constexpr int checkpoint_maxoutputs = 32;
+
+static const char * checkpoint_command = nullptr;
+static bool resuming = false;
+static time_t last_checkpoint = 0;
+
+static int output_count = 0;
+static FILE * output_fp[checkpoint_maxoutputs];
+static uint64_t resume_offsets[checkpoint_maxoutputs];
+static int resume_output_count = 0;
+
+/* state of the command, being built or restored */
+static char * state = nullptr;
+static uint64_t state_size = 0;
+static uint64_t state_alloc = 0;
+static uint64_t state_pos = 0;
+
+static void checkpoint_read_file(FILE * fp, void * buf, uint64_t size)
+{
+  if (size && (fread(buf, 1, size, fp) != size))
+    {
+      fatal("Unable to read checkpoint file, truncated or corrupt");
+    }
+}
+
+void checkpoint_init(const char * command)
+{
+  checkpoint_command = command;
+  resuming = false;
+  output_count = 0;
+  last_checkpoint = time(nullptr);
+
+  if (! (opt_checkpoint && opt_resume))
+    {
+      return;
+    }
+
+  FILE * fp = fopen(opt_checkpoint, "rb");
+  if (! fp)
+    {
+      if (! opt_quiet)
+        {
+          fprintf(stderr, "No checkpoint found, starting from the beginning\n");
+        }
+      if (opt_log)
+        {
+          fprintf(fp_log, "No checkpoint found, starting from the beginning\n");
+        }
+      return;
+    }
+
+  uint32_t header[4];
+  checkpoint_read_file(fp, header, sizeof(header));
+
+  if ((header[0] != checkpoint_magic) || (header[1] != checkpoint_version))
+    {
+      fatal("Not a checkpoint file or unsupported version (%s)", opt_checkpoint);
+    }
+
+  resume_output_count = header[2];
+  uint32_t command_len = header[3];
+
+  if (resume_output_count > checkpoint_maxoutputs)
+    {
+      fatal("Corrupt checkpoint file (%s)", opt_checkpoint);
+    }
+
+  char * saved_command = (char *) xmalloc(command_len + 1);
+  checkpoint_read_file(fp, saved_command, command_len);
+  saved_command[command_len] = 0;
+  if (strcmp(saved_command, command) != 0)
+    {
+      fatal("The checkpoint file was written by a different command (%s)",
+            saved_command);
+    }
+  xfree(saved_command);
+
+  checkpoint_read_file(fp, resume_offsets,
+                       resume_output_count * sizeof(uint64_t));
+  checkpoint_read_file(fp, & state_size, sizeof(state_size));
+  state_alloc = state_size + 1;
+  state = (char *) xmalloc(state_alloc);
+  checkpoint_read_file(fp, state, state_size);
+  state_pos = 0;
+
+  fclose(fp);
+
+  resuming = true;
+}
+
+bool checkpoint_resuming()
+{
+  return resuming;
+}
+
+FILE * checkpoint_fopen_output(const char * filename)
+{
+  if (! opt_checkpoint)
+    {
+      return fopen_output(filename);
+    }
+
+  if (strcmp(filename, "-") == 0)
+    {
+      fatal("Output to stdout cannot be used with --checkpoint");
+    }
+
+  if (output_count >= checkpoint_maxoutputs)
+    {
+      fatal("Too many output files for --checkpoint");
+    }
+
+  FILE * fp = nullptr;
+
+  if (resuming)
+    {
+      if (output_count >= resume_output_count)
+        {
+          fatal("The output files do not match the checkpoint file");
+        }
+
+      /* reopen without truncation, cut back to the checkpoint */
+      fp = fopen(filename, "r+");
+      if (fp)
+        {
+          uint64_t offset = resume_offsets[output_count];
+          xstat_t fs;
+          if (xfstat(fileno(fp), & fs) || ((uint64_t) fs.st_size < offset))
+            {
+              fatal("Output file is shorter than recorded in the checkpoint (%s)",
+                    filename);
+            }
+          if (xftruncate(fileno(fp), offset) ||
+              xfseeko(fp, offset, SEEK_SET))
+            {
+              fatal("Unable to truncate output file (%s)", filename);
+            }
+        }
+    }
+  else
+    {
+      fp = fopen_output(filename);
+    }
+
+  if (fp)
+    {
+      output_fp[output_count++] = fp;
+    }
+
+  return fp;
+}
+
+bool checkpoint_due()
+{
+  return opt_checkpoint &&
+    (time(nullptr) - last_checkpoint >= opt_checkpoint_interval);
+}
+
+void checkpoint_begin()
+{
+  state_size = 0;
+}
+
+void checkpoint_put(const void * data, uint64_t size)
+{
+  if (state_size + size > state_alloc)
+    {
+      state_alloc = MAX(state_size + size, 2 * state_alloc);
+      state = (char *) xrealloc(state, state_alloc);
+    }
+  memcpy(state + state_size, data, size);
+  state_size += size;
+}
+
+void checkpoint_commit()
+{
+  /* flush and sync all output files and record their lengths */
+
+  uint64_t offsets[checkpoint_maxoutputs];
+
+  for(int i = 0; i < output_count; i++)
+    {
+      if (fflush(output_fp[i]) || xfsync(fileno(output_fp[i])))
+        {
+          fatal("Unable to flush output file for checkpoint");
+        }
+      offsets[i] = xftello(output_fp[i]);
+    }
+
+  /* write checkpoint to a temporary file, then rename it */
+
+  char * tmpname = nullptr;
+  if (xsprintf(& tmpname, "%s.tmp", opt_checkpoint) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  FILE * fp = fopen(tmpname, "wb");
+  if (! fp)
+    {
+      fatal("Unable to open checkpoint file for writing");
+    }
+
+  uint32_t header[4];
+  header[0] = checkpoint_magic;
+  header[1] = checkpoint_version;
+  header[2] = output_count;
+  header[3] = strlen(checkpoint_command);
+
+  if ((fwrite(header, sizeof(header), 1, fp) != 1) ||
+      (fwrite(checkpoint_command, 1, header[3], fp) != header[3]) ||
+      (output_count &&
+       (fwrite(offsets, sizeof(uint64_t), output_count, fp) !=
+        (size_t) output_count)) ||
+      (fwrite(& state_size, sizeof(state_size), 1, fp) != 1) ||
+      (state_size && (fwrite(state, 1, state_size, fp) != state_size)) ||
+      fflush(fp) ||
+      xfsync(fileno(fp)))
+    {
+      fatal("Unable to write checkpoint file");
+    }
+
+  fclose(fp);
+
+  if (rename(tmpname, opt_checkpoint))
+    {
+      fatal("Unable to rename checkpoint file");
+    }
+
+  xfree(tmpname);
+
+  last_checkpoint = time(nullptr);
+}
+
+void checkpoint_get(void * data, uint64_t size)
+{
+  if (state_pos + size > state_size)
+    {
+      fatal("Corrupt checkpoint file (%s)", opt_checkpoint);
+    }
+  memcpy(data, state + state_pos, size);
+  state_pos += size;
+}
+
+void checkpoint_done()
+{
+  /* the command completed successfully, the checkpoint is obsolete */
+
+  if (opt_checkpoint)
+    {
+      remove(opt_checkpoint);
+    }
+
+  if (state)
+    {
+      xfree(state);
+      state = nullptr;
+    }
+  state_size = 0;
+  state_alloc = 0;
+  resuming = false;
+  output_count = 0;
+}
@@ -59,6 +59,7 @@
 */
 
 #include "vsearch.h"
+#include <atomic>
 
 /*
   This code implements the method described in this paper:
@@ -162,6 +163,159 @@ struct chimera_info_s
 
 static struct chimera_info_s * cia;
 
+/*
+  Cache of candidate parents and full-length alignments for query
+  sequences seen before (uchime_ref with --uchime_cache). The result
+  only depends on the query sequence and the fixed reference database,
+  so a repeated sequence skips the searches and alignments. Entries are
+  immutable once published in a bucket chain, so lookups need no lock.
+*/
+
+struct chimera_cache_s
+{
+  struct chimera_cache_s * next;
+  uint64_t hash;
+  int query_len;
+  char * query_seq;
+  int cand_count;
+  unsigned int * cand_list;
+  int64_t * nwscore;
+  int64_t * nwalignmentlength;
+  int64_t * nwmatches;
+  int64_t * nwmismatches;
+  int64_t * nwgaps;
+  char * * nwcigar;
+};
+
+static std::atomic<struct chimera_cache_s *> * chimera_cache = nullptr;
+static uint64_t chimera_cache_mask = 0;
+static std::atomic<int64_t> chimera_cache_hits(0);
+
+void chimera_cache_init(uint64_t input_size)
+{
+  /* about one bucket per 256 bytes of input */
+
+  uint64_t size = 1024;
+  while (size < input_size / 256)
+    {
+      size <<= 1;
+    }
+  chimera_cache_mask = size - 1;
+
+  chimera_cache = new std::atomic<struct chimera_cache_s *>[size];
+  for(uint64_t i = 0; i < size; i++)
+    {
+      chimera_cache[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void chimera_cache_exit()
+{
+  for(uint64_t i = 0; i <= chimera_cache_mask; i++)
+    {
+      struct chimera_cache_s * e = chimera_cache[i].load();
+      while (e)
+        {
+          struct chimera_cache_s * next = e->next;
+          for(int j = 0; j < e->cand_count; j++)
+            {
+              if (e->nwcigar[j])
+                {
+                  xfree(e->nwcigar[j]);
+                }
+            }
+          xfree(e->nwcigar);
+          xfree(e->nwgaps);
+          xfree(e->nwmismatches);
+          xfree(e->nwmatches);
+          xfree(e->nwalignmentlength);
+          xfree(e->nwscore);
+          xfree(e->cand_list);
+          xfree(e->query_seq);
+          xfree(e);
+          e = next;
+        }
+    }
+  delete [] chimera_cache;
+  chimera_cache = nullptr;
+}
+
+bool chimera_cache_get(struct chimera_info_s * ci, uint64_t hash)
+{
+  /* copy the candidates and alignments of a cached identical query */
+
+  struct chimera_cache_s * e =
+    chimera_cache[hash & chimera_cache_mask].load(std::memory_order_acquire);
+
+  while (e && ((e->hash != hash) ||
+               (e->query_len != ci->query_len) ||
+               memcmp(e->query_seq, ci->query_seq, ci->query_len)))
+    {
+      e = e->next;
+    }
+
+  if (! e)
+    {
+      return false;
+    }
+
+  ci->cand_count = e->cand_count;
+  for(int i = 0; i < e->cand_count; i++)
+    {
+      ci->cand_list[i] = e->cand_list[i];
+      ci->nwscore[i] = e->nwscore[i];
+      ci->nwalignmentlength[i] = e->nwalignmentlength[i];
+      ci->nwmatches[i] = e->nwmatches[i];
+      ci->nwmismatches[i] = e->nwmismatches[i];
+      ci->nwgaps[i] = e->nwgaps[i];
+      ci->nwcigar[i] = e->nwcigar[i] ? xstrdup(e->nwcigar[i]) : nullptr;
+    }
+
+  chimera_cache_hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void chimera_cache_put(struct chimera_info_s * ci, uint64_t hash)
+{
+  auto * e = (struct chimera_cache_s *) xmalloc(sizeof(chimera_cache_s));
+  int n = ci->cand_count;
+
+  e->hash = hash;
+  e->query_len = ci->query_len;
+  e->query_seq = (char *) xmalloc(ci->query_len + 1);
+  memcpy(e->query_seq, ci->query_seq, ci->query_len + 1);
+  e->cand_count = n;
+  e->cand_list = (unsigned int *) xmalloc(n * sizeof(unsigned int));
+  e->nwscore = (int64_t *) xmalloc(n * sizeof(int64_t));
+  e->nwalignmentlength = (int64_t *) xmalloc(n * sizeof(int64_t));
+  e->nwmatches = (int64_t *) xmalloc(n * sizeof(int64_t));
+  e->nwmismatches = (int64_t *) xmalloc(n * sizeof(int64_t));
+  e->nwgaps = (int64_t *) xmalloc(n * sizeof(int64_t));
+  e->nwcigar = (char * *) xmalloc(n * sizeof(char *));
+
+  for(int i = 0; i < n; i++)
+    {
+      e->cand_list[i] = ci->cand_list[i];
+      e->nwscore[i] = ci->nwscore[i];
+      e->nwalignmentlength[i] = ci->nwalignmentlength[i];
+      e->nwmatches[i] = ci->nwmatches[i];
+      e->nwmismatches[i] = ci->nwmismatches[i];
+      e->nwgaps[i] = ci->nwgaps[i];
+      e->nwcigar[i] = ci->nwcigar[i] ? xstrdup(ci->nwcigar[i]) : nullptr;
+    }
+
+  /* publish; another thread may have added the same sequence, harmless */
+
+  std::atomic<struct chimera_cache_s *> & head =
+    chimera_cache[hash & chimera_cache_mask];
+  e->next = head.load(std::memory_order_relaxed);
+  while (! head.compare_exchange_weak(e->next, e,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed))
+    {
+    }
+}
+
 void realloc_arrays(struct chimera_info_s * ci)
 {
   if (opt_chimeras_denovo)
@@ -1551,27 +1705,15 @@ void query_init(struct searchinfo_s * si)
   si->kmers = (count_t *) xmalloc(db_getsequencecount()*sizeof(count_t) + 32);
   si->hit_count = 0;
   si->uh = unique_init();
-  si->s = search16_init(opt_match,
-                        opt_mismatch,
-                        opt_gap_open_query_left,
-                        opt_gap_open_target_left,
-                        opt_gap_open_query_interior,
-                        opt_gap_open_target_interior,
-                        opt_gap_open_query_right,
-                        opt_gap_open_target_right,
-                        opt_gap_extension_query_left,
-                        opt_gap_extension_target_left,
-                        opt_gap_extension_query_interior,
-                        opt_gap_extension_target_interior,
-                        opt_gap_extension_query_right,
-                        opt_gap_extension_target_right);
+  si->s = nullptr; /* the aligner of the whole query, see below */
   si->nw = nw_init();
   si->m = minheap_init(tophits);
+  si->kh = nullptr;
+  si->counts_only = false;
 }
 
 void query_exit(struct searchinfo_s * si)
 {
-  search16_exit(si->s);
   unique_exit(si->uh);
   minheap_exit(si->m);
   nw_exit(si->nw);
@@ -1658,6 +1800,13 @@ void chimera_thread_init(struct chimera_info_s * ci)
                         opt_gap_extension_target_interior,
                         opt_gap_extension_query_right,
                         opt_gap_extension_target_right);
+
+  /* the parts are aligned with windows of the whole query profile */
+
+  for(int i = 0; i < maxparts; i++)
+    {
+      ci->si[i].s = ci->s;
+    }
 }
 
 void chimera_thread_exit(struct chimera_info_s * ci)
@@ -1725,6 +1874,140 @@ void chimera_thread_exit(struct chimera_info_s * ci)
       }
 }
 
+void find_candidates(struct chimera_info_s * ci,
+                     struct hit * allhits_list,
+                     LinearMemoryAligner & lma)
+{
+  /* search the query parts and align the full query to each candidate */
+
+  /* partition query */
+  partition_query(ci);
+
+  /* prepare the query profile once, for the parts and the whole query */
+  search16_qprep(ci->s, ci->query_seq, ci->query_len);
+
+  /* perform searches and collect candidate parents */
+  ci->cand_count = 0;
+  int allhits_count = 0;
+
+  if (ci->query_len >= parts)
+    {
+      int offset = 0;
+      for (int i=0; i<parts; i++)
+        {
+          struct hit * hits;
+          int hit_count;
+          search16_qselect(ci->s, 0, offset, ci->si[i].qseqlen);
+          offset += ci->si[i].qseqlen;
+          search_onequery(ci->si+i, opt_qmask);
+          search_joinhits(ci->si+i, nullptr, & hits, & hit_count);
+          for(int j=0; j<hit_count; j++)
+            {
+              if (hits[j].accepted)
+                {
+                  allhits_list[allhits_count++] = hits[j];
+                }
+            }
+          xfree(hits);
+        }
+    }
+
+  for(int i=0; i < allhits_count; i++)
+    {
+      unsigned int target = allhits_list[i].target;
+
+      /* skip duplicates */
+      int k {0};
+      for(k = 0; k < ci->cand_count; k++)
+        {
+          if (ci->cand_list[k] == target)
+            {
+              break;
+            }
+        }
+
+      if (k == ci->cand_count)
+        {
+          ci->cand_list[ci->cand_count++] = target;
+        }
+
+      /* deallocate cigar */
+      if (allhits_list[i].nwalignment)
+        {
+          xfree(allhits_list[i].nwalignment);
+          allhits_list[i].nwalignment = nullptr;
+        }
+    }
+
+  /* align full query to each candidate */
+
+  search16_qselect(ci->s, 0, 0, ci->query_len);
+
+  search16(ci->s,
+           ci->cand_count,
+           ci->cand_list,
+           ci->snwscore,
+           ci->snwalignmentlength,
+           ci->snwmatches,
+           ci->snwmismatches,
+           ci->snwgaps,
+           ci->nwcigar);
+
+  for(int i=0; i < ci->cand_count; i++)
+    {
+      int64_t target = ci->cand_list[i];
+      int64_t nwscore = ci->snwscore[i];
+      char * nwcigar;
+      int64_t nwalignmentlength;
+      int64_t nwmatches;
+      int64_t nwmismatches;
+      int64_t nwgaps;
+
+      if (nwscore == SHRT_MAX)
+        {
+          /* In case the SIMD aligner cannot align,
+             perform a new alignment with the
+             linear memory aligner */
+
+          char * tseq = db_getsequence(target);
+          int64_t tseqlen = db_getsequencelen(target);
+
+          if (ci->nwcigar[i])
+            {
+              xfree(ci->nwcigar[i]);
+            }
+
+          nwcigar = xstrdup(lma.align(ci->query_seq,
+                                      tseq,
+                                      ci->query_len,
+                                      tseqlen));
+          lma.alignstats(nwcigar,
+                         ci->query_seq,
+                         tseq,
+                         & nwscore,
+                         & nwalignmentlength,
+                         & nwmatches,
+                         & nwmismatches,
+                         & nwgaps);
+
+          ci->nwcigar[i] = nwcigar;
+          ci->nwscore[i] = nwscore;
+          ci->nwalignmentlength[i] = nwalignmentlength;
+          ci->nwmatches[i] = nwmatches;
+          ci->nwmismatches[i] = nwmismatches;
+          ci->nwgaps[i] = nwgaps;
+        }
+      else
+        {
+          ci->nwscore[i] = ci->snwscore[i];
+          ci->nwalignmentlength[i] = ci->snwalignmentlength[i];
+          ci->nwmatches[i] = ci->snwmatches[i];
+          ci->nwmismatches[i] = ci->snwmismatches[i];
+          ci->nwgaps[i] = ci->snwgaps[i];
+        }
+    }
+}
+
 uint64_t chimera_thread_core(struct chimera_info_s * ci)
 {
   chimera_thread_init(ci);
@@ -1807,129 +2090,27 @@ uint64_t chimera_thread_core(struct chimera_info_s * ci)
 
       int status = 0;
 
-      /* partition query */
-      partition_query(ci);
+      /* find candidate parents, unless cached for an identical query */
 
-      /* perform searches and collect candidate parents */
-      ci->cand_count = 0;
-      int allhits_count = 0;
+      uint64_t cache_hash = 0;
+      bool cached = false;
 
-      if (ci->query_len >= parts)
+      if (chimera_cache)
         {
-          for (int i=0; i<parts; i++)
-            {
-              struct hit * hits;
-              int hit_count;
-              search_onequery(ci->si+i, opt_qmask);
-              search_joinhits(ci->si+i, nullptr, & hits, & hit_count);
-              for(int j=0; j<hit_count; j++)
-                {
-                  if (hits[j].accepted)
-                    {
-                      allhits_list[allhits_count++] = hits[j];
-                    }
-                }
-              xfree(hits);
-            }
-        }
-
-      for(int i=0; i < allhits_count; i++)
-        {
-          unsigned int target = allhits_list[i].target;
-
-          /* skip duplicates */
-          int k {0};
-          for(k = 0; k < ci->cand_count; k++)
-            {
-              if (ci->cand_list[k] == target)
-                {
-                  break;
-                }
-            }
-
-          if (k == ci->cand_count)
-            {
-              ci->cand_list[ci->cand_count++] = target;
-            }
-
-          /* deallocate cigar */
-          if (allhits_list[i].nwalignment)
-            {
-              xfree(allhits_list[i].nwalignment);
-              allhits_list[i].nwalignment = nullptr;
-            }
+          cache_hash = hash_cityhash64(ci->query_seq, ci->query_len);
+          cached = chimera_cache_get(ci, cache_hash);
         }
 
-
-      /* align full query to each candidate */
-
-      search16_qprep(ci->s, ci->query_seq, ci->query_len);
-
-      search16(ci->s,
-               ci->cand_count,
-               ci->cand_list,
-               ci->snwscore,
-               ci->snwalignmentlength,
-               ci->snwmatches,
-               ci->snwmismatches,
-               ci->snwgaps,
-               ci->nwcigar);
-
-      for(int i=0; i < ci->cand_count; i++)
+      if (! cached)
         {
-          int64_t target = ci->cand_list[i];
-          int64_t nwscore = ci->snwscore[i];
-          char * nwcigar;
-          int64_t nwalignmentlength;
-          int64_t nwmatches;
-          int64_t nwmismatches;
-          int64_t nwgaps;
+          find_candidates(ci, allhits_list, lma);
 
-          if (nwscore == SHRT_MAX)
+          if (chimera_cache)
             {
-              /* In case the SIMD aligner cannot align,
-                 perform a new alignment with the
-                 linear memory aligner */
-
-              char * tseq = db_getsequence(target);
-              int64_t tseqlen = db_getsequencelen(target);
-
-              if (ci->nwcigar[i])
-                {
-                  xfree(ci->nwcigar[i]);
-                }
-
-              nwcigar = xstrdup(lma.align(ci->query_seq,
-                                          tseq,
-                                          ci->query_len,
-                                          tseqlen));
-              lma.alignstats(nwcigar,
-                             ci->query_seq,
-                             tseq,
-                             & nwscore,
-                             & nwalignmentlength,
-                             & nwmatches,
-                             & nwmismatches,
-                             & nwgaps);
-
-              ci->nwcigar[i] = nwcigar;
-              ci->nwscore[i] = nwscore;
-              ci->nwalignmentlength[i] = nwalignmentlength;
-              ci->nwmatches[i] = nwmatches;
-              ci->nwmismatches[i] = nwmismatches;
-              ci->nwgaps[i] = nwgaps;
-            }
-          else
-            {
-              ci->nwscore[i] = ci->snwscore[i];
-              ci->nwalignmentlength[i] = ci->snwalignmentlength[i];
-              ci->nwmatches[i] = ci->snwmatches[i];
-              ci->nwmismatches[i] = ci->snwmismatches[i];
-              ci->nwgaps[i] = ci->snwgaps[i];
+              chimera_cache_put(ci, cache_hash);
             }
         }
 
-
       /* find the best pair of parents, then compute score for them */
 
       if (opt_chimeras_denovo)
@@ -2242,6 +2423,15 @@ void chimera()
 
       query_fasta_h = fasta_open(opt_uchime_ref);
       progress_total = fasta_get_size(query_fasta_h);
+
+      if (opt_uchime_cache)
+        {
+          if (opt_self)
+            {
+              fatal("The --uchime_cache option cannot be used with --self");
+            }
+          chimera_cache_init(progress_total);
+        }
     }
   else
     {
@@ -2447,6 +2637,12 @@ void chimera()
                   chimera_count,
                   seqno);
         }
+
+      if (chimera_cache)
+        {
+          fprintf(fp_log, "%" PRId64 " repeated queries found in the cache\n",
+                  chimera_cache_hits.load());
+        }
     }
 
 
@@ -2455,6 +2651,11 @@ void chimera()
       fasta_close(query_fasta_h);
     }
 
+  if (chimera_cache)
+    {
+      chimera_cache_exit();
+    }
+
   dbindex_free();
   db_free();
 
@@ -73,6 +73,7 @@ typedef struct clusterinfo_s
 
 static clusterinfo_t * clusterinfo = nullptr;
 static int clusters = 0;
+static int seqno_start = 0; /* first sequence to cluster, > 0 if resuming */
 
 static int count_matched = 0;
 static int count_notmatched = 0;
@@ -192,6 +193,7 @@ inline void cluster_query_core(struct searchinfo_s * si)
     }
 
   /* perform search */
+  search16_qprep(si->s, si->qsequence, si->qseqlen);
   search_onequery(si, opt_qmask);
 }
 
@@ -330,6 +332,8 @@ void cluster_query_init(struct searchinfo_s * si)
 
   si->uh = unique_init();
   si->m = minheap_init(tophits);
+  si->kh = nullptr;
+  si->counts_only = false;
   si->s = search16_init(opt_match,
                         opt_mismatch,
                         opt_gap_open_query_left,
@@ -589,6 +593,201 @@ int compare_kmersample(const void * a, const void * b)
     }
 }
 
+void cluster_checkpoint_save(int seqno_next)
+{
+  /* all sequences before seqno_next have been clustered and written */
+
+  uint64_t db_seqcount = seqcount;
+
+  checkpoint_begin();
+  checkpoint_put(& db_seqcount, sizeof(db_seqcount));
+  checkpoint_put(& seqno_next, sizeof(seqno_next));
+  checkpoint_put(& clusters, sizeof(clusters));
+  checkpoint_put(& count_matched, sizeof(count_matched));
+  checkpoint_put(& count_notmatched, sizeof(count_notmatched));
+
+  for(int i = 0; i < seqno_next; i++)
+    {
+      clusterinfo_t * cp = clusterinfo + i;
+      uint32_t cigarlen = cp->cigar ? strlen(cp->cigar) + 1 : 0;
+      checkpoint_put(& cp->clusterno, sizeof(cp->clusterno));
+      checkpoint_put(& cp->strand, sizeof(cp->strand));
+      checkpoint_put(& cigarlen, sizeof(cigarlen));
+      if (cigarlen)
+        {
+          checkpoint_put(cp->cigar, cigarlen);
+        }
+    }
+
+  checkpoint_commit();
+}
+
+void cluster_checkpoint_restore()
+{
+  uint64_t db_seqcount = 0;
+
+  checkpoint_get(& db_seqcount, sizeof(db_seqcount));
+  if (db_seqcount != (uint64_t) seqcount)
+    {
+      fatal("The input file does not match the checkpoint");
+    }
+
+  checkpoint_get(& seqno_start, sizeof(seqno_start));
+  checkpoint_get(& clusters, sizeof(clusters));
+  checkpoint_get(& count_matched, sizeof(count_matched));
+  checkpoint_get(& count_notmatched, sizeof(count_notmatched));
+
+  /* restore cluster info and add the centroids to the index again,
+     in the order they were found */
+
+  int centroids = 0;
+
+  for(int i = 0; i < seqno_start; i++)
+    {
+      clusterinfo_t * cp = clusterinfo + i;
+      uint32_t cigarlen = 0;
+      cp->seqno = i;
+      checkpoint_get(& cp->clusterno, sizeof(cp->clusterno));
+      checkpoint_get(& cp->strand, sizeof(cp->strand));
+      checkpoint_get(& cigarlen, sizeof(cigarlen));
+      cp->cigar = nullptr;
+      if (cigarlen)
+        {
+          cp->cigar = (char *) xmalloc(cigarlen);
+          checkpoint_get(cp->cigar, cigarlen);
+        }
+
+      if (cp->clusterno == centroids)
+        {
+          dbindex_addsequence(i, opt_qmask);
+          centroids++;
+        }
+    }
+
+  if (centroids != clusters)
+    {
+      fatal("Corrupt checkpoint file (%s)", opt_checkpoint);
+    }
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Resuming after %d sequences in %d clusters\n",
+              seqno_start, clusters);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Resuming after %d sequences in %d clusters\n",
+              seqno_start, clusters);
+    }
+}
+
+static void cluster_align_hits(struct searchinfo_s * si,
+                               struct hit * * align_list,
+                               int align_count,
+                               LinearMemoryAligner & lma)
+{
+  /* align the query to the targets of the hits in the list */
+
+  unsigned int target_list[MAXDELAYED];
+  CELL snwscore[MAXDELAYED];
+  unsigned short snwalignmentlength[MAXDELAYED];
+  unsigned short snwmatches[MAXDELAYED];
+  unsigned short snwmismatches[MAXDELAYED];
+  unsigned short snwgaps[MAXDELAYED];
+  char * nwcigar_list[MAXDELAYED];
+
+  for(int a = 0; a < align_count; a++)
+    {
+      target_list[a] = align_list[a]->target;
+    }
+
+  search16(si->s,
+           align_count,
+           target_list,
+           snwscore,
+           snwalignmentlength,
+           snwmatches,
+           snwmismatches,
+           snwgaps,
+           nwcigar_list);
+
+  for(int a = 0; a < align_count; a++)
+    {
+      struct hit * hit = align_list[a];
+      unsigned int target = hit->target;
+
+      int64_t nwscore;
+      int64_t nwalignmentlength;
+      int64_t nwmatches;
+      int64_t nwmismatches;
+      int64_t nwgaps;
+      char * nwcigar = nwcigar_list[a];
+
+      int64_t tseqlen = db_getsequencelen(target);
+
+      if (snwscore[a] == SHRT_MAX)
+        {
+          /* In case the SIMD aligner cannot align,
+             perform a new alignment with the
+             linear memory aligner */
+
+          char * tseq = db_getsequence(target);
+
+          if (nwcigar)
+            {
+              xfree(nwcigar);
+            }
+
+          nwcigar = xstrdup(lma.align(si->qsequence,
+                                      tseq,
+                                      si->qseqlen,
+                                      tseqlen));
+
+          lma.alignstats(nwcigar,
+                         si->qsequence,
+                         tseq,
+                         & nwscore,
+                         & nwalignmentlength,
+                         & nwmatches,
+                         & nwmismatches,
+                         & nwgaps);
+        }
+      else
+        {
+          nwscore = snwscore[a];
+          nwalignmentlength = snwalignmentlength[a];
+          nwmatches = snwmatches[a];
+          nwmismatches = snwmismatches[a];
+          nwgaps = snwgaps[a];
+        }
+
+      int64_t nwdiff = nwalignmentlength - nwmatches;
+      int64_t nwindels = nwdiff - nwmismatches;
+
+      hit->aligned = true;
+      hit->nwalignment = nwcigar;
+      hit->nwscore = nwscore;
+      hit->nwdiff = nwdiff;
+      hit->nwgaps = nwgaps;
+      hit->nwindels = nwindels;
+      hit->nwalignmentlength = nwalignmentlength;
+      hit->matches = nwmatches;
+      hit->mismatches = nwmismatches;
+
+      hit->nwid = 100.0 *
+        (nwalignmentlength - hit->nwdiff) /
+        nwalignmentlength;
+
+      hit->shortest = MIN(si->qseqlen, tseqlen);
+      hit->longest = MAX(si->qseqlen, tseqlen);
+
+      /* trim alignment and compute numbers
+         excluding terminal gaps */
+      align_trim(hit);
+    }
+}
+
 void cluster_core_parallel()
 {
   /* create threads and set them in stand-by mode */
@@ -637,9 +836,13 @@ void cluster_core_parallel()
 
   int lastlength = INT_MAX;
 
-  int seqno = 0;
+  int seqno = seqno_start;
 
   int64_t sum_nucleotides = 0;
+  for(int i = 0; i < seqno_start; i++)
+    {
+      sum_nucleotides += db_getsequencelen(i);
+    }
 
   progress_init("Clustering", db_getnucleotidecount());
 
@@ -800,97 +1003,28 @@ void cluster_core_parallel()
                           unsigned int target = hit->target;
                           if (search_acceptable_unaligned(si, target))
                             {
-                              /* perform vectorized alignment */
-                              /* but only using 1 sequence ! */
-
-                              unsigned int nwtarget = target;
-
-                              int64_t nwscore;
-                              int64_t nwalignmentlength;
-                              int64_t nwmatches;
-                              int64_t nwmismatches;
-                              int64_t nwgaps;
-                              char * nwcigar = nullptr;
-
-                              /* short variants for simd aligner */
-                              CELL snwscore;
-                              unsigned short snwalignmentlength;
-                              unsigned short snwmatches;
-                              unsigned short snwmismatches;
-                              unsigned short snwgaps;
-
-                              search16(si->s,
-                                       1,
-                                       & nwtarget,
-                                       & snwscore,
-                                       & snwalignmentlength,
-                                       & snwmatches,
-                                       & snwmismatches,
-                                       & snwgaps,
-                                       & nwcigar);
-
-                              int64_t tseqlen = db_getsequencelen(target);
-
-                              if (snwscore == SHRT_MAX)
+                              /*
+                                perform vectorized alignment, together
+                                with the following hits that may need
+                                to be aligned, to use more channels
+                              */
+                              struct hit * align_list[MAXDELAYED];
+                              int align_count = 0;
+                              align_list[align_count++] = hit;
+                              for(int u = t + 1;
+                                  (u < si->hit_count) &&
+                                    (align_count < (int) MAXDELAYED);
+                                  u++)
                                 {
-                                  /* In case the SIMD aligner cannot align,
-                                     perform a new alignment with the
-                                     linear memory aligner */
-
-                                  char * tseq = db_getsequence(target);
-
-                                  if (nwcigar)
+                                  struct hit * next = si->hits + u;
+                                  if ((! next->aligned) &&
+                                      search_acceptable_unaligned(si, next->target))
                                     {
-                                      xfree(nwcigar);
+                                      align_list[align_count++] = next;
                                     }
-
-                                  nwcigar = xstrdup(lma.align(si->qsequence,
-                                                              tseq,
-                                                              si->qseqlen,
-                                                              tseqlen));
-
-                                  lma.alignstats(nwcigar,
-                                                 si->qsequence,
-                                                 tseq,
-                                                 & nwscore,
-                                                 & nwalignmentlength,
-                                                 & nwmatches,
-                                                 & nwmismatches,
-                                                 & nwgaps);
-                                }
-                              else
-                                {
-                                  nwscore = snwscore;
-                                  nwalignmentlength = snwalignmentlength;
-                                  nwmatches = snwmatches;
-                                  nwmismatches = snwmismatches;
-                                  nwgaps = snwgaps;
                                 }
 
-
-                              int64_t nwdiff = nwalignmentlength - nwmatches;
-                              int64_t nwindels = nwdiff - nwmismatches;
-
-                              hit->aligned = true;
-                              hit->nwalignment = nwcigar;
-                              hit->nwscore = nwscore;
-                              hit->nwdiff = nwdiff;
-                              hit->nwgaps = nwgaps;
-                              hit->nwindels = nwindels;
-                              hit->nwalignmentlength = nwalignmentlength;
-                              hit->matches = nwmatches;
-                              hit->mismatches = nwmismatches;
-
-                              hit->nwid = 100.0 *
-                                (nwalignmentlength - hit->nwdiff) /
-                                nwalignmentlength;
-
-                              hit->shortest = MIN(si->qseqlen, tseqlen);
-                              hit->longest = MAX(si->qseqlen, tseqlen);
-
-                              /* trim alignment and compute numbers
-                                 excluding terminal gaps */
-                              align_trim(hit);
+                              cluster_align_hits(si, align_list, align_count, lma);
                             }
                           else
                             {
@@ -1013,6 +1147,11 @@ void cluster_core_parallel()
         }
 
       progress_update(sum_nucleotides);
+
+      if (checkpoint_due())
+        {
+          cluster_checkpoint_save(seqno);
+        }
     }
   progress_done();
 
@@ -1054,7 +1193,7 @@ void cluster_core_serial()
   int lastlength = INT_MAX;
 
   progress_init("Clustering", seqcount);
-  for (int seqno=0; seqno<seqcount; seqno++)
+  for (int seqno=seqno_start; seqno<seqcount; seqno++)
     {
       int length = db_getsequencelen(seqno);
 
@@ -1137,6 +1276,11 @@ void cluster_core_serial()
         }
 
       progress_update(seqno);
+
+      if (checkpoint_due())
+        {
+          cluster_checkpoint_save(seqno + 1);
+        }
     }
   progress_done();
 
@@ -1152,9 +1296,26 @@ void cluster(char * dbname,
              char * cmdline,
              char * progheader)
 {
+  if (opt_cluster_fast)
+    {
+      checkpoint_init("cluster_fast");
+    }
+  else if (opt_cluster_size)
+    {
+      checkpoint_init("cluster_size");
+    }
+  else if (opt_cluster_smallmem)
+    {
+      checkpoint_init("cluster_smallmem");
+    }
+  else
+    {
+      checkpoint_init("cluster_unoise");
+    }
+
   if (opt_centroids)
     {
-      fp_centroids = fopen_output(opt_centroids);
+      fp_centroids = checkpoint_fopen_output(opt_centroids);
       if (!fp_centroids)
         {
           fatal("Unable to open centroids file for writing");
@@ -1163,7 +1324,7 @@ void cluster(char * dbname,
 
   if (opt_uc)
     {
-      fp_uc = fopen_output(opt_uc);
+      fp_uc = checkpoint_fopen_output(opt_uc);
       if (!fp_uc)
         {
           fatal("Unable to open uc file for writing");
@@ -1172,19 +1333,22 @@ void cluster(char * dbname,
 
   if (opt_alnout)
     {
-      fp_alnout = fopen_output(opt_alnout);
+      fp_alnout = checkpoint_fopen_output(opt_alnout);
       if (! fp_alnout)
         {
           fatal("Unable to open alignment output file for writing");
         }
 
-      fprintf(fp_alnout, "%s\n", cmdline);
-      fprintf(fp_alnout, "%s\n", progheader);
+      if (! checkpoint_resuming())
+        {
+          fprintf(fp_alnout, "%s\n", cmdline);
+          fprintf(fp_alnout, "%s\n", progheader);
+        }
     }
 
   if (opt_samout)
     {
-      fp_samout = fopen_output(opt_samout);
+      fp_samout = checkpoint_fopen_output(opt_samout);
       if (! fp_samout)
         {
           fatal("Unable to open SAM output file for writing");
@@ -1193,7 +1357,7 @@ void cluster(char * dbname,
 
   if (opt_userout)
     {
-      fp_userout = fopen_output(opt_userout);
+      fp_userout = checkpoint_fopen_output(opt_userout);
       if (! fp_userout)
         {
           fatal("Unable to open user-defined output file for writing");
@@ -1202,7 +1366,7 @@ void cluster(char * dbname,
 
   if (opt_blast6out)
     {
-      fp_blast6out = fopen_output(opt_blast6out);
+      fp_blast6out = checkpoint_fopen_output(opt_blast6out);
       if (! fp_blast6out)
         {
           fatal("Unable to open blast6-like output file for writing");
@@ -1211,7 +1375,7 @@ void cluster(char * dbname,
 
   if (opt_fastapairs)
     {
-      fp_fastapairs = fopen_output(opt_fastapairs);
+      fp_fastapairs = checkpoint_fopen_output(opt_fastapairs);
       if (! fp_fastapairs)
         {
           fatal("Unable to open fastapairs output file for writing");
@@ -1220,7 +1384,7 @@ void cluster(char * dbname,
 
   if (opt_qsegout)
     {
-      fp_qsegout = fopen_output(opt_qsegout);
+      fp_qsegout = checkpoint_fopen_output(opt_qsegout);
       if (! fp_qsegout)
         {
           fatal("Unable to open qsegout output file for writing");
@@ -1229,7 +1393,7 @@ void cluster(char * dbname,
 
   if (opt_tsegout)
     {
-      fp_tsegout = fopen_output(opt_tsegout);
+      fp_tsegout = checkpoint_fopen_output(opt_tsegout);
       if (! fp_tsegout)
         {
           fatal("Unable to open tsegout output file for writing");
@@ -1238,7 +1402,7 @@ void cluster(char * dbname,
 
   if (opt_matched)
     {
-      fp_matched = fopen_output(opt_matched);
+      fp_matched = checkpoint_fopen_output(opt_matched);
       if (! fp_matched)
         {
           fatal("Unable to open matched output file for writing");
@@ -1247,7 +1411,7 @@ void cluster(char * dbname,
 
   if (opt_notmatched)
     {
-      fp_notmatched = fopen_output(opt_notmatched);
+      fp_notmatched = checkpoint_fopen_output(opt_notmatched);
       if (! fp_notmatched)
         {
           fatal("Unable to open notmatched output file for writing");
@@ -1285,7 +1449,10 @@ void cluster(char * dbname,
 
   otutable_init();
 
-  results_show_samheader(fp_samout, cmdline, dbname);
+  if (! checkpoint_resuming())
+    {
+      results_show_samheader(fp_samout, cmdline, dbname);
+    }
 
   if (opt_qmask == MASK_DUST)
     {
@@ -1330,6 +1497,16 @@ void cluster(char * dbname,
       tophits = seqcount;
     }
 
+  /*
+    the index of the centroids grows during clustering, at most one
+    entry per nucleotide; each thread needs word counts and hits for
+    each strand
+  */
+
+  budget_threads(db_getnucleotidecount() * sizeof(unsigned int),
+                 opt_strand * (seqcount * sizeof(count_t) +
+                               tophits * sizeof(struct hit)));
+
   clusterinfo = (clusterinfo_t *) xmalloc(seqcount * sizeof(clusterinfo_t));
 
   if (opt_log)
@@ -1348,6 +1525,11 @@ void cluster(char * dbname,
       fprintf(fp_log, "\n");
     }
 
+  if (checkpoint_resuming())
+    {
+      cluster_checkpoint_restore();
+    }
+
   if (opt_threads == 1)
     {
       cluster_core_serial();
@@ -1755,6 +1937,8 @@ void cluster(char * dbname,
   dbindex_free();
   db_free();
   show_rusage();
+
+  checkpoint_done();
 }
 
 void cluster_fast(char * cmdline, char * progheader)
@@ -67,12 +67,15 @@
 
 void increment_counters_from_bitmap(count_t * counters,
                                     unsigned char * bitmap,
-                                    unsigned int totalbits)
+                                    unsigned int totalbits,
+                                    count_t weight)
 {
   const uint8x16_t c1 =
     { 0x01, 0x01, 0x02, 0x02, 0x04, 0x04, 0x08, 0x08,
       0x10, 0x10, 0x20, 0x20, 0x40, 0x40, 0x80, 0x80 };
 
+  const int16x8_t w = vdupq_n_s16(weight);
+
   unsigned short * p = (unsigned short *)(bitmap);
   int16x8_t * q = (int16x8_t *)(counters);
   int r = (totalbits + 15) / 16;
@@ -105,21 +108,108 @@ void increment_counters_from_bitmap(count_t * counters,
       // cast to signed 0x0000 or 0xffff
       r6 = vreinterpretq_s16_u8(r4);
 
-      // subtract signed 0 or -1 (i.e add 0 or 1) with saturation to counter
-      *q = vqsubq_s16(*q, r5);
+      // add 0 or the weight with saturation to counter
+      *q = vqaddq_s16(*q, vandq_s16(r5, w));
       q++;
 
-      // subtract signed 0 or 1 (i.e. add 0 or 1) with saturation to counter
-      *q = vqsubq_s16(*q, r6);
+      // add 0 or the weight with saturation to counter
+      *q = vqaddq_s16(*q, vandq_s16(r6, w));
       q++;
     }
 }
 
+int64_t merge_select(const char * fwd_sequence,
+                     const char * fwd_quality,
+                     const char * rev_sequence,
+                     const char * rev_quality,
+                     const unsigned char * complement,
+                     int64_t length,
+                     char * merged_sequence,
+                     unsigned short * qual_index,
+                     int64_t * errors)
+{
+  /*
+    Merge the overlapping part of a read pair, 16 positions at a time.
+    See the x86_64 version below for details.
+  */
+
+  uint8x16x2_t lut;
+  lut.val[0] = vld1q_u8(complement);
+  lut.val[1] = vld1q_u8(complement + 16);
+
+  const uint8x16_t base = vdupq_n_u8(0x40);
+  const uint8x16_t n = vdupq_n_u8('N');
+  const uint8x16_t one = vdupq_n_u8(1);
+  const uint8x16_t two = vdupq_n_u8(2);
+
+  int64_t fwd_errors = 0;
+  int64_t rev_errors = 0;
+  int64_t j = 0;
+
+  for(; j + 16 <= length; j += 16)
+    {
+      // reverse read, backwards
+      uint8x16_t r = vld1q_u8((const uint8_t *)(rev_sequence - j - 15));
+      r = vrev64q_u8(r);
+      r = vextq_u8(r, r, 8);
+
+      // stop at symbols outside the complement table
+      uint8x16_t x = vsubq_u8(r, base);
+      if (vmaxvq_u8(x) > 0x1f)
+        {
+          break;
+        }
+
+      uint8x16_t c = vqtbl2q_u8(lut, x);
+
+      uint8x16_t f = vld1q_u8((const uint8_t *)(fwd_sequence + j));
+      uint8x16_t qf = vld1q_u8((const uint8_t *)(fwd_quality + j));
+      uint8x16_t qr = vld1q_u8((const uint8_t *)(rev_quality - j - 15));
+      qr = vrev64q_u8(qr);
+      qr = vextq_u8(qr, qr, 8);
+
+      uint8x16_t rev_n = vceqq_u8(c, n);
+      uint8x16_t fwd_n = vceqq_u8(f, n);
+      uint8x16_t same = vceqq_u8(f, c);
+      uint8x16_t any_n = vorrq_u8(rev_n, fwd_n);
+
+      // symbol
+      uint8x16_t pick_fwd = vorrq_u8(vorrq_u8(rev_n, same),
+                                     vbicq_u8(vcgtq_u8(qf, qr), fwd_n));
+      uint8x16_t sym = vbslq_u8(pick_fwd, f, c);
+      vst1q_u8((uint8_t *)(merged_sequence + j), sym);
+
+      fwd_errors += vaddvq_u8(vbicq_u8(one, vceqq_u8(sym, f)));
+      rev_errors += vaddvq_u8(vbicq_u8(one, vceqq_u8(sym, c)));
+
+      // quality table plane and indices
+      uint8x16_t high = vbslq_u8(rev_n, qf,
+                                 vbslq_u8(fwd_n, qr, vmaxq_u8(qf, qr)));
+      uint8x16_t low = vminq_u8(qf, qr);
+      uint8x16_t kind = vorrq_u8(vandq_u8(any_n, two),
+                                 vbicq_u8(one, vorrq_u8(any_n, same)));
+
+      uint16x8_t i0 = vorrq_u16(vmovl_u8(vget_low_u8(low)),
+                                vshlq_n_u16(vmovl_u8(vget_low_u8(high)), 7));
+      i0 = vorrq_u16(i0, vshlq_n_u16(vmovl_u8(vget_low_u8(kind)), 14));
+      uint16x8_t i1 = vorrq_u16(vmovl_u8(vget_high_u8(low)),
+                                vshlq_n_u16(vmovl_u8(vget_high_u8(high)), 7));
+      i1 = vorrq_u16(i1, vshlq_n_u16(vmovl_u8(vget_high_u8(kind)), 14));
+      vst1q_u16(qual_index + j, i0);
+      vst1q_u16(qual_index + j + 8, i1);
+    }
+
+  errors[0] += fwd_errors;
+  errors[1] += rev_errors;
+  return j;
+}
+
 #elif defined __PPC__
 
 void increment_counters_from_bitmap(count_t * counters,
                                     unsigned char * bitmap,
-                                    unsigned int totalbits)
+                                    unsigned int totalbits,
+                                    count_t weight)
 {
   const __vector unsigned char c1 =
     { 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -130,6 +220,8 @@ void increment_counters_from_bitmap(count_t * counters,
     { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
       0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 
+  const __vector signed short w = vec_splats((signed short) weight);
+
   unsigned short * p = (unsigned short *)(bitmap);
   __vector signed short * q = (__vector signed short *) (counters);
   int r = (totalbits + 15) / 16;
@@ -147,9 +239,9 @@ void increment_counters_from_bitmap(count_t * counters,
       r3 = vec_cmpeq(r2, c3);
       r4 = (__vector signed short) vec_unpackl(r3);
       r5 = (__vector signed short) vec_unpackh(r3);
-      *q = vec_subs(*q, r4);
+      *q = vec_adds(*q, vec_and(r4, w));
       q++;
-      *q = vec_subs(*q, r5);
+      *q = vec_adds(*q, vec_and(r5, w));
       q++;
     }
 }
@@ -159,21 +251,26 @@ void increment_counters_from_bitmap(count_t * counters,
 #ifdef SSSE3
 void increment_counters_from_bitmap_ssse3(count_t * counters,
                                           unsigned char * bitmap,
-                                          unsigned int totalbits)
+                                          unsigned int totalbits,
+                                          count_t weight)
 #else
 void increment_counters_from_bitmap_sse2(count_t * counters,
                                          unsigned char * bitmap,
-                                         unsigned int totalbits)
+                                         unsigned int totalbits,
+                                         count_t weight)
 #endif
 {
   /*
-    Increment selected elements in an array of 16 bit counters.
-    The counters to increment are indicated by 1's in the bitmap.
+    Increment selected elements in an array of 16 bit counters by the
+    given weight. The counters to increment are indicated by 1's in
+    the bitmap.
 
     We read 16 bytes from the bitmap, but use only two bytes (16 bits).
     Convert these 16 bits into 16 bytes with either 0x00 or 0xFF.
     Extend these to 16 words (32 bytes) with either 0x0000 or 0xFFFF.
-    Use these values to increment 16 words in an array by subtraction.
+    Mask the weight with these values and add it to 16 words in an
+    array with saturation, so a weighted word (--idf) costs a single
+    pass.
 
     See article below for some hints:
     http://stackoverflow.com/questions/21622212/
@@ -195,6 +292,8 @@ void increment_counters_from_bitmap_sse2(count_t * counters,
   const __m128i c3 =
     _mm_set_epi32(0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff);
 
+  const __m128i w = _mm_set1_epi16(weight);
+
   auto * p = (unsigned short *)(bitmap);
   auto * q = (__m128i *)(counters);
   int r = (totalbits + 15) / 16;
@@ -215,13 +314,132 @@ void increment_counters_from_bitmap_sse2(count_t * counters,
       xmm3 = _mm_cmpeq_epi8(xmm2, c3);
       xmm4 = _mm_unpacklo_epi8(xmm3, xmm3);
       xmm5 = _mm_unpackhi_epi8(xmm3, xmm3);
-      *q = _mm_subs_epi16(*q, xmm4);
+      *q = _mm_adds_epi16(*q, _mm_and_si128(xmm4, w));
       q++;
-      *q = _mm_subs_epi16(*q, xmm5);
+      *q = _mm_adds_epi16(*q, _mm_and_si128(xmm5, w));
       q++;
     }
 }
 
+#ifdef SSSE3
+int64_t merge_select_ssse3(const char * fwd_sequence,
+                           const char * fwd_quality,
+                           const char * rev_sequence,
+                           const char * rev_quality,
+                           const unsigned char * complement,
+                           int64_t length,
+                           char * merged_sequence,
+                           unsigned short * qual_index,
+                           int64_t * errors)
+{
+  /*
+    Merge the overlapping part of a read pair, 16 positions at a time.
+
+    The forward read is read from fwd_sequence onwards, the reverse
+    read backwards from rev_sequence. The reverse read is reversed
+    with PSHUFB and complemented with two more PSHUFB lookups in a 32
+    byte table for the symbols 0x40 to 0x5f (upper case letters).
+
+    For each position, the symbol is selected as in merge_sym(), the
+    errors of each read are counted, and the merged quality is given
+    as an index into a table of three 128x128 planes, indexed by the
+    highest and lowest of the two qualities: agreement, disagreement,
+    and a copy of the first index, used when one symbol is N.
+
+    Stops before the first block with a reverse read symbol outside the
+    table. Returns the number of positions done.
+  */
+
+  const __m128i reverse =
+    _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i lut_lo = _mm_loadu_si128((const __m128i *) complement);
+  const __m128i lut_hi = _mm_loadu_si128((const __m128i *) (complement + 16));
+  const __m128i base = _mm_set1_epi8(0x40);
+  const __m128i top = _mm_set1_epi8(0x1f);
+  const __m128i bit4 = _mm_set1_epi8(0x10);
+  const __m128i low4 = _mm_set1_epi8(0x0f);
+  const __m128i n = _mm_set1_epi8('N');
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i two = _mm_set1_epi8(2);
+  const __m128i zero = _mm_setzero_si128();
+
+  int64_t fwd_errors = 0;
+  int64_t rev_errors = 0;
+  int64_t j = 0;
+
+  for(; j + 16 <= length; j += 16)
+    {
+      // reverse read, backwards
+      __m128i r = _mm_loadu_si128((const __m128i *)(rev_sequence - j - 15));
+      r = _mm_shuffle_epi8(r, reverse);
+
+      // stop at symbols outside the complement table
+      __m128i x = _mm_sub_epi8(r, base);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, top), top))
+          != 0xffff)
+        {
+          break;
+        }
+
+      __m128i x4 = _mm_and_si128(x, low4);
+      __m128i upper = _mm_cmpeq_epi8(_mm_and_si128(x, bit4), bit4);
+      __m128i c = _mm_or_si128(_mm_and_si128(upper,
+                                             _mm_shuffle_epi8(lut_hi, x4)),
+                               _mm_andnot_si128(upper,
+                                                _mm_shuffle_epi8(lut_lo, x4)));
+
+      __m128i f = _mm_loadu_si128((const __m128i *)(fwd_sequence + j));
+      __m128i qf = _mm_loadu_si128((const __m128i *)(fwd_quality + j));
+      __m128i qr = _mm_loadu_si128((const __m128i *)(rev_quality - j - 15));
+      qr = _mm_shuffle_epi8(qr, reverse);
+
+      __m128i rev_n = _mm_cmpeq_epi8(c, n);
+      __m128i fwd_n = _mm_cmpeq_epi8(f, n);
+      __m128i same = _mm_cmpeq_epi8(f, c);
+      __m128i any_n = _mm_or_si128(rev_n, fwd_n);
+
+      // symbol
+      __m128i pick_fwd =
+        _mm_or_si128(_mm_or_si128(rev_n, same),
+                     _mm_andnot_si128(fwd_n, _mm_cmpgt_epi8(qf, qr)));
+      __m128i sym = _mm_or_si128(_mm_and_si128(pick_fwd, f),
+                                 _mm_andnot_si128(pick_fwd, c));
+      _mm_storeu_si128((__m128i *)(merged_sequence + j), sym);
+
+      fwd_errors +=
+        __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(sym, f)) ^ 0xffff);
+      rev_errors +=
+        __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(sym, c)) ^ 0xffff);
+
+      // quality table plane and indices
+      __m128i high_n = _mm_or_si128(_mm_and_si128(fwd_n, qr),
+                                    _mm_andnot_si128(fwd_n,
+                                                     _mm_max_epu8(qf, qr)));
+      __m128i high = _mm_or_si128(_mm_and_si128(rev_n, qf),
+                                  _mm_andnot_si128(rev_n, high_n));
+      __m128i low = _mm_min_epu8(qf, qr);
+      __m128i kind = _mm_or_si128(_mm_and_si128(any_n, two),
+                                  _mm_andnot_si128(_mm_or_si128(any_n, same),
+                                                   one));
+
+      __m128i i0 =
+        _mm_or_si128(_mm_unpacklo_epi8(low, zero),
+                     _mm_slli_epi16(_mm_unpacklo_epi8(high, zero), 7));
+      i0 = _mm_or_si128(i0, _mm_slli_epi16(_mm_unpacklo_epi8(kind, zero), 14));
+      __m128i i1 =
+        _mm_or_si128(_mm_unpackhi_epi8(low, zero),
+                     _mm_slli_epi16(_mm_unpackhi_epi8(high, zero), 7));
+      i1 = _mm_or_si128(i1, _mm_slli_epi16(_mm_unpackhi_epi8(kind, zero), 14));
+      _mm_storeu_si128((__m128i *)(qual_index + j), i0);
+      _mm_storeu_si128((__m128i *)(qual_index + j + 8), i1);
+    }
+
+  errors[0] += fwd_errors;
+  errors[1] += rev_errors;
+  return j;
+}
+#endif
+
 #else
 
 #error Unknown architecture
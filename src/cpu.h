@@ -61,12 +61,36 @@
 #ifdef __x86_64__
 void increment_counters_from_bitmap_sse2(count_t * counters,
                                          unsigned char * bitmap,
-                                         unsigned int totalbits);
+                                         unsigned int totalbits,
+                                         count_t weight);
 void increment_counters_from_bitmap_ssse3(count_t * counters,
                                           unsigned char * bitmap,
-                                          unsigned int totalbits);
+                                          unsigned int totalbits,
+                                          count_t weight);
+int64_t merge_select_ssse3(const char * fwd_sequence,
+                           const char * fwd_quality,
+                           const char * rev_sequence,
+                           const char * rev_quality,
+                           const unsigned char * complement,
+                           int64_t length,
+                           char * merged_sequence,
+                           unsigned short * qual_index,
+                           int64_t * errors);
 #else
 void increment_counters_from_bitmap(count_t * counters,
                                     unsigned char * bitmap,
-                                    unsigned int totalbits);
+                                    unsigned int totalbits,
+                                    count_t weight);
+#endif
+
+#ifdef __aarch64__
+int64_t merge_select(const char * fwd_sequence,
+                     const char * fwd_quality,
+                     const char * rev_sequence,
+                     const char * rev_quality,
+                     const unsigned char * complement,
+                     int64_t length,
+                     char * merged_sequence,
+                     unsigned short * qual_index,
+                     int64_t * errors);
 #endif
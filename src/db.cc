@@ -62,6 +62,9 @@
 
 #define MEMCHUNK 16777216
 
+/* smaller steps with a memory budget, large blocks are remapped */
+#define MEMCHUNK_BUDGET 1048576
+
 static fastx_handle h = nullptr;
 static bool is_fastq = false;
 static uint64_t sequences = 0;
@@ -118,6 +121,9 @@ void db_read(const char * filename, int upcase)
 
   int64_t filesize = fastx_get_size(h);
 
+  /* the sequences will need at least the size of the file */
+  budget_require(filesize);
+
   char * prompt = nullptr;
   if (xsprintf(& prompt, "Reading file %s", filename) == -1)
     {
@@ -135,6 +141,8 @@ void db_read(const char * filename, int upcase)
   int64_t discarded_short = 0;
   int64_t discarded_long = 0;
   int64_t discarded_unoise = 0;
+  int64_t discarded_shard = 0;
+  uint64_t ordinal = 0;
 
   /* allocate space for data */
   uint64_t dataalloc = 0;
@@ -165,6 +173,11 @@ void db_read(const char * filename, int upcase)
         {
           discarded_unoise++;
         }
+      else if (! shard_select(ordinal++))
+        {
+          /* sequence belongs to another database shard */
+          discarded_shard++;
+        }
       else
         {
           /* grow space for data, if necessary */
@@ -176,10 +189,11 @@ void db_read(const char * filename, int upcase)
             }
           while (dataalloc < needed)
             {
-              dataalloc += MEMCHUNK;
+              dataalloc += opt_max_memory ? MEMCHUNK_BUDGET : MEMCHUNK;
             }
           if (dataalloc > dataalloc_old)
             {
+              budget_require(dataalloc - dataalloc_old);
               datap = (char *) xrealloc(datap, dataalloc);
             }
 
@@ -211,10 +225,11 @@ void db_read(const char * filename, int upcase)
           size_t seqindex_alloc_old = seqindex_alloc;
           while ((sequences + 1) * sizeof(seqinfo_t) > seqindex_alloc)
             {
-              seqindex_alloc += MEMCHUNK;
+              seqindex_alloc += opt_max_memory ? MEMCHUNK_BUDGET : MEMCHUNK;
             }
           if (seqindex_alloc > seqindex_alloc_old)
             {
+              budget_require(seqindex_alloc - seqindex_alloc_old);
               seqindex = (seqinfo_t *) xrealloc(seqindex, seqindex_alloc);
             }
 
@@ -350,6 +365,27 @@ void db_read(const char * filename, int upcase)
         }
     }
 
+  if (discarded_shard)
+    {
+      if (! opt_quiet)
+        {
+          fprintf(stderr,
+                  "db_shard %s: %" PRId64 " %s in other shards skipped.\n",
+                  opt_db_shard,
+                  discarded_shard,
+                  (discarded_shard == 1 ? "sequence" : "sequences"));
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "db_shard %s: %" PRId64 " %s in other shards skipped.\n\n",
+                  opt_db_shard,
+                  discarded_shard,
+                  (discarded_shard == 1 ? "sequence" : "sequences"));
+        }
+    }
+
   show_rusage();
 }
 
@@ -66,6 +66,67 @@ static unsigned int dbhash_shift;
 static uint64_t dbhash_mask;
 static struct dbhash_bucket_s * dbhash_table;
 
+/*
+  Blocked Bloom filter in front of the hash table. Each sequence sets
+  one bit in each of the 8 words of a 64-byte block, so a query that
+  is absent from the database is usually rejected after touching a
+  single cache line, without probing the hash table. The block is
+  selected by the high bits of the hash, the bits within the block by
+  the low 32 bits multiplied by 8 odd constants.
+*/
+
+constexpr int dbhash_bloom_words = 8;
+constexpr uint64_t dbhash_bloom_bits_per_element = 16;
+
+static const uint32_t dbhash_bloom_salt[dbhash_bloom_words] =
+  {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+  };
+
+static uint64_t * dbhash_bloom_alloc;
+static uint64_t * dbhash_bloom;
+static unsigned int dbhash_bloom_shift;
+
+inline uint64_t * dbhash_bloom_block(uint64_t hash)
+{
+  uint64_t block = dbhash_bloom_shift ? hash >> (64 - dbhash_bloom_shift) : 0;
+  return dbhash_bloom + dbhash_bloom_words * block;
+}
+
+inline void dbhash_bloom_mask(uint64_t hash, uint64_t * mask)
+{
+  auto key = (uint32_t) hash;
+  for(int i = 0; i < dbhash_bloom_words; i++)
+    {
+      mask[i] = 1ULL << ((uint32_t)(key * dbhash_bloom_salt[i]) >> 26);
+    }
+}
+
+void dbhash_bloom_add(uint64_t hash)
+{
+  uint64_t mask[dbhash_bloom_words];
+  dbhash_bloom_mask(hash, mask);
+  uint64_t * block = dbhash_bloom_block(hash);
+  for(int i = 0; i < dbhash_bloom_words; i++)
+    {
+      block[i] |= mask[i];
+    }
+}
+
+bool dbhash_bloom_test(uint64_t hash)
+{
+  uint64_t mask[dbhash_bloom_words];
+  dbhash_bloom_mask(hash, mask);
+  uint64_t * block = dbhash_bloom_block(hash);
+  uint64_t missing = 0;
+  for(int i = 0; i < dbhash_bloom_words; i++)
+    {
+      missing |= mask[i] & ~ block[i];
+    }
+  return missing == 0;
+}
+
 int dbhash_seqcmp(char * a, char * b, uint64_t n)
 {
   char * p = a;
@@ -109,26 +170,41 @@ void dbhash_open(uint64_t maxelements)
 
   dbhash_bitmap = bitmap_init(dbhash_size);
   bitmap_reset_all(dbhash_bitmap);
+
+  /* Bloom filter blocks, a multiple of 2, aligned to cache lines */
+
+  uint64_t bloom_blocks = 1;
+  dbhash_bloom_shift = 0;
+  while (maxelements * dbhash_bloom_bits_per_element >
+         bloom_blocks * dbhash_bloom_words * 64)
+    {
+      bloom_blocks <<= 1;
+      dbhash_bloom_shift++;
+    }
+
+  uint64_t bloom_size = bloom_blocks * dbhash_bloom_words * sizeof(uint64_t);
+  dbhash_bloom_alloc = (uint64_t *) xmalloc(bloom_size + 64);
+  dbhash_bloom = (uint64_t *) (((uintptr_t) dbhash_bloom_alloc + 63) &
+                               ~ (uintptr_t) 63);
+  memset(dbhash_bloom, 0, bloom_size);
 }
 
 void dbhash_close()
 {
+  xfree(dbhash_bloom_alloc);
+  dbhash_bloom_alloc = nullptr;
+  dbhash_bloom = nullptr;
   bitmap_free(dbhash_bitmap);
   dbhash_bitmap = nullptr;
   xfree(dbhash_table);
   dbhash_table = nullptr;
 }
 
-int64_t dbhash_search_first(char * seq,
-                            uint64_t seqlen,
-                            struct dbhash_search_info_s * info)
+int64_t dbhash_probe(struct dbhash_search_info_s * info, uint64_t index)
 {
-
-  uint64_t hash = hash_cityhash64(seq, seqlen);
-  info->hash = hash;
-  info->seq = seq;
-  info->seqlen = seqlen;
-  uint64_t index = hash & dbhash_mask;
+  uint64_t hash = info->hash;
+  char * seq = info->seq;
+  uint64_t seqlen = info->seqlen;
   struct dbhash_bucket_s * bp = dbhash_table + index;
 
   while (bitmap_get(dbhash_bitmap, index)
@@ -153,41 +229,40 @@ int64_t dbhash_search_first(char * seq,
     }
 }
 
-int64_t dbhash_search_next(struct dbhash_search_info_s * info)
+int64_t dbhash_search_first(char * seq,
+                            uint64_t seqlen,
+                            struct dbhash_search_info_s * info)
 {
-  uint64_t hash = info->hash;
-  char * seq = info->seq;
-  uint64_t seqlen = info->seqlen;
-  uint64_t index = (info->index + 1) & dbhash_mask;
-  struct dbhash_bucket_s * bp = dbhash_table + index;
 
-  while (bitmap_get(dbhash_bitmap, index)
-         &&
-         ((bp->hash != hash) ||
-          (seqlen != db_getsequencelen(bp->seqno)) ||
-          (dbhash_seqcmp(seq, db_getsequence(bp->seqno), seqlen))))
-    {
-      index = (index + 1) & dbhash_mask;
-      bp = dbhash_table + index;
-    }
-
-  info->index = index;
+  uint64_t hash = hash_cityhash64(seq, seqlen);
+  info->hash = hash;
+  info->seq = seq;
+  info->seqlen = seqlen;
+  info->index = hash & dbhash_mask;
 
-  if (bitmap_get(dbhash_bitmap, index))
-    {
-      return bp->seqno;
-    }
-  else
+  if (! dbhash_bloom_test(hash))
     {
       return -1;
     }
+
+  return dbhash_probe(info, hash & dbhash_mask);
+}
+
+int64_t dbhash_search_next(struct dbhash_search_info_s * info)
+{
+  return dbhash_probe(info, (info->index + 1) & dbhash_mask);
 }
 
 void dbhash_add(char * seq, uint64_t seqlen, uint64_t seqno)
 {
+  /* find a free bucket after any identical sequences */
+
   struct dbhash_search_info_s info;
+  info.hash = hash_cityhash64(seq, seqlen);
+  info.seq = seq;
+  info.seqlen = seqlen;
 
-  int64_t ret = dbhash_search_first(seq, seqlen, & info);
+  int64_t ret = dbhash_probe(& info, info.hash & dbhash_mask);
   while (ret >= 0)
     {
       ret = dbhash_search_next(&info);
@@ -197,6 +272,8 @@ void dbhash_add(char * seq, uint64_t seqlen, uint64_t seqno)
   struct dbhash_bucket_s * bp = dbhash_table + info.index;
   bp->hash = info.hash;
   bp->seqno = seqno;
+
+  dbhash_bloom_add(info.hash);
 }
 
 void dbhash_add_one(uint64_t seqno)
@@ -69,10 +69,21 @@ unsigned int kmerhashsize;
 uint64_t kmerindexsize;
 unsigned int dbindex_count;
 uhandle_s * dbindex_uh;
+unsigned int * kmerslots = nullptr;
+unsigned int kmerslotshift;
+unsigned int dbindex_groups = 0;
+unsigned int * dbindex_group_start = nullptr;
+uint64_t * dbindex_group_kmerhash = nullptr;
+unsigned int * dbindex_group_kmerindex = nullptr;
+unsigned char * dbindex_weights = nullptr;
+unsigned int * dbindex_duprep = nullptr;
+unsigned int * dbindex_dupnext = nullptr;
+unsigned int dbindex_dupcount = 0;
 
 #define BITMAP_THRESHOLD 8
 
 static unsigned int bitmap_mincount;
+static unsigned int kmerslots_used;
 
 void fprint_kmer(FILE * f, unsigned int kk, uint64_t kmer)
 {
@@ -83,12 +94,209 @@ void fprint_kmer(FILE * f, unsigned int kk, uint64_t kmer)
     }
 }
 
+/*
+  The directory (kmercount, kmerhash and kmerbitmap) is either
+  indexed directly by kmer, with 4^wordlength entries, or by the slots
+  of an open addressing hash table holding only the kmers present in
+  the database. The slot table stores kmer+1 in each used slot, zero
+  marks an empty slot. In both cases one extra, empty entry follows
+  the directory.
+*/
+
+void dbindex_slots_init(unsigned int slots)
+{
+  /* slots must be a power of two */
+
+  kmerhashsize = slots;
+  kmerslotshift = 32;
+  while (slots > 1)
+    {
+      slots >>= 1;
+      kmerslotshift--;
+    }
+  kmerslots = (unsigned int *) xmalloc(kmerhashsize * sizeof(unsigned int));
+  memset(kmerslots, 0, kmerhashsize * sizeof(unsigned int));
+  kmerslots_used = 0;
+}
+
+static void dbindex_slots_grow()
+{
+  /*
+    Double the slot table while counting words, moving the counts to
+    the new slots. A table as large as the direct directory is
+    replaced by the direct directory.
+  */
+
+  const unsigned int old_size = kmerhashsize;
+  unsigned int * old_slots = kmerslots;
+  unsigned int * old_count = kmercount;
+  const uint64_t words = 1ULL << (2 * opt_wordlength);
+
+  if (2ULL * old_size >= words)
+    {
+      kmerslots = nullptr;
+      kmerhashsize = words;
+    }
+  else
+    {
+      dbindex_slots_init(2 * old_size);
+    }
+
+  kmercount = (unsigned int *) xmalloc((kmerhashsize+1) * sizeof(unsigned int));
+  memset(kmercount, 0, (kmerhashsize+1) * sizeof(unsigned int));
+
+  for(unsigned int j = 0; j < old_size; j++)
+    {
+      if (old_slots[j])
+        {
+          const unsigned int kmer = old_slots[j] - 1;
+          const unsigned int slot =
+            kmerslots ? dbindex_slots_insert(kmer) : kmer;
+          kmercount[slot] = old_count[j];
+        }
+    }
+
+  xfree(old_slots);
+  xfree(old_count);
+}
+
+unsigned int dbindex_slots_insert(unsigned int kmer)
+{
+  /*
+    Return the slot of the kmer, inserting it if new. The table grows
+    when it would be more than three quarters full, so this is only
+    used while counting the words in dbindex_prepare().
+  */
+
+  const unsigned int mask = kmerhashsize - 1;
+  unsigned int j = dbindex_slothash(kmer);
+  while (kmerslots[j])
+    {
+      if (kmerslots[j] == kmer + 1)
+        {
+          return j;
+        }
+      j = (j + 1) & mask;
+    }
+
+  if (kmerslots_used + 1 > kmerhashsize - kmerhashsize / 4)
+    {
+      dbindex_slots_grow();
+      return kmerslots ? dbindex_slots_insert(kmer) : kmer;
+    }
+
+  kmerslots_used++;
+  kmerslots[j] = kmer + 1;
+  return j;
+}
+
+static uint64_t dbindex_slotcount()
+{
+  /*
+    Number of slots for a hashed directory, or zero for a directly
+    indexed one. Without --slots, a hashed directory is used for long
+    words, where most of the direct directory would be empty. There
+    cannot be more distinct words than nucleotides in the database.
+  */
+
+  const uint64_t words = 1ULL << (2 * opt_wordlength);
+  const uint64_t distinct = MIN(words, db_getnucleotidecount());
+  const uint64_t direct_entry = sizeof(unsigned int) + sizeof(uint64_t)
+    + sizeof(bitmap_t *);
+  const uint64_t hashed_entry = direct_entry + sizeof(unsigned int);
+  const uint64_t postings = db_getnucleotidecount() * sizeof(unsigned int);
+  uint64_t wanted = 0;
+
+  if (opt_slots > 0)
+    {
+      wanted = opt_slots;
+    }
+  else if (opt_wordlength >= 12)
+    {
+      wanted = distinct + distinct / 3;
+    }
+  else if (opt_max_memory)
+    {
+      /*
+        With a memory budget, use a hashed directory if the direct one,
+        together with at most one index entry per nucleotide, does not
+        fit, and the hashed one is smaller.
+      */
+
+      const uint64_t direct = (words + 1) * direct_entry;
+      wanted = distinct + distinct / 3;
+
+      /* the slot count is rounded up to at most twice the wanted one */
+      if ((direct + postings <= budget_available()) ||
+          (2 * wanted * hashed_entry >= direct))
+        {
+          return 0;
+        }
+
+      if (! opt_quiet)
+        {
+          fprintf(stderr, "Using a hashed word directory to stay within --max_memory\n");
+        }
+      if (opt_log)
+        {
+          fprintf(fp_log, "Using a hashed word directory to stay within --max_memory\n");
+        }
+    }
+  else
+    {
+      return 0;
+    }
+
+  uint64_t slots = 1024;
+  while (slots < wanted)
+    {
+      slots *= 2;
+    }
+
+  if (opt_max_memory && (opt_slots == 0))
+    {
+      /*
+        The estimate above assumes that all words are distinct. With a
+        memory budget, start with as many slots as fit instead. The
+        table grows while counting if there are more distinct words.
+      */
+
+      const uint64_t available = budget_available();
+      const uint64_t room = (available > postings) ? available - postings : 0;
+      const uint64_t planned = slots;
+      while ((slots > 1024) && (slots * hashed_entry > room))
+        {
+          slots /= 2;
+        }
+
+      if (slots < planned)
+        {
+          if (! opt_quiet)
+            {
+              fprintf(stderr, "Using %" PRIu64 " word slots to stay within --max_memory\n", slots);
+            }
+          if (opt_log)
+            {
+              fprintf(fp_log, "Using %" PRIu64 " word slots to stay within --max_memory\n", slots);
+            }
+        }
+    }
+
+  return (slots < words) ? slots : 0;
+}
+
 void dbindex_addsequence(unsigned int seqno, int seqmask)
 {
 #if 0
   printf("Adding seqno %d as index element no %d\n", seqno, dbindex_count);
 #endif
 
+  if (dbindex_isduplicate(seqno))
+    {
+      dbindex_map[dbindex_count++] = seqno;
+      return;
+    }
+
   unsigned int uniquecount;
   unsigned int * uniquelist;
   unique_count(dbindex_uh, opt_wordlength,
@@ -97,15 +305,15 @@ void dbindex_addsequence(unsigned int seqno, int seqmask)
   dbindex_map[dbindex_count] = seqno;
   for(unsigned int i=0; i<uniquecount; i++)
     {
-      unsigned int kmer = uniquelist[i];
-      if (kmerbitmap[kmer])
+      unsigned int slot = dbindex_getslot(uniquelist[i]);
+      if (kmerbitmap[slot])
         {
-          kmercount[kmer]++;
-          bitmap_set(kmerbitmap[kmer], dbindex_count);
+          kmercount[slot]++;
+          bitmap_set(kmerbitmap[slot], dbindex_count);
         }
       else
         {
-          kmerindex[kmerhash[kmer]+(kmercount[kmer]++)] = dbindex_count;
+          kmerindex[kmerhash[slot]+(kmercount[slot]++)] = dbindex_count;
         }
     }
   dbindex_count++;
@@ -123,21 +331,117 @@ void dbindex_addallsequences(int seqmask)
   progress_done();
 }
 
+/*
+  Similarity layout. Each sequence gets a signature of two minimum
+  word hashes, a MinHash sketch of size two, and the sequences are
+  indexed in signature order. Sequences sharing most of their words
+  are likely to share the signature and get adjacent index numbers,
+  so the candidates of a query fall in fewer parts of the match lists
+  and of the sequence data, when that is stored in index order.
+*/
+
+static uint64_t * dbindex_similar_sig = nullptr;
+
+static int dbindex_similar_compare(const void * a, const void * b)
+{
+  const unsigned int x = * (const unsigned int *) a;
+  const unsigned int y = * (const unsigned int *) b;
+
+  for(int h = 0; h < 2; h++)
+    {
+      if (dbindex_similar_sig[2 * x + h] < dbindex_similar_sig[2 * y + h])
+        {
+          return -1;
+        }
+      else if (dbindex_similar_sig[2 * x + h] > dbindex_similar_sig[2 * y + h])
+        {
+          return +1;
+        }
+    }
+
+  return (x < y) ? -1 : ((x > y) ? +1 : 0);
+}
+
+void dbindex_addallsequences_similar(int seqmask)
+{
+  const unsigned int seqcount = db_getsequencecount();
+
+  auto * order = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  dbindex_similar_sig =
+    (uint64_t *) xmalloc(2 * seqcount * sizeof(uint64_t));
+
+  progress_init("Ordering sequences by similarity", seqcount);
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      unsigned int uniquecount;
+      unsigned int * uniquelist;
+      unique_count(dbindex_uh, opt_wordlength,
+                   db_getsequencelen(i), db_getsequence(i),
+                   & uniquecount, & uniquelist, seqmask);
+
+      uint64_t min1 = UINT64_MAX;
+      uint64_t min2 = UINT64_MAX;
+      for(unsigned int j = 0; j < uniquecount; j++)
+        {
+          const char * kmer = (const char *) (uniquelist + j);
+          const uint64_t h1 = CityHash64(kmer, sizeof(unsigned int));
+          const uint64_t h2 = CityHash64WithSeed(kmer, sizeof(unsigned int),
+                                                 0x9e3779b97f4a7c15ULL);
+          min1 = MIN(min1, h1);
+          min2 = MIN(min2, h2);
+        }
+
+      order[i] = i;
+      dbindex_similar_sig[2 * i] = min1;
+      dbindex_similar_sig[2 * i + 1] = min2;
+      progress_update(i + 1);
+    }
+  progress_done();
+
+  qsort(order, seqcount, sizeof(unsigned int), dbindex_similar_compare);
+
+  xfree(dbindex_similar_sig);
+  dbindex_similar_sig = nullptr;
+
+  progress_init("Creating k-mer index", seqcount);
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      dbindex_addsequence(order[i], seqmask);
+      progress_update(i + 1);
+    }
+  progress_done();
+
+  xfree(order);
+}
+
 void dbindex_prepare(int use_bitmap, int seqmask)
 {
   dbindex_uh = unique_init();
 
   unsigned int seqcount = db_getsequencecount();
-  kmerhashsize = 1 << (2 * opt_wordlength);
+
+  uint64_t slots = dbindex_slotcount();
+  if (slots)
+    {
+      dbindex_slots_init(slots);
+    }
+  else
+    {
+      kmerhashsize = 1 << (2 * opt_wordlength);
+    }
 
   /* allocate memory for kmer count array */
-  kmercount = (unsigned int *) xmalloc(kmerhashsize * sizeof(unsigned int));
-  memset(kmercount, 0, kmerhashsize * sizeof(unsigned int));
+  kmercount = (unsigned int *) xmalloc((kmerhashsize+1) * sizeof(unsigned int));
+  memset(kmercount, 0, (kmerhashsize+1) * sizeof(unsigned int));
 
   /* first scan, just count occurences */
   progress_init("Counting k-mers", seqcount);
   for(unsigned int seqno = 0; seqno < seqcount ; seqno++)
     {
+      if (dbindex_isduplicate(seqno))
+        {
+          continue;
+        }
       unsigned int uniquecount;
       unsigned int * uniquelist;
       unique_count(dbindex_uh, opt_wordlength,
@@ -145,12 +449,43 @@ void dbindex_prepare(int use_bitmap, int seqmask)
                    & uniquecount, & uniquelist, seqmask);
       for(unsigned int i=0; i<uniquecount; i++)
         {
-          kmercount[uniquelist[i]]++;
+          if (kmerslots)
+            {
+              /* may grow the table and move kmercount */
+              const unsigned int slot = dbindex_slots_insert(uniquelist[i]);
+              kmercount[slot]++;
+            }
+          else
+            {
+              kmercount[uniquelist[i]]++;
+            }
         }
       progress_update(seqno);
     }
   progress_done();
 
+  /* warn only if the slot count given with --slots was too small */
+  if ((opt_slots > 0) && slots && (kmerhashsize != slots))
+    {
+      char * message = nullptr;
+      if (kmerslots)
+        {
+          xsprintf(& message, "Too many distinct words for %" PRIu64
+                   " slots, using %u slots", slots, kmerhashsize);
+        }
+      else
+        {
+          xsprintf(& message, "Too many distinct words for %" PRIu64
+                   " slots, using a direct word directory", slots);
+        }
+      fprintf(stderr, "\nWARNING: %s\n", message);
+      if (opt_log)
+        {
+          fprintf(fp_log, "WARNING: %s\n", message);
+        }
+      xfree(message);
+    }
+
 #if 0
   /* dump kmer counts */
   FILE * f = fopen_output("kmercounts.txt");
@@ -173,8 +508,8 @@ void dbindex_prepare(int use_bitmap, int seqmask)
     }
 
   /* allocate and zero bitmap pointers */
-  kmerbitmap = (bitmap_t **) xmalloc(kmerhashsize * sizeof(bitmap_t *));
-  memset(kmerbitmap, 0, kmerhashsize * sizeof(bitmap_t *));
+  kmerbitmap = (bitmap_t **) xmalloc((kmerhashsize+1) * sizeof(bitmap_t *));
+  memset(kmerbitmap, 0, (kmerhashsize+1) * sizeof(bitmap_t *));
 
   /* hash / bitmap setup */
   /* convert hash counts to position in index */
@@ -202,7 +537,7 @@ void dbindex_prepare(int use_bitmap, int seqmask)
 #endif
 
   /* reset counts */
-  memset(kmercount, 0, kmerhashsize * sizeof(unsigned int));
+  memset(kmercount, 0, (kmerhashsize+1) * sizeof(unsigned int));
 
   /* allocate space for actual data */
   kmerindex = (unsigned int *) xmalloc(kmerindexsize * sizeof(unsigned int));
@@ -215,6 +550,363 @@ void dbindex_prepare(int use_bitmap, int seqmask)
   show_rusage();
 }
 
+/*
+  Two-level index. The database sequences are grouped around
+  representatives by greedy centroid clustering on shared words, like
+  cluster_fast does on alignments: the sequences are visited by
+  decreasing length, and each sequence not yet in a group becomes the
+  representative of a new group, taking all ungrouped sequences that
+  share at least the given fraction of their words with it. The index
+  numbers are then assigned group by group, representative first, so
+  each group is a contiguous range of index numbers and a contiguous
+  part of every match list. A small second index lists the groups
+  whose representative contains each kmer.
+*/
+
+static int dbindex_group_compare(const void * a, const void * b)
+{
+  const unsigned int x = * (const unsigned int *) a;
+  const unsigned int y = * (const unsigned int *) b;
+  const uint64_t lx = db_getsequencelen(x);
+  const uint64_t ly = db_getsequencelen(y);
+
+  if (lx > ly)
+    {
+      return -1;
+    }
+  else if (lx < ly)
+    {
+      return +1;
+    }
+  else
+    {
+      return (x < y) ? -1 : ((x > y) ? +1 : 0);
+    }
+}
+
+void dbindex_group(double group_id, int seqmask)
+{
+  /* group the sequences of a flat index, then index them again by group */
+
+  const unsigned int seqcount = db_getsequencecount();
+  const unsigned int none = UINT_MAX;
+
+  auto * order = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * words = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * group_of = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * shared = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * touched = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * reps = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      unsigned int uniquecount;
+      unsigned int * uniquelist;
+      unique_count(dbindex_uh, opt_wordlength,
+                   db_getsequencelen(i), db_getsequence(i),
+                   & uniquecount, & uniquelist, seqmask);
+      order[i] = i;
+      words[i] = uniquecount;
+      group_of[i] = none;
+      shared[i] = 0;
+    }
+
+  qsort(order, seqcount, sizeof(unsigned int), dbindex_group_compare);
+
+  unsigned int groups = 0;
+
+  progress_init("Grouping sequences", seqcount);
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      const unsigned int rep = order[i];
+
+      if (group_of[rep] == none)
+        {
+          const unsigned int g = groups++;
+          reps[g] = rep;
+          group_of[rep] = g;
+
+          /* count words shared with the ungrouped sequences */
+
+          unsigned int uniquecount;
+          unsigned int * uniquelist;
+          unique_count(dbindex_uh, opt_wordlength,
+                       db_getsequencelen(rep), db_getsequence(rep),
+                       & uniquecount, & uniquelist, seqmask);
+
+          unsigned int touched_count = 0;
+          for(unsigned int j = 0; j < uniquecount; j++)
+            {
+              const unsigned int slot = dbindex_getslot(uniquelist[j]);
+              const unsigned int * list = dbindex_getmatchlist(slot);
+              const unsigned int count = dbindex_getmatchcount(slot);
+              for(unsigned int k = 0; k < count; k++)
+                {
+                  const unsigned int t = list[k];
+                  if (group_of[t] == none)
+                    {
+                      if (shared[t] == 0)
+                        {
+                          touched[touched_count++] = t;
+                        }
+                      shared[t]++;
+                    }
+                }
+            }
+
+          for(unsigned int j = 0; j < touched_count; j++)
+            {
+              const unsigned int t = touched[j];
+              if (shared[t] >= group_id * words[t])
+                {
+                  group_of[t] = g;
+                }
+              shared[t] = 0;
+            }
+        }
+      progress_update(i + 1);
+    }
+  progress_done();
+
+  /* index numbers by group, representative first, then by seqno */
+
+  dbindex_groups = groups;
+  dbindex_group_start =
+    (unsigned int *) xmalloc((groups + 1) * sizeof(unsigned int));
+  memset(dbindex_group_start, 0, (groups + 1) * sizeof(unsigned int));
+
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      dbindex_group_start[group_of[i] + 1]++;
+    }
+  for(unsigned int g = 0; g < groups; g++)
+    {
+      dbindex_group_start[g + 1] += dbindex_group_start[g];
+      order[dbindex_group_start[g]] = reps[g];
+      shared[g] = dbindex_group_start[g] + 1;
+    }
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      const unsigned int g = group_of[i];
+      if (i != reps[g])
+        {
+          order[shared[g]++] = i;
+        }
+    }
+
+  xfree(reps);
+  xfree(touched);
+  xfree(shared);
+  xfree(group_of);
+  xfree(words);
+
+  /* index again in the new order, with bitmaps */
+
+  unsigned int * group_start = dbindex_group_start;
+  dbindex_group_start = nullptr;
+  dbindex_groups = 0;
+  dbindex_free();
+  dbindex_prepare(1, seqmask);
+  dbindex_groups = groups;
+  dbindex_group_start = group_start;
+
+  progress_init("Creating k-mer index", seqcount);
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      dbindex_addsequence(order[i], seqmask);
+      progress_update(i + 1);
+    }
+  progress_done();
+
+  xfree(order);
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Grouped %u sequences into %u groups\n",
+              seqcount, groups);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Grouped %u sequences into %u groups\n",
+              seqcount, groups);
+    }
+}
+
+void dbindex_group_index(int seqmask)
+{
+  /* index the kmers of the group representatives */
+
+  dbindex_group_kmerhash =
+    (uint64_t *) xmalloc((kmerhashsize + 2) * sizeof(uint64_t));
+  memset(dbindex_group_kmerhash, 0, (kmerhashsize + 2) * sizeof(uint64_t));
+
+  /* count, then convert the counts to positions, then fill */
+
+  for(int pass = 0; pass < 2; pass++)
+    {
+      for(unsigned int g = 0; g < dbindex_groups; g++)
+        {
+          const unsigned int rep = dbindex_map[dbindex_group_start[g]];
+          unsigned int uniquecount;
+          unsigned int * uniquelist;
+          unique_count(dbindex_uh, opt_wordlength,
+                       db_getsequencelen(rep), db_getsequence(rep),
+                       & uniquecount, & uniquelist, seqmask);
+          for(unsigned int j = 0; j < uniquecount; j++)
+            {
+              const unsigned int slot = dbindex_getslot(uniquelist[j]);
+              if (pass == 0)
+                {
+                  dbindex_group_kmerhash[slot + 1]++;
+                }
+              else
+                {
+                  dbindex_group_kmerindex[dbindex_group_kmerhash[slot]++] = g;
+                }
+            }
+        }
+
+      if (pass == 0)
+        {
+          for(unsigned int i = 0; i <= kmerhashsize; i++)
+            {
+              dbindex_group_kmerhash[i + 1] += dbindex_group_kmerhash[i];
+            }
+          dbindex_group_kmerindex = (unsigned int *)
+            xmalloc((dbindex_group_kmerhash[kmerhashsize + 1] + 1) *
+                    sizeof(unsigned int));
+        }
+      else
+        {
+          /* the fill moved each start to the next one, shift back */
+          for(unsigned int i = kmerhashsize + 1; i > 0; i--)
+            {
+              dbindex_group_kmerhash[i] = dbindex_group_kmerhash[i - 1];
+            }
+          dbindex_group_kmerhash[0] = 0;
+        }
+    }
+}
+
+void dbindex_weights_init(double max_word_freq, bool idf)
+{
+  /*
+    Give each directory slot the weight its kmer contributes to the
+    number of matching kmers of a target. Kmers found in more than the
+    given fraction of the indexed sequences get weight zero and are
+    ignored. With idf, the other kmers are weighted by their inverse
+    document frequency, 1 + log2(n / df), limited to idf_maxweight.
+  */
+
+  const double n = dbindex_count - dbindex_dupcount;
+  unsigned int stopwords = 0;
+
+  dbindex_weights = (unsigned char *) xmalloc(kmerhashsize + 1);
+
+  for(unsigned int slot = 0; slot < kmerhashsize; slot++)
+    {
+      const unsigned int df = kmercount[slot];
+      unsigned char w = 1;
+
+      if (df > max_word_freq * n)
+        {
+          w = 0;
+          stopwords++;
+        }
+      else if (idf && (df > 0))
+        {
+          w = (unsigned char) MIN(1 + floor(log2(n / df)), idf_maxweight);
+        }
+
+      dbindex_weights[slot] = w;
+    }
+
+  dbindex_weights[kmerhashsize] = 1;
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Ignoring %u words found in more than %.1f%% of the sequences\n",
+              stopwords, 100.0 * max_word_freq);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Ignoring %u words found in more than %.1f%% of the sequences\n",
+              stopwords, 100.0 * max_word_freq);
+    }
+}
+
+void dbindex_dedup()
+{
+  /*
+    Find the sequences identical to an earlier one, including the case
+    of the letters, so that the masking is the same. Only the first of
+    each set of identical sequences is indexed. The others are linked
+    to it in seqno order and get the same alignment when it is a
+    candidate.
+  */
+
+  const unsigned int seqcount = db_getsequencecount();
+
+  dbindex_duprep = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  dbindex_dupnext = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  auto * last = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  char * normalized = (char *) xmalloc(db_getlongestsequence() + 1);
+  dbindex_dupcount = 0;
+
+  dbhash_open(seqcount);
+
+  progress_init("Finding identical sequences", seqcount);
+  for(unsigned int seqno = 0; seqno < seqcount; seqno++)
+    {
+      char * seq = db_getsequence(seqno);
+      uint64_t seqlen = db_getsequencelen(seqno);
+      string_normalize(normalized, seq, seqlen);
+
+      struct dbhash_search_info_s info;
+      int64_t rep = dbhash_search_first(normalized, seqlen, & info);
+      while ((rep >= 0) && memcmp(seq, db_getsequence(rep), seqlen))
+        {
+          rep = dbhash_search_next(& info);
+        }
+
+      dbindex_dupnext[seqno] = 0;
+
+      if (rep >= 0)
+        {
+          dbindex_duprep[seqno] = rep;
+          dbindex_dupnext[last[rep]] = seqno;
+          last[rep] = seqno;
+          dbindex_dupcount++;
+        }
+      else
+        {
+          dbindex_duprep[seqno] = seqno;
+          last[seqno] = seqno;
+          dbhash_add(normalized, seqlen, seqno);
+        }
+      progress_update(seqno + 1);
+    }
+  progress_done();
+
+  dbhash_close();
+  xfree(normalized);
+  xfree(last);
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Indexing %u unique of %u sequences\n",
+              seqcount - dbindex_dupcount, seqcount);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Indexing %u unique of %u sequences\n",
+              seqcount - dbindex_dupcount, seqcount);
+    }
+}
+
 void dbindex_free()
 {
   xfree(kmerhash);
@@ -230,5 +922,36 @@ void dbindex_free()
         }
     }
   xfree(kmerbitmap);
+  if (kmerslots)
+    {
+      xfree(kmerslots);
+      kmerslots = nullptr;
+    }
+  if (dbindex_groups)
+    {
+      xfree(dbindex_group_start);
+      dbindex_group_start = nullptr;
+      dbindex_groups = 0;
+    }
+  if (dbindex_group_kmerhash)
+    {
+      xfree(dbindex_group_kmerhash);
+      xfree(dbindex_group_kmerindex);
+      dbindex_group_kmerhash = nullptr;
+      dbindex_group_kmerindex = nullptr;
+    }
+  if (dbindex_weights)
+    {
+      xfree(dbindex_weights);
+      dbindex_weights = nullptr;
+    }
+  if (dbindex_duprep)
+    {
+      xfree(dbindex_duprep);
+      xfree(dbindex_dupnext);
+      dbindex_duprep = nullptr;
+      dbindex_dupnext = nullptr;
+      dbindex_dupcount = 0;
+    }
   unique_exit(dbindex_uh);
 }
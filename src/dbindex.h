@@ -67,20 +67,71 @@ extern unsigned int dbindex_count;
 extern unsigned int kmerhashsize;
 extern uint64_t kmerindexsize;
 extern uhandle_s * dbindex_uh;
+extern unsigned int * kmerslots; /* kmer+1 in each used slot, if hashed */
+extern unsigned int kmerslotshift;
+extern unsigned int dbindex_groups; /* number of groups, 0 if flat */
+extern unsigned int * dbindex_group_start; /* first index no of each group */
+extern uint64_t * dbindex_group_kmerhash; /* representatives index */
+extern unsigned int * dbindex_group_kmerindex; /* groups with each kmer */
+extern unsigned char * dbindex_weights; /* weight of each slot, or null */
+extern unsigned int * dbindex_duprep; /* first identical seqno, or null */
+extern unsigned int * dbindex_dupnext; /* next identical seqno, 0 if last */
+extern unsigned int dbindex_dupcount; /* sequences identical to an earlier one */
+
+/* largest idf weight of a kmer */
+constexpr unsigned int idf_maxweight = 8;
 
 void fprint_kmer(FILE * f, unsigned int k, uint64_t kmer);
 
+void dbindex_slots_init(unsigned int slots);
+unsigned int dbindex_slots_insert(unsigned int kmer);
 void dbindex_prepare(int use_bitmap, int seqmask);
 void dbindex_addallsequences(int seqmask);
+void dbindex_addallsequences_similar(int seqmask);
 void dbindex_addsequence(unsigned int seqno, int seqmask);
 void dbindex_free();
+void dbindex_group(double group_id, int seqmask);
+void dbindex_group_index(int seqmask);
+void dbindex_weights_init(double max_word_freq, bool idf);
+void dbindex_dedup();
 void dbindex_udb_write();
 
-inline unsigned char * dbindex_getbitmap(unsigned int kmer)
+inline unsigned int dbindex_slothash(unsigned int kmer)
 {
-  if (kmerbitmap[kmer])
+  return (kmer * 2654435761U) >> kmerslotshift;
+}
+
+inline unsigned int dbindex_getslot(unsigned int kmer)
+{
+  /*
+    Return the directory slot of the kmer. Without a slot table the
+    directory is indexed directly by kmer. Kmers missing from a hashed
+    directory get the empty slot at the end.
+  */
+
+  if (! kmerslots)
+    {
+      return kmer;
+    }
+
+  const unsigned int mask = kmerhashsize - 1;
+  unsigned int j = dbindex_slothash(kmer);
+  while (kmerslots[j])
     {
-      return kmerbitmap[kmer]->bitmap;
+      if (kmerslots[j] == kmer + 1)
+        {
+          return j;
+        }
+      j = (j + 1) & mask;
+    }
+  return kmerhashsize;
+}
+
+inline unsigned char * dbindex_getbitmap(unsigned int slot)
+{
+  if (kmerbitmap[slot])
+    {
+      return kmerbitmap[slot]->bitmap;
     }
   else
     {
@@ -88,14 +139,43 @@ inline unsigned char * dbindex_getbitmap(unsigned int kmer)
     }
 }
 
-inline unsigned int dbindex_getmatchcount(unsigned int kmer)
+inline unsigned int dbindex_getmatchcount(unsigned int slot)
 {
-  return kmercount[kmer];
+  return kmercount[slot];
 }
 
-inline unsigned int * dbindex_getmatchlist(unsigned int kmer)
+inline unsigned int * dbindex_getmatchlist(unsigned int slot)
 {
-  return kmerindex + kmerhash[kmer];
+  return kmerindex + kmerhash[slot];
+}
+
+inline void dbindex_prefetch_directory(unsigned int kmer)
+{
+  if (kmerslots)
+    {
+      __builtin_prefetch(kmerslots + dbindex_slothash(kmer));
+    }
+  else
+    {
+      __builtin_prefetch(kmerbitmap + kmer);
+      __builtin_prefetch(kmercount + kmer);
+      __builtin_prefetch(kmerhash + kmer);
+    }
+}
+
+inline void dbindex_prefetch_matchlist(unsigned int kmer)
+{
+  if (kmerslots)
+    {
+      unsigned int slot = dbindex_getslot(kmer);
+      __builtin_prefetch(kmerbitmap + slot);
+      __builtin_prefetch(kmercount + slot);
+      __builtin_prefetch(kmerhash + slot);
+    }
+  else if (! kmerbitmap[kmer])
+    {
+      __builtin_prefetch(kmerindex + kmerhash[kmer]);
+    }
 }
 
 inline unsigned int dbindex_getmapping(unsigned int index)
@@ -103,7 +183,24 @@ inline unsigned int dbindex_getmapping(unsigned int index)
   return dbindex_map[index];
 }
 
+inline bool dbindex_isduplicate(unsigned int seqno)
+{
+  /* duplicates are not indexed, but expanded from their representative */
+  return dbindex_duprep && (dbindex_duprep[seqno] != seqno);
+}
+
 inline unsigned int dbindex_getcount()
 {
   return dbindex_count;
 }
+
+inline unsigned int dbindex_group_getcount(unsigned int slot)
+{
+  return dbindex_group_kmerhash[slot + 1] - dbindex_group_kmerhash[slot];
+}
+
+inline unsigned int * dbindex_group_getlist(unsigned int slot)
+{
+  return dbindex_group_kmerindex + dbindex_group_kmerhash[slot];
+}
+
@@ -279,6 +279,8 @@ void derep(char * input_filename, bool use_header)
 
   show_rusage();
 
+  budget_set_hint("Use --derep_smallmem to dereplicate with less memory");
+
   fastx_handle h = fastx_open(input_filename);
 
   if (!h)
@@ -1136,6 +1138,16 @@ void derep_prefix()
   auto * prefix_hashes = (uint64_t *)
     xmalloc(sizeof(uint64_t) * (len_longest+1));
 
+  /*
+    Number of current cluster representatives of each length. Only
+    prefix lengths with at least one representative need to be looked
+    up in the hash table.
+  */
+
+  auto * length_count = (unsigned int *)
+    xmalloc(sizeof(unsigned int) * (len_longest+1));
+  memset(length_count, 0, sizeof(unsigned int) * (len_longest+1));
+
   progress_init("Dereplicating", dbsequencecount);
   for(int64_t i=0; i<dbsequencecount; i++)
     {
@@ -1225,6 +1237,12 @@ void derep_prefix()
           while((! bp->size) && (prefix_len > len_shortest))
             {
               prefix_len--;
+
+              if (! length_count[prefix_len])
+                {
+                  continue;
+                }
+
               hash = prefix_hashes[prefix_len];
               bp = hashtable + (hash & hash_mask);
 
@@ -1253,6 +1271,8 @@ void derep_prefix()
               unsigned int last = bp->seqno_last;
               unsigned int size = bp->size;
               bp->deleted = true;
+              length_count[prefix_len]--;
+              length_count[seqlen]++;
 
               /* create new hash entry */
               bp = orig_bp;
@@ -1274,6 +1294,7 @@ void derep_prefix()
               orig_bp->hash = orig_hash;
               orig_bp->seqno_first = i;
               orig_bp->seqno_last = i;
+              length_count[seqlen]++;
 
               if (ab > maxsize)
                 {
@@ -1288,6 +1309,7 @@ void derep_prefix()
   progress_done();
 
   xfree(prefix_hashes);
+  xfree(length_count);
 
   xfree(seq_up);
 
@@ -582,11 +582,37 @@ uint64_t fastx_file_fill_buffer(fastx_handle h)
       switch(h->format)
         {
         case FORMAT_PLAIN:
-          bytes_read = fread(h->file_buffer.data
-                             + h->file_buffer.position,
-                             1,
-                             space,
-                             h->fp);
+          if (opt_stream && h->is_pipe)
+            {
+              /* take what is available now, flushing output while the
+                 pipe is empty, instead of waiting for a full buffer */
+              int fd = fileno(h->fp);
+              bool ready = arch_input_ready(fd);
+              if (! ready)
+                {
+                  stream_wait(true);
+                }
+              bytes_read = arch_read(fd,
+                                     h->file_buffer.data
+                                     + h->file_buffer.position,
+                                     space);
+              if (! ready)
+                {
+                  stream_wait(false);
+                }
+              if (bytes_read < 0)
+                {
+                  fatal("Unable to read from pipe");
+                }
+            }
+          else
+            {
+              bytes_read = fread(h->file_buffer.data
+                                 + h->file_buffer.position,
+                                 1,
+                                 space,
+                                 h->fp);
+            }
           break;
 
         case FORMAT_GZIP:
@@ -671,6 +697,41 @@ uint64_t fastx_get_position(fastx_handle h)
     }
 }
 
+uint64_t fastx_get_next_offset(fastx_handle h)
+{
+  /* uncompressed offset of the start of the next entry in the file,
+     only meaningful for plain files */
+  return h->file_position - (h->file_buffer.length - h->file_buffer.position);
+}
+
+void fastx_skip(fastx_handle h, uint64_t offset, uint64_t count)
+{
+  /* skip to entry number count, starting at the given file offset;
+     seek directly in plain files, otherwise read and discard entries */
+
+  if ((h->format == FORMAT_PLAIN) && (! h->is_pipe))
+    {
+      if (xfseeko(h->fp, offset, SEEK_SET) != 0)
+        {
+          fatal("Unable to seek in input file");
+        }
+      h->file_buffer.position = 0;
+      h->file_buffer.length = 0;
+      h->file_position = offset;
+      h->seqno = count - 1;
+    }
+  else
+    {
+      while ((uint64_t)(h->seqno + 1) < count)
+        {
+          if (! fastx_next(h, false, chrmap_no_change))
+            {
+              fatal("Input file is shorter than expected");
+            }
+        }
+    }
+}
+
 
 uint64_t fastx_get_size(fastx_handle h)
 {
@@ -124,6 +124,8 @@ bool fastx_next(fastx_handle h,
                 bool truncateatspace,
                 const unsigned char * char_mapping);
 uint64_t fastx_get_position(fastx_handle h);
+uint64_t fastx_get_next_offset(fastx_handle h);
+void fastx_skip(fastx_handle h, uint64_t offset, uint64_t count);
 uint64_t fastx_get_size(fastx_handle h);
 uint64_t fastx_get_lineno(fastx_handle h);
 uint64_t fastx_get_seqno(fastx_handle h);
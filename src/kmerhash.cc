@@ -297,3 +297,60 @@ void kh_find_diagonals(struct kh_handle_s * kh,
         }
     }
 }
+
+void kh_find_coverage(struct kh_handle_s * kh,
+                      int k,
+                      char * seq,
+                      int len,
+                      int * diags,
+                      int * cover)
+{
+  /*
+    Count the kmers of seq found in the hashed sequence on each
+    diagonal, as in kh_find_diagonals but on the same strand, and mark
+    the positions of the hashed sequence covered by these kmers in
+    cover, as the start (+1) and end (-1) of each kmer. The diags
+    array must have room for maxpos + len elements and the cover array
+    for maxpos + 1 elements.
+  */
+
+  memset(diags, 0, (kh->maxpos + len) * sizeof(int));
+  memset(cover, 0, (kh->maxpos + 1) * sizeof(int));
+
+  int kmers = 1 << (2 * k);
+  unsigned int kmer_mask = kmers - 1;
+
+  unsigned int bad = kmer_mask;
+  unsigned int kmer = 0;
+  char * s = seq;
+
+  for (int pos = 0; pos < len; pos++)
+    {
+      int c = *s++;
+
+      bad <<= 2ULL;
+      bad |= chrmap_mask_ambig[c];
+      bad &= kmer_mask;
+
+      kmer <<= 2ULL;
+      kmer |= chrmap_2bit[c];
+      kmer &= kmer_mask;
+
+      if (!bad)
+        {
+          /* find matching buckets in hash */
+          unsigned int j = HASH((char*)&kmer, (k+3)/4) & kh->hash_mask;
+          while(kh->hash[j].pos)
+            {
+              if (kh->hash[j].kmer == kmer)
+                {
+                  int fpos = kh->hash[j].pos - 1;
+                  diags[len + fpos - (pos - k + 1)]++;
+                  cover[fpos]++;
+                  cover[fpos + k]--;
+                }
+              j = (j + 1) & kh->hash_mask;
+            }
+        }
+    }
+}
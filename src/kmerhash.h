@@ -72,3 +72,10 @@ void kh_find_diagonals(struct kh_handle_s * kh,
                        char * seq,
                        int len,
                        int * diags);
+
+void kh_find_coverage(struct kh_handle_s * kh,
+                      int k,
+                      char * seq,
+                      int len,
+                      int * diags,
+                      int * cover);
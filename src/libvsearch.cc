@@ -0,0 +1,410 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include "libvsearch.h"
+
+struct vsearch_db_s
+{
+  int seqcount;
+};
+
+struct vsearch_ctx_s
+{
+  vsearch_db_t * db;
+  struct searchinfo_s * si_plus;
+  struct searchinfo_s * si_minus;
+  struct kh_handle_s * kmerhash;
+  int query_no;
+};
+
+static vsearch_db_t * db_open = nullptr;
+
+void vsearch_init(int argc, char ** argv)
+{
+  cpu_features_detect();
+
+  args_init(argc, argv);
+
+  dynlibs_open();
+
+#ifdef __x86_64__
+  if (!sse2_present)
+    {
+      fatal("Sorry, this program requires a cpu with SSE2.");
+    }
+#endif
+
+  /* no progress indicators from the library */
+  opt_no_progress = true;
+
+  mergepairs_prep();
+}
+
+void vsearch_exit()
+{
+  dynlibs_close();
+}
+
+vsearch_db_t * vsearch_db_open(const char * filename)
+{
+  if (db_open)
+    {
+      fatal("Only one database can be open at a time");
+    }
+
+  opt_db = (char *) filename;
+
+  if (opt_sintax)
+    {
+      sintax_prep_db();
+    }
+  else
+    {
+      search_prep_db();
+    }
+
+  db_open = (vsearch_db_t *) xmalloc(sizeof(vsearch_db_t));
+  db_open->seqcount = db_getsequencecount();
+
+  return db_open;
+}
+
+void vsearch_db_close(vsearch_db_t * db)
+{
+  dbindex_free();
+  db_free();
+  xfree(db);
+  db_open = nullptr;
+}
+
+int vsearch_db_count(vsearch_db_t * db)
+{
+  return db->seqcount;
+}
+
+const char * vsearch_db_header(vsearch_db_t * db, int target)
+{
+  if ((target < 0) || (target >= db->seqcount))
+    {
+      return nullptr;
+    }
+  return db_getheader(target);
+}
+
+vsearch_ctx_t * vsearch_ctx_new(vsearch_db_t * db)
+{
+  auto * ctx = (vsearch_ctx_t *) xmalloc(sizeof(vsearch_ctx_t));
+
+  ctx->db = db;
+  ctx->si_plus = nullptr;
+  ctx->si_minus = nullptr;
+  ctx->kmerhash = nullptr;
+  ctx->query_no = 0;
+
+  if (db)
+    {
+      /* thread specific search data, as for the worker threads */
+
+      ctx->si_plus = (struct searchinfo_s *)
+        xmalloc(sizeof(struct searchinfo_s));
+      if (opt_strand > 1)
+        {
+          ctx->si_minus = (struct searchinfo_s *)
+            xmalloc(sizeof(struct searchinfo_s));
+        }
+
+      for (int s = 0; s < opt_strand; s++)
+        {
+          struct searchinfo_s * si = s ? ctx->si_minus : ctx->si_plus;
+          if (opt_sintax)
+            {
+              sintax_thread_init(si);
+            }
+          else
+            {
+              search_thread_init(si);
+            }
+        }
+
+      if (! opt_sintax)
+        {
+          /* the strands share the aligner, as in search_threads_init() */
+          ctx->si_plus->s = search_aligner_init();
+          if (ctx->si_minus)
+            {
+              ctx->si_minus->s = ctx->si_plus->s;
+            }
+        }
+    }
+
+  return ctx;
+}
+
+void vsearch_ctx_free(vsearch_ctx_t * ctx)
+{
+  if (ctx->db)
+    {
+      if (! opt_sintax)
+        {
+          search16_exit(ctx->si_plus->s);
+        }
+
+      for (int s = 0; s < opt_strand; s++)
+        {
+          struct searchinfo_s * si = s ? ctx->si_minus : ctx->si_plus;
+          if (opt_sintax)
+            {
+              sintax_thread_exit(si);
+            }
+          else
+            {
+              search_thread_exit(si);
+            }
+          xfree(si);
+        }
+    }
+
+  if (ctx->kmerhash)
+    {
+      kh_exit(ctx->kmerhash);
+    }
+
+  xfree(ctx);
+}
+
+static void ctx_set_query(vsearch_ctx_t * ctx,
+                          const char * header,
+                          const char * sequence,
+                          int length)
+{
+  /* copy the query into the search data of both strands */
+
+  if (! ctx->db)
+    {
+      fatal("No database given for this context");
+    }
+
+  int header_len = header ? strlen(header) : 0;
+
+  for (int s = 0; s < opt_strand; s++)
+    {
+      struct searchinfo_s * si = s ? ctx->si_minus : ctx->si_plus;
+
+      si->query_head_len = header_len;
+      si->qseqlen = length;
+      si->query_no = ctx->query_no;
+      si->qsize = 1;
+      si->strand = s;
+
+      /* allocate more memory for header and sequence, if necessary */
+
+      if (si->query_head_len + 1 > si->query_head_alloc)
+        {
+          si->query_head_alloc = si->query_head_len + 2001;
+          si->query_head = (char*)
+            xrealloc(si->query_head, (size_t)(si->query_head_alloc));
+        }
+
+      if (si->qseqlen + 1 > si->seq_alloc)
+        {
+          si->seq_alloc = si->qseqlen + 2001;
+          si->qsequence = (char*)
+            xrealloc(si->qsequence, (size_t)(si->seq_alloc));
+        }
+    }
+
+  /* plus strand: copy header and sequence */
+  memcpy(ctx->si_plus->query_head, header ? header : "", header_len + 1);
+  memcpy(ctx->si_plus->qsequence, sequence, length);
+  ctx->si_plus->qsequence[length] = 0;
+
+  /* minus strand: copy header and reverse complementary sequence */
+  if (opt_strand > 1)
+    {
+      strcpy(ctx->si_minus->query_head, ctx->si_plus->query_head);
+      reverse_complement(ctx->si_minus->qsequence,
+                         ctx->si_plus->qsequence,
+                         ctx->si_plus->qseqlen);
+    }
+
+  ctx->query_no++;
+}
+
+int vsearch_search(vsearch_ctx_t * ctx,
+                   const char * header,
+                   const char * sequence,
+                   int length,
+                   struct vsearch_hit_s * hits,
+                   int maxhits)
+{
+  ctx_set_query(ctx, header, sequence, length);
+
+  struct hit * h;
+  int hit_count;
+
+  search_hits(ctx->si_plus, ctx->si_minus, & h, & hit_count);
+
+  int stored = 0;
+  for (int i = 0; i < hit_count; i++)
+    {
+      if (stored < maxhits)
+        {
+          struct vsearch_hit_s * r = hits + stored++;
+          r->target = h[i].target;
+          r->strand = h[i].strand;
+          r->id = h[i].id;
+          r->matches = h[i].matches;
+          r->mismatches = h[i].mismatches;
+          r->gaps = h[i].nwgaps;
+          r->alignment_length = h[i].nwalignmentlength;
+        }
+
+      /* free memory for alignment strings */
+      if (h[i].nwalignment)
+        {
+          xfree(h[i].nwalignment);
+        }
+    }
+
+  xfree(h);
+
+  return stored;
+}
+
+void vsearch_sintax(vsearch_ctx_t * ctx,
+                    const char * sequence,
+                    int length,
+                    struct vsearch_sintax_s * result)
+{
+  if (! opt_sintax)
+    {
+      fatal("The library was not initialised with the --sintax command");
+    }
+
+  ctx_set_query(ctx, nullptr, sequence, length);
+
+  int all_seqno[sintax_bootstrap_count];
+  int best_strand = 0;
+  int best_seqno = 0;
+  int best_count = 0;
+  int count = 0;
+
+  sintax_search(ctx->si_plus, ctx->si_minus,
+                & best_strand, & best_seqno, & best_count,
+                all_seqno, & count);
+
+  result->classified = 0;
+  result->strand = best_strand;
+  result->target = best_seqno;
+
+  int level_start[tax_levels];
+  int level_len[tax_levels];
+  int level_match[tax_levels];
+
+  if (count >= (sintax_bootstrap_count + 1) / 2)
+    {
+      result->classified = 1;
+      sintax_levels(best_seqno, all_seqno, count,
+                    level_start, level_len, level_match);
+    }
+
+  char * best_h = db_getheader(best_seqno);
+
+  for (int j = 0; j < tax_levels; j++)
+    {
+      result->rank[j] = tax_letters[j];
+      if (result->classified && (level_len[j] > 0))
+        {
+          result->name[j] = best_h + level_start[j];
+          result->name_length[j] = level_len[j];
+          result->confidence[j] = 1.0 * level_match[j] / count;
+        }
+      else
+        {
+          result->name[j] = nullptr;
+          result->name_length[j] = 0;
+          result->confidence[j] = 0.0;
+        }
+    }
+}
+
+int vsearch_mergepair(vsearch_ctx_t * ctx,
+                      const char * fwd_sequence,
+                      const char * fwd_quality,
+                      int fwd_length,
+                      const char * rev_sequence,
+                      const char * rev_quality,
+                      int rev_length,
+                      char * merged_sequence,
+                      char * merged_quality,
+                      double * expected_errors)
+{
+  if (! ctx->kmerhash)
+    {
+      ctx->kmerhash = kh_init();
+    }
+
+  return mergepairs_pair(ctx->kmerhash,
+                         fwd_sequence, fwd_quality, fwd_length,
+                         rev_sequence, rev_quality, rev_length,
+                         merged_sequence, merged_quality,
+                         expected_errors);
+}
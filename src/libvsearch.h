@@ -0,0 +1,158 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+  C interface to the vsearch library (libvsearch.a).
+
+  The library is configured once with vsearch_init, using the same
+  arguments as the command line tool. The command given there (for
+  instance --usearch_global, --sintax or --fastq_mergepairs, with a
+  dummy filename) selects which options are accepted; input and output
+  filenames are ignored. The options are global, so only one
+  configuration and one open database may be used at a time.
+
+  A database handle holds the reference sequences and their k-mer
+  index. Each thread that searches, classifies or merges must use its
+  own context. Errors are fatal, as in the command line tool, and
+  terminate the process.
+*/
+
+#ifndef LIBVSEARCH_H
+#define LIBVSEARCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VSEARCH_TAX_LEVELS 8
+
+typedef struct vsearch_db_s vsearch_db_t;
+typedef struct vsearch_ctx_s vsearch_ctx_t;
+
+struct vsearch_hit_s
+{
+  int target;                 /* database sequence number, zero-based */
+  int strand;                 /* 0 for plus, 1 for minus */
+  double id;                  /* percent identity, as defined by --iddef */
+  int matches;                /* number of matching columns */
+  int mismatches;             /* number of mismatching columns */
+  int gaps;                   /* number of gap openings */
+  int alignment_length;       /* columns in the alignment */
+};
+
+struct vsearch_sintax_s
+{
+  int classified;             /* non-zero if the query was classified */
+  int strand;                 /* 0 for plus, 1 for minus */
+  int target;                 /* database sequence of the best hit */
+  char rank[VSEARCH_TAX_LEVELS];          /* level letters (d,k,p,...) */
+  const char * name[VSEARCH_TAX_LEVELS];  /* names, not terminated */
+  int name_length[VSEARCH_TAX_LEVELS];    /* zero if level absent */
+  double confidence[VSEARCH_TAX_LEVELS];  /* bootstrap support */
+};
+
+/* configure the library with a vsearch command line */
+void vsearch_init(int argc, char ** argv);
+void vsearch_exit(void);
+
+/* load a fasta or UDB database and index it */
+vsearch_db_t * vsearch_db_open(const char * filename);
+void vsearch_db_close(vsearch_db_t * db);
+int vsearch_db_count(vsearch_db_t * db);
+const char * vsearch_db_header(vsearch_db_t * db, int target);
+
+/* per-thread context, db may be NULL when only merging pairs */
+vsearch_ctx_t * vsearch_ctx_new(vsearch_db_t * db);
+void vsearch_ctx_free(vsearch_ctx_t * ctx);
+
+/* search one query, return the number of accepted hits stored */
+int vsearch_search(vsearch_ctx_t * ctx,
+                   const char * header,
+                   const char * sequence,
+                   int length,
+                   struct vsearch_hit_s * hits,
+                   int maxhits);
+
+/* classify one query with sintax (requires --sintax in vsearch_init) */
+void vsearch_sintax(vsearch_ctx_t * ctx,
+                    const char * sequence,
+                    int length,
+                    struct vsearch_sintax_s * result);
+
+/*
+  merge one pair of reads, return the merged length or zero if not
+  merged; the output buffers need fwd_length + rev_length + 1 bytes
+*/
+int vsearch_mergepair(vsearch_ctx_t * ctx,
+                      const char * fwd_sequence,
+                      const char * fwd_quality,
+                      int fwd_length,
+                      const char * rev_sequence,
+                      const char * rev_quality,
+                      int rev_length,
+                      char * merged_sequence,
+                      char * merged_quality,
+                      double * expected_errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
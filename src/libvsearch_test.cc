@@ -0,0 +1,128 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+  Smoke test of libvsearch.a, run by "make check" when the library is
+  built: search one query against a small database and check that it
+  finds itself.
+*/
+
+#include "libvsearch.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+static const char * const db_seqs[] =
+  {
+    "ACGTTGCATGCCTAGGATCCGATCGATTACGGCTAGCTAGGCTTACGATCGATCGGATCGATCGATGCTAGC",
+    "TTGACCGATGCATGCTAGCTAGGATCGATCGGCTAGCTAGCTAGCATCGATCGTAGCTAGCTAGGATCGAT",
+    "GGCATCGATCGTACGTAGCTAGCTGACTGATCGATCGTAGCTAGCTAGCTAGTCGATCGATGCATGCATGC"
+  };
+
+int main()
+{
+  char filename[] = "libvsearch_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0)
+    {
+      perror("mkstemp");
+      return EXIT_FAILURE;
+    }
+
+  FILE * fp = fdopen(fd, "w");
+  for (int i = 0; i < 3; i++)
+    {
+      fprintf(fp, ">t%d\n%s\n", i, db_seqs[i]);
+    }
+  fclose(fp);
+
+  char arg0[] = "vsearch";
+  char arg1[] = "--usearch_global";
+  char arg2[] = "-";
+  char arg3[] = "--id";
+  char arg4[] = "0.9";
+  char arg5[] = "--strand";
+  char arg6[] = "both";
+  char * argv[] = { arg0, arg1, arg2, arg3, arg4, arg5, arg6, nullptr };
+
+  vsearch_init(7, argv);
+  vsearch_db_t * db = vsearch_db_open(filename);
+  vsearch_ctx_t * ctx = vsearch_ctx_new(db);
+
+  struct vsearch_hit_s hits[4];
+  int count = vsearch_search(ctx, "q1", db_seqs[1], strlen(db_seqs[1]),
+                             hits, 4);
+
+  int status = EXIT_SUCCESS;
+  if ((count < 1) || (hits[0].target != 1) || (hits[0].id < 100.0) ||
+      (hits[0].alignment_length != (int) strlen(db_seqs[1])))
+    {
+      fprintf(stderr, "libvsearch_test: expected an exact hit to t1\n");
+      status = EXIT_FAILURE;
+    }
+
+  vsearch_ctx_free(ctx);
+  vsearch_db_close(db);
+  vsearch_exit();
+  unlink(filename);
+
+  return status;
+}
@@ -62,7 +62,7 @@
 
 /* chunk constants */
 
-static const int chunk_size = 500; /* read pairs per chunk */
+static int chunk_size = 500; /* read pairs per chunk */
 static const int chunk_factor = 2; /* chunks per thread */
 
 /* scores in bits */
@@ -97,8 +97,22 @@ static double sum_fragment_length = 0.0;
 static pthread_t * pthread;
 static pthread_attr_t attr;
 
-static char merge_qual_same[128][128];
-static char merge_qual_diff[128][128];
+/*
+  Merged qualities, indexed by the two qualities. The third plane
+  gives the first quality, for symbols merged with an N. The SIMD
+  merge uses indices into the flattened table.
+*/
+
+static char merge_qual_table[3][128][128];
+static char (* const merge_qual_same)[128] = merge_qual_table[0];
+static char (* const merge_qual_diff)[128] = merge_qual_table[1];
+static char (* const merge_qual_copy)[128] = merge_qual_table[2];
+
+/* complements of the symbols 0x40 to 0x5f, for the SIMD merge */
+static unsigned char merge_complement[32];
+
+/* positions merged at a time with SIMD */
+static const int64_t merge_block = 64;
 static double match_score[128][128];
 static double mism_score[128][128];
 static double q2p[128];
@@ -307,6 +321,11 @@ void precompute_qual()
 {
   /* Precompute tables of scores etc */
 
+  for (int i = 0; i < 32; i++)
+    {
+      merge_complement[i] = chrmap_complement[0x40 + i];
+    }
+
   for (int x = 33; x <= 126; x++)
     {
       double px = q_to_p(x);
@@ -334,6 +353,8 @@ void precompute_qual()
           q = MAX(q, opt_fastq_qminout);
           merge_qual_diff[x][y] = opt_fastq_ascii + q;
 
+          merge_qual_copy[x][y] = x;
+
           /*
             observed match,
             p = probability that they truly are identical,
@@ -567,6 +588,47 @@ void discard(merge_data_t * ip)
     }
 }
 
+static int64_t merge_select_simd(const char * fwd_sequence,
+                                 const char * fwd_quality,
+                                 const char * rev_sequence,
+                                 const char * rev_quality,
+                                 int64_t length,
+                                 char * merged_sequence,
+                                 unsigned short * qual_index,
+                                 int64_t * errors)
+{
+  /*
+    Merge up to length positions of the overlap with SIMD code where
+    available, see cpu.cc. Returns the number of positions done.
+  */
+
+#ifdef __x86_64__
+  if (ssse3_present)
+    {
+      return merge_select_ssse3(fwd_sequence, fwd_quality,
+                                rev_sequence, rev_quality,
+                                merge_complement, length,
+                                merged_sequence, qual_index, errors);
+    }
+  return 0;
+#elif defined __aarch64__
+  return merge_select(fwd_sequence, fwd_quality,
+                      rev_sequence, rev_quality,
+                      merge_complement, length,
+                      merged_sequence, qual_index, errors);
+#else
+  (void) fwd_sequence;
+  (void) fwd_quality;
+  (void) rev_sequence;
+  (void) rev_quality;
+  (void) length;
+  (void) merged_sequence;
+  (void) qual_index;
+  (void) errors;
+  return 0;
+#endif
+}
+
 void merge(merge_data_t * ip)
 {
   /* length of 5' overhang of the forward sequence not merged
@@ -575,11 +637,25 @@ void merge(merge_data_t * ip)
   int64_t fwd_5prime_overhang = ip->fwd_trunc > ip->offset ?
     ip->fwd_trunc - ip->offset : 0;
 
-  ip->ee_merged = 0.0;
-  ip->ee_fwd = 0.0;
-  ip->ee_rev = 0.0;
-  ip->fwd_errors = 0;
-  ip->rev_errors = 0;
+  /*
+    Accumulate in locals rather than through ip, as the compiler must
+    otherwise assume that the stores of merged symbols may alias the
+    sums and reload them for every position. The summation order is
+    unchanged, so the expected errors are identical.
+  */
+
+  double ee_merged = 0.0;
+  double ee_fwd = 0.0;
+  double ee_rev = 0.0;
+  int64_t fwd_errors = 0;
+  int64_t rev_errors = 0;
+
+  const char * fwd_sequence = ip->fwd_sequence;
+  const char * fwd_quality = ip->fwd_quality;
+  const char * rev_sequence = ip->rev_sequence;
+  const char * rev_quality = ip->rev_quality;
+  char * merged_sequence = ip->merged_sequence;
+  char * merged_quality = ip->merged_quality;
 
   char sym, qual;
   char fwd_sym, fwd_qual, rev_sym, rev_qual;
@@ -594,15 +670,15 @@ void merge(merge_data_t * ip)
 
   while(fwd_pos < fwd_5prime_overhang)
     {
-      sym = ip->fwd_sequence[fwd_pos];
-      qual = ip->fwd_quality[fwd_pos];
+      sym = fwd_sequence[fwd_pos];
+      qual = fwd_quality[fwd_pos];
 
-      ip->merged_sequence[merged_pos] = sym;
-      ip->merged_quality[merged_pos] = qual;
+      merged_sequence[merged_pos] = sym;
+      merged_quality[merged_pos] = qual;
 
       ee = q2p[(unsigned)qual];
-      ip->ee_merged += ee;
-      ip->ee_fwd += ee;
+      ee_merged += ee;
+      ee_fwd += ee;
 
       fwd_pos++;
       merged_pos++;
@@ -615,12 +691,56 @@ void merge(merge_data_t * ip)
 
   rev_pos = ip->rev_trunc - 1 - rev_3prime_overhang;
 
+  /*
+    Select symbols and merged quality indices for blocks of the
+    overlap with SIMD, then look up the qualities and sum the expected
+    errors in sequence order, so the sums are identical.
+  */
+
+  const char * merged_qual_flat = & merge_qual_table[0][0][0];
+  unsigned short qual_index[merge_block];
+  int64_t errors[2] = { 0, 0 };
+  int64_t overlap = MIN(ip->fwd_trunc - fwd_pos, rev_pos + 1);
+
+  while (overlap >= 16)
+    {
+      int64_t done = merge_select_simd(fwd_sequence + fwd_pos,
+                                       fwd_quality + fwd_pos,
+                                       rev_sequence + rev_pos,
+                                       rev_quality + rev_pos,
+                                       MIN(overlap, merge_block),
+                                       merged_sequence + merged_pos,
+                                       qual_index,
+                                       errors);
+      if (done == 0)
+        {
+          break;
+        }
+
+      for (int64_t i = 0; i < done; i++)
+        {
+          qual = merged_qual_flat[qual_index[i]];
+          merged_quality[merged_pos] = qual;
+          ee_merged += q2p[(unsigned)qual];
+          ee_fwd += q2p[(unsigned)fwd_quality[fwd_pos]];
+          ee_rev += q2p[(unsigned)rev_quality[rev_pos]];
+
+          fwd_pos++;
+          rev_pos--;
+          merged_pos++;
+        }
+      overlap -= done;
+    }
+
+  fwd_errors += errors[0];
+  rev_errors += errors[1];
+
   while ((fwd_pos < ip->fwd_trunc) && (rev_pos >= 0))
     {
-      fwd_sym = ip->fwd_sequence[fwd_pos];
-      rev_sym = chrmap_complement[(int)(ip->rev_sequence[rev_pos])];
-      fwd_qual = ip->fwd_quality[fwd_pos];
-      rev_qual = ip->rev_quality[rev_pos];
+      fwd_sym = fwd_sequence[fwd_pos];
+      rev_sym = chrmap_complement[(int)(rev_sequence[rev_pos])];
+      fwd_qual = fwd_quality[fwd_pos];
+      rev_qual = rev_quality[rev_pos];
 
       merge_sym(& sym,
                 & qual,
@@ -629,20 +749,14 @@ void merge(merge_data_t * ip)
                 fwd_qual,
                 rev_qual);
 
-      if (sym != fwd_sym)
-        {
-          ip->fwd_errors++;
-        }
-      if (sym != rev_sym)
-        {
-          ip->rev_errors++;
-        }
+      fwd_errors += (sym != fwd_sym);
+      rev_errors += (sym != rev_sym);
 
-      ip->merged_sequence[merged_pos] = sym;
-      ip->merged_quality[merged_pos] = qual;
-      ip->ee_merged += q2p[(unsigned)qual];
-      ip->ee_fwd += q2p[(unsigned)fwd_qual];
-      ip->ee_rev += q2p[(unsigned)rev_qual];
+      merged_sequence[merged_pos] = sym;
+      merged_quality[merged_pos] = qual;
+      ee_merged += q2p[(unsigned)qual];
+      ee_fwd += q2p[(unsigned)fwd_qual];
+      ee_rev += q2p[(unsigned)rev_qual];
 
       fwd_pos++;
       rev_pos--;
@@ -653,16 +767,16 @@ void merge(merge_data_t * ip)
 
   while (rev_pos >= 0)
     {
-      sym = chrmap_complement[(int)(ip->rev_sequence[rev_pos])];
-      qual = ip->rev_quality[rev_pos];
+      sym = chrmap_complement[(int)(rev_sequence[rev_pos])];
+      qual = rev_quality[rev_pos];
 
-      ip->merged_sequence[merged_pos] = sym;
-      ip->merged_quality[merged_pos] = qual;
+      merged_sequence[merged_pos] = sym;
+      merged_quality[merged_pos] = qual;
       merged_pos++;
 
       ee = q2p[(unsigned)qual];
-      ip->ee_merged += ee;
-      ip->ee_rev += ee;
+      ee_merged += ee;
+      ee_rev += ee;
 
       rev_pos--;
     }
@@ -670,10 +784,16 @@ void merge(merge_data_t * ip)
   int64_t mergelen = merged_pos;
   ip->merged_length = mergelen;
 
-  ip->merged_sequence[mergelen] = 0;
-  ip->merged_quality[mergelen] = 0;
+  merged_sequence[mergelen] = 0;
+  merged_quality[mergelen] = 0;
+
+  ip->ee_merged = ee_merged;
+  ip->ee_fwd = ee_fwd;
+  ip->ee_rev = ee_rev;
+  ip->fwd_errors = fwd_errors;
+  ip->rev_errors = rev_errors;
 
-  if (ip->ee_merged <= opt_fastq_maxee)
+  if (ee_merged <= opt_fastq_maxee)
     {
       ip->reason = ok;
       ip->merged = true;
@@ -1152,6 +1272,7 @@ inline void chunk_perform_write()
         {
           keep_or_discard(chunks[chunk_write_next].merge_data + i);
         }
+      stream_flush_due();
       xpthread_mutex_lock(&mutex_chunks);
       pairs_written += chunks[chunk_write_next].size;
       chunks[chunk_write_next].state = empty;
@@ -1575,7 +1696,7 @@ void print_stats(FILE * fp)
     }
 }
 
-void fastq_mergepairs()
+void mergepairs_prep()
 {
   /* fatal error if specified overlap is too small */
 
@@ -1592,6 +1713,86 @@ void fastq_mergepairs()
       merge_minscore = 1.6 * opt_fastq_minovlen;
     }
 
+  /* precompute merged quality values */
+
+  precompute_qual();
+}
+
+int64_t mergepairs_pair(struct kh_handle_s * kmerhash,
+                        const char * fwd_sequence,
+                        const char * fwd_quality,
+                        int64_t fwd_length,
+                        const char * rev_sequence,
+                        const char * rev_quality,
+                        int64_t rev_length,
+                        char * merged_sequence,
+                        char * merged_quality,
+                        double * ee_merged)
+{
+  /*
+    Merge a single pair of reads held in memory. The merged sequence
+    and quality buffers must have room for fwd_length + rev_length + 1
+    characters. Returns the length of the merged sequence, or zero if
+    the reads could not be merged.
+  */
+
+  merge_data_t md;
+  init_merge_data(& md);
+
+  int64_t seq_needed = MAX(fwd_length, rev_length) + 1;
+  md.seq_alloc = seq_needed;
+  md.fwd_sequence = (char*) xmalloc(seq_needed);
+  md.rev_sequence = (char*) xmalloc(seq_needed);
+  md.fwd_quality  = (char*) xmalloc(seq_needed);
+  md.rev_quality  = (char*) xmalloc(seq_needed);
+
+  md.merged_seq_alloc = fwd_length + rev_length + 1;
+  md.merged_sequence = (char*) xmalloc(md.merged_seq_alloc);
+  md.merged_quality = (char*) xmalloc(md.merged_seq_alloc);
+
+  for (int64_t i = 0; i < fwd_length; i++)
+    {
+      md.fwd_sequence[i] = chrmap_upcase[(unsigned char) fwd_sequence[i]];
+      md.fwd_quality[i] = fwd_quality[i];
+    }
+  md.fwd_sequence[fwd_length] = 0;
+  md.fwd_quality[fwd_length] = 0;
+
+  for (int64_t i = 0; i < rev_length; i++)
+    {
+      md.rev_sequence[i] = chrmap_upcase[(unsigned char) rev_sequence[i]];
+      md.rev_quality[i] = rev_quality[i];
+    }
+  md.rev_sequence[rev_length] = 0;
+  md.rev_quality[rev_length] = 0;
+
+  md.fwd_length = fwd_length;
+  md.rev_length = rev_length;
+  md.merged_sequence[0] = 0;
+  md.merged_quality[0] = 0;
+  md.merged = false;
+
+  process(& md, kmerhash);
+
+  int64_t length = 0;
+
+  if (md.merged)
+    {
+      length = md.merged_length;
+      memcpy(merged_sequence, md.merged_sequence, length + 1);
+      memcpy(merged_quality, md.merged_quality, length + 1);
+      * ee_merged = md.ee_merged;
+    }
+
+  free_merge_data(& md);
+
+  return length;
+}
+
+void fastq_mergepairs()
+{
+  mergepairs_prep();
+
   /* open input files */
 
   fastq_fwd = fastq_open(opt_fastq_mergepairs);
@@ -1628,9 +1829,20 @@ void fastq_mergepairs()
       fp_eetabbedout = fileopenw(opt_eetabbedout);
     }
 
-  /* precompute merged quality values */
+  stream_add(fp_fastqout);
+  stream_add(fp_fastaout);
+  stream_add(fp_fastqout_notmerged_fwd);
+  stream_add(fp_fastqout_notmerged_rev);
+  stream_add(fp_fastaout_notmerged_fwd);
+  stream_add(fp_fastaout_notmerged_rev);
+  stream_add(fp_eetabbedout);
 
-  precompute_qual();
+  /* with --stream, hand each pair to the workers as soon as it is read */
+
+  if (opt_stream)
+    {
+      chunk_size = 1;
+    }
 
   /* main */
 
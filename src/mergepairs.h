@@ -58,4 +58,16 @@
 
 */
 
+void mergepairs_prep();
+int64_t mergepairs_pair(struct kh_handle_s * kmerhash,
+                        const char * fwd_sequence,
+                        const char * fwd_quality,
+                        int64_t fwd_length,
+                        const char * rev_sequence,
+                        const char * rev_quality,
+                        int64_t rev_length,
+                        char * merged_sequence,
+                        char * merged_quality,
+                        double * ee_merged);
+
 void fastq_mergepairs();
@@ -0,0 +1,464 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+
+/*
+  MinHash sketches and locality sensitive hashing (LSH), used to find
+  candidate pairs of similar sequences without considering all pairs.
+
+  Each sequence is summarized by a sketch of a fixed number of 16-bit
+  values, computed from the same unique words that are used by the
+  k-mer index (unique_count). A single hash function is applied to
+  each word. The upper half of the hash selects one of the bins of
+  the sketch and the lowest value of the lower half seen in each bin
+  is kept (one permutation MinHash). Empty bins are filled with the
+  value of another bin chosen by a fixed pseudo-random sequence that
+  only depends on the bin number (densification), so that sketches of
+  different sequences remain comparable position by position. Only
+  the low 16 bits of each minimum are stored (b-bit MinHash), which
+  halves the memory needed and allows eight positions to be compared
+  at a time. The fraction of equal positions in two sketches estimates
+  the Jaccard similarity of their word sets.
+
+  For LSH the sketch is divided into bands of a few consecutive
+  positions (rows). For each band, the sequences are sorted on a hash
+  of their values in that band. Two sequences are candidates if all
+  the values of at least one band are identical, and if the number of
+  equal positions in their sketches is not much lower than expected
+  for a pair with the identity given by --id. Unless specified with
+  --lsh_rows, the number of rows per band is chosen so that a pair
+  with that identity is very likely to share at least one band.
+
+  Sequences without any words (e.g. shorter than the word length or
+  completely masked) have no usable sketch and are considered as
+  candidates for all other sequences.
+*/
+
+struct minhash_entry_s
+{
+  unsigned int key;
+  unsigned int seqno;
+};
+
+static unsigned int minhash_seqcount = 0;
+static unsigned int minhash_size = 0;
+static unsigned int minhash_rows = 0;
+static unsigned int minhash_bands = 0;
+static double minhash_wordfraction = 0.0;
+
+static unsigned short * minhash_sketches = nullptr;
+static unsigned int * minhash_wordcount = nullptr;
+
+static struct minhash_entry_s * minhash_table = nullptr;
+static unsigned int minhash_tablecount = 0;
+
+static unsigned int * minhash_empty = nullptr;
+static unsigned int minhash_emptycount = 0;
+
+inline uint64_t minhash_mix(uint64_t x)
+{
+  /* 64-bit finalizer from MurmurHash3 */
+  x ^= x >> 33U;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33U;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33U;
+  return x;
+}
+
+inline unsigned short * minhash_sketch(unsigned int seqno)
+{
+  return minhash_sketches + (uint64_t) seqno * minhash_size;
+}
+
+inline unsigned int minhash_bandkey(unsigned int seqno, unsigned int band)
+{
+  unsigned short * values = minhash_sketch(seqno) + band * minhash_rows;
+  uint64_t key = band;
+  for(unsigned int r = 0; r < minhash_rows; r++)
+    {
+      key = minhash_mix(key ^ ((uint64_t) values[r] << 32U));
+    }
+  return (unsigned int) (key >> 32U);
+}
+
+static void minhash_compute(struct uhandle_s * uh,
+                            uint64_t * mins,
+                            unsigned int seqno)
+{
+  unsigned int wordcount = 0;
+  unsigned int * words = nullptr;
+
+  unique_count(uh, opt_wordlength,
+               db_getsequencelen(seqno), db_getsequence(seqno),
+               & wordcount, & words, opt_qmask);
+
+  minhash_wordcount[seqno] = wordcount;
+
+  for(unsigned int i = 0; i < minhash_size; i++)
+    {
+      mins[i] = UINT64_MAX;
+    }
+
+  for(unsigned int i = 0; i < wordcount; i++)
+    {
+      uint64_t hash = minhash_mix(words[i]);
+      uint64_t bin = ((hash >> 32U) * minhash_size) >> 32U;
+      uint64_t value = hash & 0xffffffffULL;
+      if (value < mins[bin])
+        {
+          mins[bin] = value;
+        }
+    }
+
+  unsigned short * sketch = minhash_sketch(seqno);
+
+  for(unsigned int i = 0; i < minhash_size; i++)
+    {
+      uint64_t value = mins[i];
+
+      /* densify: borrow from the first non-empty bin in a fixed
+         pseudo-random order depending only on the bin number */
+      uint64_t attempt = 0;
+      while ((value == UINT64_MAX) && wordcount)
+        {
+          attempt++;
+          uint64_t hash = minhash_mix(((uint64_t) i << 32U) | attempt);
+          uint64_t bin = ((hash >> 32U) * minhash_size) >> 32U;
+          value = mins[bin];
+        }
+
+      sketch[i] = (unsigned short) value;
+    }
+}
+
+static int minhash_compare_entries(const void * a, const void * b)
+{
+  auto * x = (const struct minhash_entry_s *) a;
+  auto * y = (const struct minhash_entry_s *) b;
+
+  if (x->key < y->key)
+    {
+      return -1;
+    }
+  else if (x->key > y->key)
+    {
+      return +1;
+    }
+  else if (x->seqno < y->seqno)
+    {
+      return -1;
+    }
+  else if (x->seqno > y->seqno)
+    {
+      return +1;
+    }
+  else
+    {
+      return 0;
+    }
+}
+
+static unsigned int minhash_autorows()
+{
+  /* expected Jaccard similarity of the word sets of two sequences
+     of equal length at the identity given by --id */
+  double jaccard = minhash_wordfraction / (2.0 - minhash_wordfraction);
+
+  for(unsigned int rows = MIN(minhash_size, 8); rows > 1; rows--)
+    {
+      unsigned int bands = minhash_size / rows;
+      double miss = pow(1.0 - pow(jaccard, rows), bands);
+      if (miss <= 0.01)
+        {
+          return rows;
+        }
+    }
+  return 1;
+}
+
+void minhash_init(unsigned int seqcount)
+{
+  minhash_seqcount = seqcount;
+  minhash_size = opt_sketch_size;
+  minhash_wordfraction = pow(MAX(opt_id, 0.0), opt_wordlength);
+  minhash_rows = opt_lsh_rows ? opt_lsh_rows : minhash_autorows();
+  minhash_bands = minhash_size / minhash_rows;
+
+  minhash_sketches = (unsigned short *)
+    xmalloc((uint64_t) seqcount * minhash_size * sizeof(unsigned short));
+  minhash_wordcount = (unsigned int *)
+    xmalloc(MAX(seqcount, 1) * sizeof(unsigned int));
+
+  /* compute sketches */
+
+  struct uhandle_s * uh = unique_init();
+  auto * mins = (uint64_t *) xmalloc(minhash_size * sizeof(uint64_t));
+
+  progress_init("Sketching", seqcount);
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      minhash_compute(uh, mins, i);
+      progress_update(i);
+    }
+  progress_done();
+
+  xfree(mins);
+  unique_exit(uh);
+
+  minhash_emptycount = 0;
+  for(unsigned int i = 0; i < seqcount; i++)
+    {
+      if (minhash_wordcount[i] == 0)
+        {
+          minhash_emptycount++;
+        }
+    }
+
+  minhash_empty = (unsigned int *)
+    xmalloc(MAX(minhash_emptycount, 1) * sizeof(unsigned int));
+  minhash_tablecount = seqcount - minhash_emptycount;
+  minhash_table = (struct minhash_entry_s *)
+    xmalloc(MAX((uint64_t) minhash_tablecount * minhash_bands, 1)
+            * sizeof(struct minhash_entry_s));
+
+  /* sort the sequences on the hash of each band */
+
+  progress_init("Hashing bands", minhash_bands);
+  for(unsigned int band = 0; band < minhash_bands; band++)
+    {
+      struct minhash_entry_s * table
+        = minhash_table + (uint64_t) band * minhash_tablecount;
+      unsigned int n = 0;
+      unsigned int e = 0;
+      for(unsigned int i = 0; i < seqcount; i++)
+        {
+          if (minhash_wordcount[i])
+            {
+              table[n].key = minhash_bandkey(i, band);
+              table[n].seqno = i;
+              n++;
+            }
+          else if (band == 0)
+            {
+              minhash_empty[e++] = i;
+            }
+        }
+      qsort(table, n, sizeof(struct minhash_entry_s),
+            minhash_compare_entries);
+      progress_update(band);
+    }
+  progress_done();
+}
+
+void minhash_exit()
+{
+  xfree(minhash_table);
+  xfree(minhash_empty);
+  xfree(minhash_wordcount);
+  xfree(minhash_sketches);
+  minhash_table = nullptr;
+  minhash_empty = nullptr;
+  minhash_wordcount = nullptr;
+  minhash_sketches = nullptr;
+}
+
+unsigned int minhash_getrows()
+{
+  return minhash_rows;
+}
+
+unsigned int minhash_getbands()
+{
+  return minhash_bands;
+}
+
+unsigned int minhash_compare(unsigned int a, unsigned int b)
+{
+  /* number of equal positions in the sketches of a and b */
+
+  const unsigned short * x = minhash_sketch(a);
+  const unsigned short * y = minhash_sketch(b);
+
+  unsigned int equal = 0;
+  unsigned int i = 0;
+
+#ifdef __x86_64__
+  unsigned int bits = 0;
+  for(; i + 8 <= minhash_size; i += 8)
+    {
+      __m128i u = _mm_loadu_si128((const __m128i *) (x + i));
+      __m128i v = _mm_loadu_si128((const __m128i *) (y + i));
+      bits += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(u, v)));
+    }
+  equal = bits / 2;
+#elif __aarch64__
+  for(; i + 8 <= minhash_size; i += 8)
+    {
+      uint16x8_t c = vceqq_u16(vld1q_u16(x + i), vld1q_u16(y + i));
+      equal += vaddvq_u16(vshrq_n_u16(c, 15));
+    }
+#endif
+
+  for(; i < minhash_size; i++)
+    {
+      if (x[i] == y[i])
+        {
+          equal++;
+        }
+    }
+
+  return equal;
+}
+
+static bool minhash_similar(unsigned int a, unsigned int b)
+{
+  /*
+    Compare the sketches and reject the pair if the number of equal
+    positions is more than three standard deviations below the
+    number expected at the identity given by --id. The shared words
+    are estimated as the fraction (id^k) of the words of the
+    shortest sequence that survive the differences.
+  */
+
+  double na = minhash_wordcount[a];
+  double nb = minhash_wordcount[b];
+  double shared = minhash_wordfraction * MIN(na, nb);
+  double jaccard = shared / (na + nb - shared);
+  double expected = minhash_size * jaccard;
+  double deviation = sqrt(minhash_size * jaccard * (1.0 - jaccard));
+
+  return minhash_compare(a, b) >= expected - 3.0 * deviation;
+}
+
+unsigned int minhash_candidates(unsigned int query,
+                                unsigned int * seen,
+                                unsigned int * list)
+{
+  /*
+    Find the candidates among the sequences numbered after the query.
+    The seen array is private to the calling thread, it must hold one
+    element per sequence, initialized to a value that is not a valid
+    sequence number, and is used to report each candidate once.
+  */
+
+  unsigned int count = 0;
+
+  if (minhash_wordcount[query] == 0)
+    {
+      for(unsigned int t = query + 1; t < minhash_seqcount; t++)
+        {
+          list[count++] = t;
+        }
+      return count;
+    }
+
+  for(unsigned int band = 0; band < minhash_bands; band++)
+    {
+      struct minhash_entry_s * table
+        = minhash_table + (uint64_t) band * minhash_tablecount;
+      struct minhash_entry_s first;
+      first.key = minhash_bandkey(query, band);
+      first.seqno = query + 1;
+
+      /* binary search for the first entry with the same key and a
+         higher sequence number */
+      unsigned int lo = 0;
+      unsigned int hi = minhash_tablecount;
+      while (lo < hi)
+        {
+          unsigned int mid = lo + (hi - lo) / 2;
+          if (minhash_compare_entries(table + mid, & first) < 0)
+            {
+              lo = mid + 1;
+            }
+          else
+            {
+              hi = mid;
+            }
+        }
+
+      for(unsigned int j = lo;
+          (j < minhash_tablecount) && (table[j].key == first.key);
+          j++)
+        {
+          unsigned int t = table[j].seqno;
+          if (seen[t] != query)
+            {
+              seen[t] = query;
+              if (minhash_similar(query, t))
+                {
+                  list[count++] = t;
+                }
+            }
+        }
+    }
+
+  for(unsigned int e = 0; e < minhash_emptycount; e++)
+    {
+      if (minhash_empty[e] > query)
+        {
+          list[count++] = minhash_empty[e];
+        }
+    }
+
+  return count;
+}
@@ -153,6 +153,11 @@ void orient()
         }
     }
 
+  stream_add(fp_fastaout);
+  stream_add(fp_fastqout);
+  stream_add(fp_notmatched);
+  stream_add(fp_tabbedout);
+
   /* check if it may be an UDB file */
 
   bool is_udb = udb_detect_isudb(opt_db);
@@ -160,6 +165,13 @@ void orient()
   if (is_udb)
     {
       udb_read(opt_db, true, true);
+
+      /* reverse complemented words are only valid for contiguous words */
+      unsigned int pattern_bits = 0;
+      if (unique_get_pattern(& pattern_bits))
+        {
+          fatal("UDB files with spaced words cannot be used with --orient");
+        }
     }
   else
     {
@@ -222,8 +234,10 @@ void orient()
           unsigned int kmer_fwd = kmer_list_fwd[i];
           unsigned int kmer_rev = rc_kmer(kmer_fwd);
 
-          unsigned int hits_fwd = dbindex_getmatchcount(kmer_fwd);
-          unsigned int hits_rev = dbindex_getmatchcount(kmer_rev);
+          unsigned int hits_fwd =
+            dbindex_getmatchcount(dbindex_getslot(kmer_fwd));
+          unsigned int hits_rev =
+            dbindex_getmatchcount(dbindex_getslot(kmer_rev));
 
           /* require 8 times as many matches on one stand than the other */
 
@@ -402,6 +416,8 @@ void orient()
                   count_rev);
         }
 
+      stream_flush_due();
+
       /* show progress */
 
       progress_update(progress);
@@ -59,6 +59,7 @@
 */
 
 #include "vsearch.h"
+#include <cerrno>
 
 static struct searchinfo_s * si_plus;
 static struct searchinfo_s * si_minus;
@@ -73,6 +74,8 @@ static fastx_handle query_fasta_h;
 /* global data protected by mutex */
 static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
+static pthread_cond_t cond_output;
+static int queries_started;
 static int qmatches;
 static uint64 qmatches_abundance;
 static int queries;
@@ -94,11 +97,54 @@ static FILE * fp_biomout = nullptr;
 static FILE * fp_lcaout = nullptr;
 static FILE * fp_qsegout = nullptr;
 static FILE * fp_tsegout = nullptr;
+static FILE * fp_shardout = nullptr;
 
 static int count_matched = 0;
 static int count_notmatched = 0;
 
-void search_output_results(int hit_count,
+/*
+  Locality-aware scheduling of queries (--reorder_window).
+
+  The queries are read in windows of the given size. Each query gets
+  a signature, the word with the lowest hash value among its words
+  that occur in the database. Similar queries tend to share that word
+  and hit the same targets and index lists, so the queries of a
+  window are searched in the order of their signatures, and the
+  threads work on similar queries at about the same time while the
+  target sequences and match lists are still cached. The threads
+  compute the signatures of a window before they search it. The
+  results are kept until the whole window has been searched and are
+  then written in input order.
+*/
+
+struct search_batch_query_s
+{
+  char * query_head;
+  int query_head_len;
+  int query_head_alloc;
+  char * qsequence;
+  char * qsequence_rc;
+  int qseqlen;
+  int seq_alloc;
+  int query_no;
+  int qsize;
+  uint64_t progress;
+  uint64_t signature;
+  struct hit * hits;
+  int hit_count;
+};
+
+static struct search_batch_query_s * batch = nullptr;
+static int * batch_order = nullptr;
+static int batch_count = 0; /* queries in the current window */
+static int batch_sign_next = 0; /* next query to get a signature */
+static int batch_signed = 0; /* queries with a signature */
+static int batch_next = 0;  /* next query to be started */
+static int batch_done = 0;  /* queries completed */
+static pthread_cond_t cond_batch;
+
+void search_output_results(int query_no,
+                           int hit_count,
                            struct hit * hits,
                            char * query_head,
                            int qseqlen,
@@ -301,6 +347,16 @@ void search_output_results(int hit_count,
         }
     }
 
+  if (fp_shardout)
+    {
+      shard_write_query(fp_shardout,
+                        query_no,
+                        query_head,
+                        qseqlen,
+                        hits,
+                        hit_count);
+    }
+
   /* update matching db sequences */
   for (int i=0; i < hit_count; i++)
     {
@@ -310,14 +366,30 @@ void search_output_results(int hit_count,
         }
     }
 
+  stream_flush_due();
+
   xpthread_mutex_unlock(&mutex_output);
 }
 
-int search_query(int64_t t)
+void search_hits(struct searchinfo_s * si_p,
+                 struct searchinfo_s * si_m,
+                 struct hit * * hits,
+                 int * hit_count)
 {
+  /* search one query on one or both strands and join the hits */
+
+  /*
+    Both strands share the aligner. The profile of the reverse
+    complement is prepared together with that of the query, unless
+    dust with hard masking may mask the strands differently.
+  */
+
+  const bool both = (opt_strand > 1) &&
+    ! ((opt_qmask == MASK_DUST) && opt_hardmask);
+
   for (int s = 0; s < opt_strand; s++)
     {
-      struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+      struct searchinfo_s * si = s ? si_m : si_p;
 
       /* mask query */
       if (opt_qmask == MASK_DUST)
@@ -329,19 +401,49 @@ int search_query(int64_t t)
           hardmask(si->qsequence, si->qseqlen);
         }
 
+      /* prepare query profile */
+      if (s == 0)
+        {
+          if (both)
+            {
+              search16_qprep_strands(si->s, si->qsequence, si->qseqlen);
+            }
+          else
+            {
+              search16_qprep(si->s, si->qsequence, si->qseqlen);
+            }
+        }
+      else if (both)
+        {
+          search16_qselect(si->s, 1, 0, si->qseqlen);
+        }
+      else
+        {
+          search16_qprep(si->s, si->qsequence, si->qseqlen);
+        }
+
       /* perform search */
       search_onequery(si, opt_qmask);
     }
 
+  search_joinhits(si_p,
+                  opt_strand > 1 ? si_m : nullptr,
+                  hits,
+                  hit_count);
+}
+
+int search_query(int64_t t)
+{
   struct hit * hits;
   int hit_count;
 
-  search_joinhits(si_plus + t,
-                  opt_strand > 1 ? si_minus + t : nullptr,
-                  & hits,
-                  & hit_count);
+  search_hits(si_plus + t,
+              opt_strand > 1 ? si_minus + t : nullptr,
+              & hits,
+              & hit_count);
 
-  search_output_results(hit_count,
+  search_output_results(si_plus[t].query_no,
+                        hit_count,
                         hits,
                         si_plus[t].query_head,
                         si_plus[t].qseqlen,
@@ -352,7 +454,7 @@ int search_query(int64_t t)
   /* free memory for alignment strings */
   for(int i=0; i<hit_count; i++)
     {
-      if (hits[i].aligned)
+      if (hits[i].nwalignment)
         {
           xfree(hits[i].nwalignment);
         }
@@ -363,16 +465,398 @@ int search_query(int64_t t)
   return hit_count;
 }
 
+void search_checkpoint_save()
+{
+  /* called with the input mutex held, so that no new queries are
+     started; wait for the queries in progress to be completed */
+
+  xpthread_mutex_lock(&mutex_output);
+
+  while (queries < queries_started)
+    {
+      xpthread_cond_wait(&cond_output, &mutex_output);
+    }
+
+  uint64_t query_size = fasta_get_size(query_fasta_h);
+  uint64_t db_seqcount = seqcount;
+  uint64_t query_count = fasta_get_seqno(query_fasta_h) + 1;
+  uint64_t query_offset = fastx_get_next_offset(query_fasta_h);
+
+  checkpoint_begin();
+  checkpoint_put(& query_size, sizeof(query_size));
+  checkpoint_put(& db_seqcount, sizeof(db_seqcount));
+  checkpoint_put(& query_count, sizeof(query_count));
+  checkpoint_put(& query_offset, sizeof(query_offset));
+  checkpoint_put(& queries, sizeof(queries));
+  checkpoint_put(& queries_abundance, sizeof(queries_abundance));
+  checkpoint_put(& qmatches, sizeof(qmatches));
+  checkpoint_put(& qmatches_abundance, sizeof(qmatches_abundance));
+  checkpoint_put(& count_matched, sizeof(count_matched));
+  checkpoint_put(& count_notmatched, sizeof(count_notmatched));
+  checkpoint_put(dbmatched, seqcount * sizeof(uint64));
+  checkpoint_commit();
+
+  xpthread_mutex_unlock(&mutex_output);
+}
+
+void search_checkpoint_restore()
+{
+  uint64_t query_size = 0;
+  uint64_t db_seqcount = 0;
+  uint64_t query_count = 0;
+  uint64_t query_offset = 0;
+
+  checkpoint_get(& query_size, sizeof(query_size));
+  checkpoint_get(& db_seqcount, sizeof(db_seqcount));
+
+  if ((query_size != fasta_get_size(query_fasta_h)) ||
+      (db_seqcount != (uint64_t) seqcount))
+    {
+      fatal("The query or database file does not match the checkpoint");
+    }
+
+  checkpoint_get(& query_count, sizeof(query_count));
+  checkpoint_get(& query_offset, sizeof(query_offset));
+  checkpoint_get(& queries, sizeof(queries));
+  checkpoint_get(& queries_abundance, sizeof(queries_abundance));
+  checkpoint_get(& qmatches, sizeof(qmatches));
+  checkpoint_get(& qmatches_abundance, sizeof(qmatches_abundance));
+  checkpoint_get(& count_matched, sizeof(count_matched));
+  checkpoint_get(& count_notmatched, sizeof(count_notmatched));
+  checkpoint_get(dbmatched, seqcount * sizeof(uint64));
+
+  fastx_skip(query_fasta_h, query_offset, query_count);
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Resuming after %d queries\n", queries);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Resuming after %d queries\n", queries);
+    }
+}
+
+uint64_t search_batch_signature(struct uhandle_s * uh,
+                                struct search_batch_query_s * q)
+{
+  /* the lowest word hash among the query words found in the database */
+
+  unsigned int kmer_count;
+  unsigned int * kmer_list;
+
+  unique_count(uh, opt_wordlength,
+               q->qseqlen, q->qsequence,
+               & kmer_count, & kmer_list, opt_qmask);
+
+  uint64_t signature = UINT64_MAX;
+
+  for (unsigned int i = 0; i < kmer_count; i++)
+    {
+      unsigned int kmer = kmer_list[i];
+      if (dbindex_getmatchcount(dbindex_getslot(kmer)) > 0)
+        {
+          uint64_t h = CityHash64((const char *) & kmer, sizeof(kmer));
+          if (h < signature)
+            {
+              signature = h;
+            }
+        }
+    }
+
+  return signature;
+}
+
+int search_batch_compare(const void * a, const void * b)
+{
+  int x = * (const int *) a;
+  int y = * (const int *) b;
+
+  if (batch[x].signature < batch[y].signature)
+    {
+      return -1;
+    }
+  else if (batch[x].signature > batch[y].signature)
+    {
+      return +1;
+    }
+  else
+    {
+      return x - y;
+    }
+}
+
+void search_batch_read()
+{
+  /* read the next window of queries, called with the input mutex held */
+
+  if (checkpoint_due())
+    {
+      search_checkpoint_save();
+    }
+
+  batch_count = 0;
+  batch_sign_next = 0;
+  batch_signed = 0;
+  batch_next = 0;
+  batch_done = 0;
+
+  while ((batch_count < opt_reorder_window) &&
+         fasta_next(query_fasta_h,
+                    ! opt_notrunclabels,
+                    chrmap_no_change))
+    {
+      struct search_batch_query_s * q = batch + batch_count;
+
+      q->query_head_len = fasta_get_header_length(query_fasta_h);
+      q->qseqlen = fasta_get_sequence_length(query_fasta_h);
+      q->query_no = fasta_get_seqno(query_fasta_h);
+      q->qsize = fasta_get_abundance(query_fasta_h);
+      q->progress = fasta_get_position(query_fasta_h);
+
+      if (q->query_head_len + 1 > q->query_head_alloc)
+        {
+          q->query_head_alloc = q->query_head_len + 2001;
+          q->query_head = (char *)
+            xrealloc(q->query_head, (size_t)(q->query_head_alloc));
+        }
+
+      if (q->qseqlen + 1 > q->seq_alloc)
+        {
+          q->seq_alloc = q->qseqlen + 2001;
+          q->qsequence = (char *)
+            xrealloc(q->qsequence, (size_t)(q->seq_alloc));
+          if (opt_strand > 1)
+            {
+              q->qsequence_rc = (char *)
+                xrealloc(q->qsequence_rc, (size_t)(q->seq_alloc));
+            }
+        }
+
+      strcpy(q->query_head, fasta_get_header(query_fasta_h));
+      strcpy(q->qsequence, fasta_get_sequence(query_fasta_h));
+
+      q->hits = nullptr;
+      q->hit_count = 0;
+
+      batch_order[batch_count] = batch_count;
+      batch_count++;
+    }
+
+  queries_started += batch_count;
+}
+
+void search_batch_output()
+{
+  /* write the results of the window in input order */
+
+  for (int i = 0; i < batch_count; i++)
+    {
+      struct search_batch_query_s * q = batch + i;
+
+      search_output_results(q->query_no,
+                            q->hit_count,
+                            q->hits,
+                            q->query_head,
+                            q->qseqlen,
+                            q->qsequence,
+                            opt_strand > 1 ? q->qsequence_rc : nullptr,
+                            q->qsize);
+
+      for(int j = 0; j < q->hit_count; j++)
+        {
+          if (q->hits[j].nwalignment)
+            {
+              xfree(q->hits[j].nwalignment);
+            }
+        }
+
+      xfree(q->hits);
+      q->hits = nullptr;
+
+      xpthread_mutex_lock(&mutex_output);
+
+      queries++;
+      queries_abundance += q->qsize;
+
+      if (q->hit_count)
+        {
+          qmatches++;
+          qmatches_abundance += q->qsize;
+        }
+
+      progress_update(q->progress);
+
+      xpthread_mutex_unlock(&mutex_output);
+    }
+}
+
+void search_batch_init()
+{
+  batch = (struct search_batch_query_s *)
+    xmalloc(opt_reorder_window * sizeof(struct search_batch_query_s));
+  memset(batch, 0, opt_reorder_window * sizeof(struct search_batch_query_s));
+  batch_order = (int *) xmalloc(opt_reorder_window * sizeof(int));
+  batch_count = 0;
+  xpthread_cond_init(&cond_batch, nullptr);
+}
+
+void search_batch_exit()
+{
+  xpthread_cond_destroy(&cond_batch);
+  for (int i = 0; i < opt_reorder_window; i++)
+    {
+      if (batch[i].query_head)
+        {
+          xfree(batch[i].query_head);
+        }
+      if (batch[i].qsequence)
+        {
+          xfree(batch[i].qsequence);
+        }
+      if (batch[i].qsequence_rc)
+        {
+          xfree(batch[i].qsequence_rc);
+        }
+    }
+  xfree(batch_order);
+  xfree(batch);
+  batch_order = nullptr;
+  batch = nullptr;
+}
+
+void search_thread_run_batched(int64_t t)
+{
+  /*
+    Compute the signatures of the current window, then search its
+    queries in signature order. The thread computing the last
+    signature sorts the window. The thread completing the last query
+    writes the results and reads the next window, while the others
+    wait for it.
+  */
+
+  xpthread_mutex_lock(&mutex_input);
+
+  while (batch_count > 0)
+    {
+      if (batch_sign_next < batch_count)
+        {
+          struct search_batch_query_s * q = batch + batch_sign_next++;
+
+          xpthread_mutex_unlock(&mutex_input);
+
+          q->signature = search_batch_signature(si_plus[t].uh, q);
+
+          xpthread_mutex_lock(&mutex_input);
+
+          batch_signed++;
+
+          if (batch_signed == batch_count)
+            {
+              qsort(batch_order, batch_count, sizeof(int),
+                    search_batch_compare);
+              xpthread_cond_broadcast(&cond_batch);
+            }
+          continue;
+        }
+
+      if ((batch_signed < batch_count) || (batch_next == batch_count))
+        {
+          xpthread_cond_wait(&cond_batch, &mutex_input);
+          continue;
+        }
+
+      struct search_batch_query_s * q = batch + batch_order[batch_next++];
+
+      xpthread_mutex_unlock(&mutex_input);
+
+      for (int s = 0; s < opt_strand; s++)
+        {
+          struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+
+          si->query_head_len = q->query_head_len;
+          si->qseqlen = q->qseqlen;
+          si->query_no = q->query_no;
+          si->qsize = q->qsize;
+          si->strand = s;
+
+          if (si->query_head_len + 1 > si->query_head_alloc)
+            {
+              si->query_head_alloc = si->query_head_len + 2001;
+              si->query_head = (char*)
+                xrealloc(si->query_head, (size_t)(si->query_head_alloc));
+            }
+
+          if (si->qseqlen + 1 > si->seq_alloc)
+            {
+              si->seq_alloc = si->qseqlen + 2001;
+              si->qsequence = (char*)
+                xrealloc(si->qsequence, (size_t)(si->seq_alloc));
+            }
+
+          strcpy(si->query_head, q->query_head);
+        }
+
+      strcpy(si_plus[t].qsequence, q->qsequence);
+
+      if (opt_strand > 1)
+        {
+          reverse_complement(si_minus[t].qsequence,
+                             si_plus[t].qsequence,
+                             si_plus[t].qseqlen);
+        }
+
+      search_hits(si_plus + t,
+                  opt_strand > 1 ? si_minus + t : nullptr,
+                  & q->hits,
+                  & q->hit_count);
+
+      /* keep the query as masked by the search for the output */
+      strcpy(q->qsequence, si_plus[t].qsequence);
+      if (opt_strand > 1)
+        {
+          strcpy(q->qsequence_rc, si_minus[t].qsequence);
+        }
+
+      xpthread_mutex_lock(&mutex_input);
+
+      batch_done++;
+
+      if (batch_done == batch_count)
+        {
+          search_batch_output();
+          search_batch_read();
+          xpthread_cond_broadcast(&cond_batch);
+        }
+    }
+
+  xpthread_mutex_unlock(&mutex_input);
+}
+
 void search_thread_run(int64_t t)
 {
+  if (opt_reorder_window)
+    {
+      search_thread_run_batched(t);
+      return;
+    }
+
   while (true)
     {
       xpthread_mutex_lock(&mutex_input);
 
+      if (checkpoint_due())
+        {
+          search_checkpoint_save();
+        }
+
       if (fasta_next(query_fasta_h,
                      ! opt_notrunclabels,
                      chrmap_no_change))
         {
+          queries_started++;
+
           char * qhead = fasta_get_header(query_fasta_h);
           int query_head_len = fasta_get_header_length(query_fasta_h);
           char * qseq = fasta_get_sequence(query_fasta_h);
@@ -444,6 +928,11 @@ void search_thread_run(int64_t t)
           /* show progress */
           progress_update(progress);
 
+          if (opt_checkpoint)
+            {
+              xpthread_cond_signal(&cond_output);
+            }
+
           xpthread_mutex_unlock(&mutex_output);
         }
       else
@@ -467,31 +956,42 @@ void search_thread_init(struct searchinfo_s * si)
   si->query_head = nullptr;
   si->seq_alloc = 0;
   si->qsequence = nullptr;
+  si->kh = opt_diag_prefilter ? kh_init() : nullptr;
+  /* only these outputs show the alignments themselves */
+  si->counts_only = ! (opt_alnout || opt_blast6out || opt_fastapairs ||
+                       opt_qsegout || opt_samout || opt_shardout ||
+                       opt_tsegout || opt_uc || opt_userout);
+  si->diag_alloc = 0;
+  si->diags = nullptr;
+  si->cover = nullptr;
 #ifdef COMPARENONVECTORIZED
   si->nw = nw_init();
 #else
   si->nw = nullptr;
 #endif
-  si->s = search16_init(opt_match,
-                        opt_mismatch,
-                        opt_gap_open_query_left,
-                        opt_gap_open_target_left,
-                        opt_gap_open_query_interior,
-                        opt_gap_open_target_interior,
-                        opt_gap_open_query_right,
-                        opt_gap_open_target_right,
-                        opt_gap_extension_query_left,
-                        opt_gap_extension_target_left,
-                        opt_gap_extension_query_interior,
-                        opt_gap_extension_target_interior,
-                        opt_gap_extension_query_right,
-                        opt_gap_extension_target_right);
+}
+
+struct s16info_s * search_aligner_init()
+{
+  return search16_init(opt_match,
+                       opt_mismatch,
+                       opt_gap_open_query_left,
+                       opt_gap_open_target_left,
+                       opt_gap_open_query_interior,
+                       opt_gap_open_target_interior,
+                       opt_gap_open_query_right,
+                       opt_gap_open_target_right,
+                       opt_gap_extension_query_left,
+                       opt_gap_extension_target_left,
+                       opt_gap_extension_query_interior,
+                       opt_gap_extension_target_interior,
+                       opt_gap_extension_query_right,
+                       opt_gap_extension_target_right);
 }
 
 void search_thread_exit(struct searchinfo_s * si)
 {
   /* thread specific clean up */
-  search16_exit(si->s);
 #ifdef COMPARENONVECTORIZED
   nw_exit(si->nw);
 #endif
@@ -499,6 +999,12 @@ void search_thread_exit(struct searchinfo_s * si)
   xfree(si->hits);
   minheap_exit(si->m);
   xfree(si->kmers);
+  if (si->kh)
+    {
+      kh_exit(si->kh);
+      xfree(si->diags);
+      xfree(si->cover);
+    }
   if (si->query_head)
     {
       xfree(si->query_head);
@@ -518,29 +1024,32 @@ void * search_thread_worker(void * vp)
   return nullptr;
 }
 
-void search_thread_worker_run()
+void search_threads_init()
 {
-  /* initialize threads, start them, join them and return */
-
-  xpthread_attr_init(&attr);
-  xpthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
-  /* init and create worker threads, put them into stand-by mode */
+  /* thread specific data, kept for all runs of the worker threads */
   for(int t=0; t<opt_threads; t++)
     {
       search_thread_init(si_plus+t);
+      si_plus[t].s = search_aligner_init();
       if (si_minus)
         {
+          /* the strands share the aligner and the query profiles */
           search_thread_init(si_minus+t);
+          si_minus[t].s = si_plus[t].s;
         }
-      xpthread_create(pthread+t, &attr,
-                      search_thread_worker, (void*)(int64_t)t);
     }
 
-  /* finish and clean up worker threads */
+  if (opt_reorder_window)
+    {
+      search_batch_init();
+    }
+}
+
+void search_threads_exit()
+{
   for(int t=0; t<opt_threads; t++)
     {
-      xpthread_join(pthread[t], nullptr);
+      search16_exit(si_plus[t].s);
       search_thread_exit(si_plus+t);
       if (si_minus)
         {
@@ -548,30 +1057,62 @@ void search_thread_worker_run()
         }
     }
 
+  if (opt_reorder_window)
+    {
+      search_batch_exit();
+    }
+}
+
+void search_thread_worker_run()
+{
+  /* start the worker threads, join them and return */
+
+  if (opt_reorder_window)
+    {
+      search_batch_read();
+    }
+
+  xpthread_attr_init(&attr);
+  xpthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  for(int t=0; t<opt_threads; t++)
+    {
+      xpthread_create(pthread+t, &attr,
+                      search_thread_worker, (void*)(int64_t)t);
+    }
+
+  for(int t=0; t<opt_threads; t++)
+    {
+      xpthread_join(pthread[t], nullptr);
+    }
+
   xpthread_attr_destroy(&attr);
 }
 
 
 
-void search_prep(char * cmdline, char * progheader)
+void search_open_outputs(char * cmdline, char * progheader)
 {
   /* open output files */
 
   if (opt_alnout)
     {
-      fp_alnout = fopen_output(opt_alnout);
+      fp_alnout = checkpoint_fopen_output(opt_alnout);
       if (! fp_alnout)
         {
           fatal("Unable to open alignment output file for writing");
         }
 
-      fprintf(fp_alnout, "%s\n", cmdline);
-      fprintf(fp_alnout, "%s\n", progheader);
+      if (! checkpoint_resuming())
+        {
+          fprintf(fp_alnout, "%s\n", cmdline);
+          fprintf(fp_alnout, "%s\n", progheader);
+        }
     }
 
   if (opt_lcaout)
     {
-      fp_lcaout = fopen_output(opt_lcaout);
+      fp_lcaout = checkpoint_fopen_output(opt_lcaout);
       if (! fp_lcaout)
         {
           fatal("Unable to open lca output file for writing");
@@ -580,7 +1121,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_samout)
     {
-      fp_samout = fopen_output(opt_samout);
+      fp_samout = checkpoint_fopen_output(opt_samout);
       if (! fp_samout)
         {
           fatal("Unable to open SAM output file for writing");
@@ -589,7 +1130,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_userout)
     {
-      fp_userout = fopen_output(opt_userout);
+      fp_userout = checkpoint_fopen_output(opt_userout);
       if (! fp_userout)
         {
           fatal("Unable to open user-defined output file for writing");
@@ -598,7 +1139,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_blast6out)
     {
-      fp_blast6out = fopen_output(opt_blast6out);
+      fp_blast6out = checkpoint_fopen_output(opt_blast6out);
       if (! fp_blast6out)
         {
           fatal("Unable to open blast6-like output file for writing");
@@ -607,7 +1148,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_uc)
     {
-      fp_uc = fopen_output(opt_uc);
+      fp_uc = checkpoint_fopen_output(opt_uc);
       if (! fp_uc)
         {
           fatal("Unable to open uc output file for writing");
@@ -616,7 +1157,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_fastapairs)
     {
-      fp_fastapairs = fopen_output(opt_fastapairs);
+      fp_fastapairs = checkpoint_fopen_output(opt_fastapairs);
       if (! fp_fastapairs)
         {
           fatal("Unable to open fastapairs output file for writing");
@@ -625,7 +1166,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_qsegout)
     {
-      fp_qsegout = fopen_output(opt_qsegout);
+      fp_qsegout = checkpoint_fopen_output(opt_qsegout);
       if (! fp_qsegout)
         {
           fatal("Unable to open qsegout output file for writing");
@@ -634,7 +1175,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_tsegout)
     {
-      fp_tsegout = fopen_output(opt_tsegout);
+      fp_tsegout = checkpoint_fopen_output(opt_tsegout);
       if (! fp_tsegout)
         {
           fatal("Unable to open tsegout output file for writing");
@@ -643,7 +1184,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_matched)
     {
-      fp_matched = fopen_output(opt_matched);
+      fp_matched = checkpoint_fopen_output(opt_matched);
       if (! fp_matched)
         {
           fatal("Unable to open matched output file for writing");
@@ -652,7 +1193,7 @@ void search_prep(char * cmdline, char * progheader)
 
   if (opt_notmatched)
     {
-      fp_notmatched = fopen_output(opt_notmatched);
+      fp_notmatched = checkpoint_fopen_output(opt_notmatched);
       if (! fp_notmatched)
         {
           fatal("Unable to open notmatched output file for writing");
@@ -686,21 +1227,47 @@ void search_prep(char * cmdline, char * progheader)
         }
     }
 
+  if (opt_shardout)
+    {
+      fp_shardout = shard_open_output(opt_shardout);
+    }
+
+  /* per-query outputs are flushed regularly with --stream */
+
+  stream_add(fp_alnout);
+  stream_add(fp_lcaout);
+  stream_add(fp_samout);
+  stream_add(fp_userout);
+  stream_add(fp_blast6out);
+  stream_add(fp_uc);
+  stream_add(fp_fastapairs);
+  stream_add(fp_qsegout);
+  stream_add(fp_tsegout);
+  stream_add(fp_matched);
+  stream_add(fp_notmatched);
+}
+
+void search_prep_db()
+{
+  /* read the database and build its index */
+
   /* check if it may be an UDB file */
 
   bool is_udb = udb_detect_isudb(opt_db);
 
   if (is_udb)
     {
+      if (opt_db_shard)
+        {
+          fatal("The --db_shard option cannot be used with an UDB database");
+        }
       udb_read(opt_db, true, true);
-      results_show_samheader(fp_samout, cmdline, opt_db);
       show_rusage();
       seqcount = db_getsequencecount();
     }
   else
     {
       db_read(opt_db, 0);
-      results_show_samheader(fp_samout, cmdline, opt_db);
       if (opt_dbmask == MASK_DUST)
         {
           dust_all();
@@ -711,10 +1278,19 @@ void search_prep(char * cmdline, char * progheader)
         }
       show_rusage();
       seqcount = db_getsequencecount();
+      if (opt_db_dedup)
+        {
+          dbindex_dedup();
+        }
       dbindex_prepare(1, opt_dbmask);
       dbindex_addallsequences(opt_dbmask);
     }
 
+  if ((opt_max_word_freq < 1.0) || opt_idf)
+    {
+      dbindex_weights_init(opt_max_word_freq, opt_idf);
+    }
+
   /* tophits = the maximum number of hits we need to store */
 
   if ((opt_maxrejects == 0) || (opt_maxrejects > seqcount))
@@ -733,6 +1309,28 @@ void search_prep(char * cmdline, char * progheader)
     {
       tophits = seqcount;
     }
+
+  /* each thread needs word counts and hits for each strand */
+
+  budget_threads(0, opt_strand * (seqcount * sizeof(count_t) +
+                                  tophits * sizeof(struct hit)));
+}
+
+void search_prep(char * cmdline, char * progheader)
+{
+  /* with --serve, the output goes to the clients */
+
+  if (! opt_serve)
+    {
+      search_open_outputs(cmdline, progheader);
+    }
+
+  search_prep_db();
+
+  if (! checkpoint_resuming() && ! opt_serve)
+    {
+      results_show_samheader(fp_samout, cmdline, opt_db);
+    }
 }
 
 void search_done()
@@ -786,11 +1384,599 @@ void search_done()
     {
       fclose(fp_samout);
     }
+  if (fp_shardout)
+    {
+      fclose(fp_shardout);
+    }
   show_rusage();
 }
 
+/* the outputs returned to the clients, one section each, in this order */
+
+static struct serve_output_s
+{
+  const char * name;
+  char ** opt;
+  FILE ** fp;
+} serve_outputs[] =
+  {
+    { "alnout", & opt_alnout, & fp_alnout },
+    { "lcaout", & opt_lcaout, & fp_lcaout },
+    { "samout", & opt_samout, & fp_samout },
+    { "userout", & opt_userout, & fp_userout },
+    { "blast6out", & opt_blast6out, & fp_blast6out },
+    { "uc", & opt_uc, & fp_uc },
+    { "fastapairs", & opt_fastapairs, & fp_fastapairs },
+    { "qsegout", & opt_qsegout, & fp_qsegout },
+    { "tsegout", & opt_tsegout, & fp_tsegout },
+    { "matched", & opt_matched, & fp_matched },
+    { "notmatched", & opt_notmatched, & fp_notmatched }
+  };
+
+static const int serve_outputs_count =
+  sizeof(serve_outputs) / sizeof(struct serve_output_s);
+
+static const uint64_t serve_header_max = 1024 * 1024;
+static const uint64_t serve_request_max = 1024 * 1024 * 1024;
+
+struct serve_check_s
+{
+  int state;  /* 0: batch start, 1: line start, 2: header, 3: sequence */
+  bool truncated;
+  uint64_t lineno;
+  char * header;
+  uint64_t header_raw;
+  uint64_t header_length;
+  char message[200];
+};
+
+static void search_serve_reply_error(int conn, const char * message)
+{
+  /* send the error to the client and log it, the server keeps going */
+
+  char * reply = nullptr;
+  if (xsprintf(& reply, "ERROR %s\n", message) > 0)
+    {
+      arch_write(conn, reply, strlen(reply));
+      xfree(reply);
+    }
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Rejected request: %s\n", message);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Rejected request: %s\n", message);
+      fflush(fp_log);
+    }
+}
+
+static bool search_serve_check_header(struct serve_check_s * c)
+{
+  /* the header as the FASTA reader will see it must not fail later */
+
+  c->header[c->header_length] = 0;
+
+  int start = 0;
+  int end = 0;
+  if (header_find_attribute(c->header,
+                            (int) c->header_length,
+                            "size=",
+                            & start,
+                            & end,
+                            false) &&
+      (atol(c->header + start + 5) <= 0))
+    {
+      snprintf(c->message,
+               sizeof(c->message),
+               "Invalid (zero) abundance annotation in header on line %"
+               PRIu64,
+               c->lineno);
+      return false;
+    }
+  return true;
+}
+
+static bool search_serve_check(struct serve_check_s * c,
+                               const char * buffer,
+                               int64_t length)
+{
+  /*
+    Validate the query bytes as they arrive, with the same character
+    rules as the FASTA reader, so that nothing sent by a client can
+    make the reader stop the server. Sets the message and returns
+    false on the first error.
+  */
+
+  for (int64_t i = 0; i < length; i++)
+    {
+      unsigned char x = buffer[i];
+
+      if ((c->state == 0) || ((c->state == 1) && (x == '>')))
+        {
+          if (x != '>')
+            {
+              snprintf(c->message,
+                       sizeof(c->message),
+                       "Invalid FASTA - header must start with > character");
+              return false;
+            }
+          c->state = 2;
+          c->truncated = false;
+          c->header_raw = 0;
+          c->header_length = 0;
+          continue;
+        }
+
+      if (c->state == 2)
+        {
+          if (x == '\n')
+            {
+              if (! search_serve_check_header(c))
+                {
+                  return false;
+                }
+              c->lineno++;
+              c->state = 1;
+              continue;
+            }
+
+          c->header_raw++;
+          if (c->header_raw > serve_header_max)
+            {
+              snprintf(c->message,
+                       sizeof(c->message),
+                       "Header longer than %" PRIu64 " bytes on line %" PRIu64,
+                       serve_header_max,
+                       c->lineno);
+              return false;
+            }
+
+          if (c->truncated)
+            {
+              continue;
+            }
+
+          switch (char_header_action[x])
+            {
+            case 1:
+            case 7:
+              c->header[c->header_length++] = x;
+              break;
+
+            case 2:
+              snprintf(c->message,
+                       sizeof(c->message),
+                       "Illegal unprintable ASCII character no %d in header"
+                       " on line %" PRIu64,
+                       x,
+                       c->lineno);
+              return false;
+
+            case 5:
+            case 6:
+              if (opt_notrunclabels)
+                {
+                  c->header[c->header_length++] = x;
+                }
+              else
+                {
+                  c->truncated = true;
+                }
+              break;
+
+            default:
+              c->truncated = true;
+              break;
+            }
+          continue;
+        }
+
+      /* sequence */
+
+      c->state = 3;
+
+      if (x == '\n')
+        {
+          c->lineno++;
+          c->state = 1;
+        }
+      else if ((x == 0) || (char_fasta_action[x] == 2))
+        {
+          if ((x >= 32) && (x < 127))
+            {
+              snprintf(c->message,
+                       sizeof(c->message),
+                       "Illegal character '%c' in sequence on line %" PRIu64,
+                       x,
+                       c->lineno);
+            }
+          else
+            {
+              snprintf(c->message,
+                       sizeof(c->message),
+                       "Illegal unprintable ASCII character no %d in sequence"
+                       " on line %" PRIu64,
+                       x,
+                       c->lineno);
+            }
+          return false;
+        }
+    }
+  return true;
+}
+
+static bool search_serve_read_queries(int conn,
+                                      int fd,
+                                      time_t deadline,
+                                      char * message,
+                                      size_t message_size,
+                                      uint64_t * received)
+{
+  /*
+    Read the request, the line "QUERIES <bytes>" followed by exactly
+    that many bytes of FASTA, into the spool file. Returns false with
+    a message if the request is malformed, invalid or too slow.
+  */
+
+  char line[64];
+  uint64_t linelength = 0;
+  while (true)
+    {
+      if ((linelength + 1 >= sizeof(line)) || (time(nullptr) > deadline) ||
+          (arch_read(conn, line + linelength, 1) != 1))
+        {
+          snprintf(message, message_size,
+                   "Expected request line QUERIES <bytes>");
+          return false;
+        }
+      if (line[linelength] == '\n')
+        {
+          break;
+        }
+      linelength++;
+    }
+  line[linelength] = 0;
+
+  char * end = nullptr;
+  if ((strncmp(line, "QUERIES ", 8) != 0) ||
+      (line[8] < '0') || (line[8] > '9'))
+    {
+      snprintf(message, message_size,
+               "Expected request line QUERIES <bytes>");
+      return false;
+    }
+  errno = 0;
+  uint64_t expected = strtoull(line + 8, & end, 10);
+  if ((errno == ERANGE) || (end == line + 8) || (*end != 0))
+    {
+      snprintf(message, message_size,
+               "Expected request line QUERIES <bytes>");
+      return false;
+    }
+  if (expected > serve_request_max)
+    {
+      snprintf(message, message_size,
+               "Request of %" PRIu64 " bytes exceeds the maximum of %"
+               PRIu64 " bytes",
+               expected,
+               serve_request_max);
+      return false;
+    }
+
+  struct serve_check_s check;
+  check.state = 0;
+  check.truncated = false;
+  check.lineno = 1;
+  check.header = (char *) xmalloc(serve_header_max + 1);
+  check.header_raw = 0;
+  check.header_length = 0;
+  check.message[0] = 0;
+
+  bool ok = true;
+  char buffer[65536];
+  *received = 0;
+  while (ok && (*received < expected))
+    {
+      uint64_t want = MIN(sizeof(buffer), expected - *received);
+      int64_t n = arch_read(conn, buffer, want);
+      if ((n <= 0) || (time(nullptr) > deadline))
+        {
+          snprintf(message, message_size,
+                   "Received %" PRIu64 " of %" PRIu64 " query bytes"
+                   " within %" PRId64 " seconds",
+                   *received, expected, opt_serve_timeout);
+          ok = false;
+        }
+      else if (! search_serve_check(& check, buffer, n))
+        {
+          snprintf(message, message_size, "%s", check.message);
+          ok = false;
+        }
+      else if (arch_write(fd, buffer, n) != n)
+        {
+          snprintf(message, message_size,
+                   "Unable to write to temporary file");
+          ok = false;
+        }
+      else
+        {
+          *received += n;
+        }
+    }
+
+  if (ok && (check.state == 2))
+    {
+      snprintf(message, message_size,
+               "Invalid FASTA - header must be terminated with newline");
+      ok = false;
+    }
+
+  xfree(check.header);
+  return ok;
+}
+
+static bool search_serve_send_outputs(int conn, FILE ** files)
+{
+  /* send each requested output as "<name> <bytes>" and its content */
+
+  int sections = 0;
+  for (int i = 0; i < serve_outputs_count; i++)
+    {
+      if (*serve_outputs[i].opt)
+        {
+          sections++;
+        }
+    }
+
+  char * line = nullptr;
+  if ((xsprintf(& line, "OK %d\n", sections) < 0) ||
+      (arch_write(conn, line, strlen(line)) < 0))
+    {
+      if (line)
+        {
+          xfree(line);
+        }
+      return false;
+    }
+  xfree(line);
+
+  char buffer[65536];
+  for (int i = 0; i < serve_outputs_count; i++)
+    {
+      if (! *serve_outputs[i].opt)
+        {
+          continue;
+        }
+
+      FILE * fp = files[i];
+      fflush(fp);
+      uint64_t size = ftell(fp);
+      rewind(fp);
+
+      if ((xsprintf(& line, "%s %" PRIu64 "\n",
+                    serve_outputs[i].name, size) < 0) ||
+          (arch_write(conn, line, strlen(line)) < 0))
+        {
+          if (line)
+            {
+              xfree(line);
+            }
+          return false;
+        }
+      xfree(line);
+      line = nullptr;
+
+      uint64_t n = 0;
+      while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        {
+          if (arch_write(conn, buffer, n) < 0)
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+static void search_serve_request(int conn, char * cmdline, char * progheader)
+{
+  /*
+    Answer one request. The client sends the line "QUERIES <bytes>"
+    and that many bytes of uncompressed FASTA. The queries are checked
+    while they are spooled to a temporary file, so that invalid input
+    is rejected with an "ERROR <message>" reply and never reaches the
+    FASTA reader. Otherwise the queries are searched by the worker
+    threads and the reply is "OK <sections>", followed by one section
+    per requested output, "<name> <bytes>" and the output itself. The
+    connection is closed after the reply. A request that is not
+    complete within --serve_timeout seconds is rejected.
+  */
+
+  time_t deadline = time(nullptr) + opt_serve_timeout;
+  arch_set_timeout(conn, (int) opt_serve_timeout);
+
+  const char * tmpdir = getenv("TMPDIR");
+  char * tmpname = nullptr;
+  if (xsprintf(& tmpname, "%s/vsearch-serve-XXXXXX",
+               tmpdir ? tmpdir : "/tmp") == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  int fd = arch_mkstemp(tmpname);
+  if (fd < 0)
+    {
+      search_serve_reply_error(conn, "Unable to create temporary file");
+      xfree(tmpname);
+      close(conn);
+      return;
+    }
+
+  char message[256];
+  uint64_t received = 0;
+  bool ok = search_serve_read_queries(conn, fd, deadline,
+                                      message, sizeof(message), & received);
+  close(fd);
+
+  FILE * files[serve_outputs_count];
+  for (int i = 0; i < serve_outputs_count; i++)
+    {
+      files[i] = nullptr;
+      if (ok && *serve_outputs[i].opt)
+        {
+          files[i] = tmpfile();
+          if (! files[i])
+            {
+              snprintf(message, sizeof(message),
+                       "Unable to create temporary file");
+              ok = false;
+            }
+        }
+    }
+
+  if (ok)
+    {
+      for (int i = 0; i < serve_outputs_count; i++)
+        {
+          *serve_outputs[i].fp = files[i];
+        }
+
+      if (fp_alnout)
+        {
+          fprintf(fp_alnout, "%s\n", cmdline);
+          fprintf(fp_alnout, "%s\n", progheader);
+        }
+
+      results_show_samheader(fp_samout, cmdline, opt_db);
+
+      qmatches = 0;
+      qmatches_abundance = 0;
+      queries = 0;
+      queries_abundance = 0;
+      queries_started = 0;
+      count_matched = 0;
+      count_notmatched = 0;
+
+      if (received > 0)
+        {
+          query_fasta_h = fasta_open(tmpname);
+          search_thread_worker_run();
+          fasta_close(query_fasta_h);
+        }
+
+      for (int i = 0; i < serve_outputs_count; i++)
+        {
+          *serve_outputs[i].fp = nullptr;
+        }
+
+      if (! search_serve_send_outputs(conn, files))
+        {
+          fprintf(stderr, "WARNING: Unable to send the results to the client\n");
+          if (opt_log)
+            {
+              fprintf(fp_log,
+                      "WARNING: Unable to send the results to the client\n");
+            }
+        }
+    }
+  else
+    {
+      search_serve_reply_error(conn, message);
+    }
+
+  for (int i = 0; i < serve_outputs_count; i++)
+    {
+      if (files[i])
+        {
+          fclose(files[i]);
+        }
+    }
+
+  unlink(tmpname);
+  xfree(tmpname);
+  close(conn);
+
+  if (ok)
+    {
+      if (! opt_quiet)
+        {
+          fprintf(stderr, "Served %d queries, %d matching\n",
+                  queries, qmatches);
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log, "Served %d queries, %d matching\n",
+                  queries, qmatches);
+          fflush(fp_log);
+        }
+    }
+}
+
+void search_serve(char * cmdline, char * progheader)
+{
+  /*
+    Keep the database, its index and the per-thread search data
+    loaded, and answer query batches from clients connecting to a
+    Unix domain socket, one client at a time, until terminated. Each
+    request is framed and must arrive within --serve_timeout seconds,
+    so a slow or broken client cannot hold up the others, and invalid
+    requests are answered with an error instead of stopping the
+    server.
+  */
+
+  int listener = arch_listen_unix(opt_serve);
+  if (listener < 0)
+    {
+      fatal("Unable to listen on socket (%s)", opt_serve);
+    }
+
+  si_plus = (struct searchinfo_s *) xmalloc(opt_threads *
+                                            sizeof(struct searchinfo_s));
+  si_minus = (opt_strand > 1) ?
+    (struct searchinfo_s *) xmalloc(opt_threads * sizeof(struct searchinfo_s)) :
+    nullptr;
+  pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
+
+  xpthread_mutex_init(&mutex_input, nullptr);
+  xpthread_mutex_init(&mutex_output, nullptr);
+  xpthread_cond_init(&cond_output, nullptr);
+
+  search_threads_init();
+
+  /* no progress indicator while serving */
+  opt_no_progress = true;
+  progress_init("Serving queries", 0);
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, " on %s\n", opt_serve);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Serving queries on %s\n", opt_serve);
+      fflush(fp_log);
+    }
+
+  while (true)
+    {
+      int conn = arch_accept(listener);
+      if (conn < 0)
+        {
+          fatal("Unable to accept connection on socket (%s)", opt_serve);
+        }
+      search_serve_request(conn, cmdline, progheader);
+    }
+}
+
 void usearch_global(char * cmdline, char * progheader)
 {
+  checkpoint_init("usearch_global");
+
   search_prep(cmdline, progheader);
 
   if (opt_dbmatched)
@@ -821,8 +2007,21 @@ void usearch_global(char * cmdline, char * progheader)
   qmatches_abundance = 0;
   queries = 0;
   queries_abundance = 0;
+
+  if (opt_serve)
+    {
+      search_serve(cmdline, progheader);
+    }
+
   query_fasta_h = fasta_open(opt_usearch_global);
 
+  if (checkpoint_resuming())
+    {
+      search_checkpoint_restore();
+    }
+
+  queries_started = queries;
+
   /* allocate memory for thread info */
   si_plus = (struct searchinfo_s *) xmalloc(opt_threads *
                                             sizeof(struct searchinfo_s));
@@ -841,11 +2040,15 @@ void usearch_global(char * cmdline, char * progheader)
   /* init mutexes for input and output */
   xpthread_mutex_init(&mutex_input, nullptr);
   xpthread_mutex_init(&mutex_output, nullptr);
+  xpthread_cond_init(&cond_output, nullptr);
 
+  search_threads_init();
   progress_init("Searching", fasta_get_size(query_fasta_h));
   search_thread_worker_run();
   progress_done();
+  search_threads_exit();
 
+  xpthread_cond_destroy(&cond_output);
   xpthread_mutex_destroy(&mutex_output);
   xpthread_mutex_destroy(&mutex_input);
 
@@ -980,4 +2183,6 @@ void usearch_global(char * cmdline, char * progheader)
     }
 
   search_done();
+
+  checkpoint_done();
 }
@@ -58,4 +58,13 @@
 
 */
 
+void search_prep_db();
+void search_thread_init(struct searchinfo_s * si);
+struct s16info_s * search_aligner_init();
+void search_thread_exit(struct searchinfo_s * si);
+void search_hits(struct searchinfo_s * si_p,
+                 struct searchinfo_s * si_m,
+                 struct hit * * hits,
+                 int * hit_count);
+
 void usearch_global(char * cmdline, char * progheader);
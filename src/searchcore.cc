@@ -59,6 +59,7 @@
 */
 
 #include "vsearch.h"
+#include <algorithm>
 
 /* per thread data */
 
@@ -209,6 +210,263 @@ bool search_enough_kmers(struct searchinfo_s * si,
   return (count >= opt_minwordmatches) || (count >= si->kmersamplecount);
 }
 
+/* counts above the last bin are pooled in it */
+constexpr unsigned int topscores_bins = 256;
+
+inline void search_count_target(count_t * kmers,
+                                int i,
+                                unsigned int * histogram,
+                                minheap_t * m)
+{
+  const unsigned int count = kmers[i];
+
+  if (histogram)
+    {
+      histogram[MIN(count, topscores_bins - 1)]++;
+    }
+  else
+    {
+      unsigned int seqno = dbindex_getmapping(i);
+      unsigned int length = db_getsequencelen(seqno);
+
+      elem_t novel;
+      novel.count = count;
+      novel.seqno = seqno;
+      novel.length = length;
+
+      minheap_add(m, & novel);
+    }
+}
+
+static void search_scan_counts(count_t * kmers,
+                               int first,
+                               int indexed_count,
+                               unsigned int threshold,
+                               unsigned int * histogram,
+                               minheap_t * m)
+{
+  /*
+    Visit the targets from first up to indexed_count with at least
+    threshold matching kmers, either adding their counts to the
+    histogram or adding them to the min heap. Most targets are
+    usually below the threshold, so on x86_64 eight counters are
+    compared at a time and blocks without any candidates are skipped.
+  */
+
+  int i = first;
+
+#ifdef __x86_64__
+  if (threshold > 0)
+    {
+      const __m128i t = _mm_set1_epi16((short) MIN(threshold, 65535U));
+      const __m128i z = _mm_setzero_si128();
+
+      for(; i + 8 <= indexed_count; i += 8)
+        {
+          __m128i v = _mm_loadu_si128((__m128i *) (kmers + i));
+          /* t - v saturates to zero where v >= t */
+          __m128i below = _mm_subs_epu16(t, v);
+          unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(below, z));
+          while (mask)
+            {
+              int j = __builtin_ctz(mask) / 2;
+              search_count_target(kmers, i + j, histogram, m);
+              mask &= ~(3U << (2 * j));
+            }
+        }
+    }
+#endif
+
+  for(; i < indexed_count; i++)
+    {
+      if (kmers[i] >= threshold)
+        {
+          search_count_target(kmers, i, histogram, m);
+        }
+    }
+}
+
+static int compare_kmers(const void * a, const void * b)
+{
+  unsigned int x = * (const unsigned int *) a;
+  unsigned int y = * (const unsigned int *) b;
+
+  if (x < y)
+    {
+      return -1;
+    }
+  else if (x > y)
+    {
+      return +1;
+    }
+  else
+    {
+      return 0;
+    }
+}
+
+inline unsigned int search_kmer_weight(unsigned int slot,
+                                       unsigned int maxweight)
+{
+  if (dbindex_weights)
+    {
+      return MIN(dbindex_weights[slot], maxweight);
+    }
+  else
+    {
+      return 1;
+    }
+}
+
+static unsigned int search_drop_stopwords(struct searchinfo_s * si)
+{
+  /*
+    Remove the query kmers with weight zero from the sample and scale
+    the minimum number of word matches by the fraction of the kmers
+    that is kept.
+  */
+
+  const unsigned int samples = si->kmersamplecount;
+  unsigned int kept = 0;
+
+  for(unsigned int i = 0; i < samples; i++)
+    {
+      unsigned int kmer = si->kmersample[i];
+      if (dbindex_weights[dbindex_getslot(kmer)])
+        {
+          si->kmersample[kept++] = kmer;
+        }
+    }
+
+  si->kmersamplecount = kept;
+
+  if (kept == samples)
+    {
+      return MIN(opt_minwordmatches, samples);
+    }
+
+  unsigned int minmatches =
+    (unsigned int) ceil((double) opt_minwordmatches * kept / samples);
+  return MIN(minmatches, kept);
+}
+
+static void search_topscores_groups(struct searchinfo_s * si,
+                                    unsigned int minmatches,
+                                    unsigned int maxweight)
+{
+  /*
+    Two-level search in a grouped index. First count the query kmers
+    in the group representatives, using the counter of the first
+    index no of each group, then count the kmers only in the members
+    of the best groups. The match lists are sorted by index no, so
+    the members of a group are found by binary search in each list.
+  */
+
+  count_t * kmers = si->kmers;
+  const unsigned int samples = si->kmersamplecount;
+  const unsigned int groups = dbindex_groups;
+  const unsigned int * start = dbindex_group_start;
+
+  for(unsigned int g = 0; g < groups; g++)
+    {
+      kmers[start[g]] = 0;
+    }
+
+  for(unsigned int i = 0; i < samples; i++)
+    {
+      unsigned int slot = dbindex_getslot(si->kmersample[i]);
+      unsigned int w = search_kmer_weight(slot, maxweight);
+      unsigned int * list = dbindex_group_getlist(slot);
+      unsigned int count = dbindex_group_getcount(slot);
+      for(unsigned int j = 0; j < count; j++)
+        {
+          kmers[start[list[j]]] += w;
+        }
+    }
+
+  /*
+    Probe the groups with the most matches: all groups above the
+    threshold count, and groups at the threshold in index order until
+    the number of probes is reached. Groups without matches are not
+    probed.
+  */
+
+  unsigned int histogram[topscores_bins];
+  memset(histogram, 0, sizeof(histogram));
+  for(unsigned int g = 0; g < groups; g++)
+    {
+      histogram[MIN(kmers[start[g]], topscores_bins - 1)]++;
+    }
+
+  unsigned int threshold = 1;
+  unsigned int ties = UINT_MAX;
+  unsigned int above = 0;
+  for(unsigned int c = topscores_bins - 1; c > 0; c--)
+    {
+      if (above + histogram[c] >= opt_probe_groups)
+        {
+          threshold = c;
+          ties = opt_probe_groups - above;
+          break;
+        }
+      above += histogram[c];
+    }
+
+  for(unsigned int g = 0; g < groups; g++)
+    {
+      const unsigned int count = MIN(kmers[start[g]], topscores_bins - 1);
+
+      if (count < threshold)
+        {
+          continue;
+        }
+
+      if (count == threshold)
+        {
+          if (ties == 0)
+            {
+              continue;
+            }
+          ties--;
+        }
+
+      const unsigned int lo = start[g];
+      const unsigned int hi = start[g + 1];
+
+      memset(kmers + lo, 0, (hi - lo) * sizeof(count_t));
+
+      for(unsigned int i = 0; i < samples; i++)
+        {
+          unsigned int slot = dbindex_getslot(si->kmersample[i]);
+          unsigned int w = search_kmer_weight(slot, maxweight);
+          unsigned char * bitmap = dbindex_getbitmap(slot);
+
+          if (bitmap)
+            {
+              for(unsigned int x = lo; x < hi; x++)
+                {
+                  kmers[x] += ((bitmap[x >> 3] >> (x & 7)) & 1) * w;
+                }
+            }
+          else
+            {
+              unsigned int * list = dbindex_getmatchlist(slot);
+              unsigned int count = dbindex_getmatchcount(slot);
+              unsigned int * p = std::lower_bound(list, list + count, lo);
+              unsigned int * end = list + count;
+              while ((p < end) && (*p < hi))
+                {
+                  kmers[*p++] += w;
+                }
+            }
+        }
+
+      search_scan_counts(kmers, lo, hi, minmatches, nullptr, si->m);
+    }
+
+  minheap_sort(si->m);
+}
+
 void search_topscores(struct searchinfo_s * si)
 {
   /*
@@ -218,6 +476,25 @@ void search_topscores(struct searchinfo_s * si)
     These are stored in the min heap array.
   */
 
+  unsigned int minmatches = MIN(opt_minwordmatches, si->kmersamplecount);
+  unsigned int maxweight = 1;
+
+  if (dbindex_weights)
+    {
+      minmatches = search_drop_stopwords(si);
+      /* keep the weighted counts within the range of count_t */
+      maxweight = MIN(idf_maxweight, 65535 / MAX(si->kmersamplecount, 1U));
+      maxweight = MAX(maxweight, 1U);
+    }
+
+  if (dbindex_groups && (opt_probe_groups > 0) &&
+      (opt_probe_groups < dbindex_groups))
+    {
+      minheap_empty(si->m);
+      search_topscores_groups(si, minmatches, maxweight);
+      return;
+    }
+
   /* count kmer hits in the database sequences */
   const int indexed_count = dbindex_getcount();
 
@@ -226,10 +503,46 @@ void search_topscores(struct searchinfo_s * si)
 
   minheap_empty(si->m);
 
-  for(unsigned int i=0; i<si->kmersamplecount; i++)
+  /*
+    In a directly indexed directory the match lists are stored in kmer
+    order, so visiting the query kmers in ascending order walks the
+    index sequentially. The directory entries (or the slots of a hashed
+    directory) and the start of the match lists are prefetched a few
+    kmers ahead of their use.
+  */
+
+  const unsigned int samples = si->kmersamplecount;
+  const unsigned int prefetch_distance = 8;
+
+  if (! kmerslots)
     {
-      unsigned int kmer = si->kmersample[i];
-      unsigned char * bitmap = dbindex_getbitmap(kmer);
+      qsort(si->kmersample, samples, sizeof(unsigned int), compare_kmers);
+    }
+
+  for(unsigned int i=0; i < MIN(samples, prefetch_distance); i++)
+    {
+      dbindex_prefetch_directory(si->kmersample[i]);
+    }
+
+  for(unsigned int i=0; i<samples; i++)
+    {
+      if (i + prefetch_distance < samples)
+        {
+          dbindex_prefetch_directory(si->kmersample[i + prefetch_distance]);
+        }
+      if (i + prefetch_distance / 2 < samples)
+        {
+          dbindex_prefetch_matchlist(si->kmersample[i + prefetch_distance / 2]);
+        }
+
+      unsigned int slot = dbindex_getslot(si->kmersample[i]);
+      unsigned int w = search_kmer_weight(slot, maxweight);
+      unsigned char * bitmap = dbindex_getbitmap(slot);
+
+      if (w == 0)
+        {
+          continue;
+        }
 
       if (bitmap)
         {
@@ -237,47 +550,54 @@ void search_topscores(struct searchinfo_s * si)
           if (ssse3_present)
             {
               increment_counters_from_bitmap_ssse3(si->kmers,
-                                                   bitmap, indexed_count);
+                                                   bitmap, indexed_count, w);
             }
           else
             {
               increment_counters_from_bitmap_sse2(si->kmers,
-                                                  bitmap, indexed_count);
+                                                  bitmap, indexed_count, w);
             }
 #else
-          increment_counters_from_bitmap(si->kmers, bitmap, indexed_count);
+          increment_counters_from_bitmap(si->kmers, bitmap, indexed_count, w);
 #endif
         }
       else
         {
-          unsigned int * list = dbindex_getmatchlist(kmer);
-          unsigned int count = dbindex_getmatchcount(kmer);
+          unsigned int * list = dbindex_getmatchlist(slot);
+          unsigned int count = dbindex_getmatchcount(slot);
           for(unsigned int j=0; j < count; j++)
             {
-              si->kmers[list[j]]++;
+              si->kmers[list[j]] += w;
             }
         }
     }
 
-  const int minmatches = MIN(opt_minwordmatches, si->kmersamplecount);
+  /*
+    Instead of offering every target with enough matching kmers to
+    the min heap, first make a histogram of the counts and find the
+    lowest count that may still make it into the heap. Only targets
+    with at least that count are added, so the heap keeps exactly
+    the same elements, including the tie-breaking on length and seqno.
+  */
 
-  for(int i=0; i < indexed_count; i++)
+  unsigned int histogram[topscores_bins];
+  memset(histogram, 0, sizeof(histogram));
+  search_scan_counts(si->kmers, 0, indexed_count, minmatches, histogram, nullptr);
+
+  unsigned int threshold = minmatches;
+  unsigned int above = 0;
+  for(unsigned int c = topscores_bins - 1; c > minmatches; c--)
     {
-      count_t count = si->kmers[i];
-      if (count >= minmatches)
+      above += histogram[c];
+      if (above >= (unsigned int) si->m->alloc)
         {
-          unsigned int seqno = dbindex_getmapping(i);
-          unsigned int length = db_getsequencelen(seqno);
-
-          elem_t novel;
-          novel.count = count;
-          novel.seqno = seqno;
-          novel.length = length;
-
-          minheap_add(si->m, & novel);
+          threshold = c;
+          break;
         }
     }
 
+  search_scan_counts(si->kmers, 0, indexed_count, threshold, nullptr, si->m);
+
   minheap_sort(si->m);
 }
 
@@ -299,6 +619,66 @@ int seqncmp(char * a, char * b, uint64_t n)
   return 0;
 }
 
+static void align_trim_finish(struct hit * hit)
+{
+  /* compute numbers excluding terminal gaps and the identities */
+
+  if (hit->trim_q_left >= hit->nwalignmentlength)
+    {
+      hit->trim_q_right = 0;
+    }
+
+  if (hit->trim_t_left >= hit->nwalignmentlength)
+    {
+      hit->trim_t_right = 0;
+    }
+
+  hit->internal_alignmentlength = hit->nwalignmentlength
+    - hit->trim_q_left - hit->trim_t_left
+    - hit->trim_q_right - hit->trim_t_right;
+
+  hit->internal_indels = hit->nwindels
+    - hit->trim_q_left - hit->trim_t_left
+    - hit->trim_q_right - hit->trim_t_right;
+
+  hit->internal_gaps = hit->nwgaps
+    - ((hit->trim_q_left  + hit->trim_t_left)  > 0 ? 1 : 0)
+    - ((hit->trim_q_right + hit->trim_t_right) > 0 ? 1 : 0);
+
+  /* CD-HIT */
+  hit->id0 = hit->shortest > 0 ? 100.0 * hit->matches / hit->shortest : 0.0;
+  /* all diffs */
+  hit->id1 = hit->nwalignmentlength > 0 ?
+    100.0 * hit->matches / hit->nwalignmentlength : 0.0;
+  /* internal diffs */
+  hit->id2 = hit->internal_alignmentlength > 0 ?
+    100.0 * hit->matches / hit->internal_alignmentlength : 0.0;
+  /* Marine Biology Lab */
+  hit->id3 = MAX(0.0, 100.0 * (1.0 - (1.0 * (hit->mismatches + hit->nwgaps) /
+                                      hit->longest)));
+  /* BLAST */
+  hit->id4 = hit->nwalignmentlength > 0 ?
+    100.0 * hit->matches / hit->nwalignmentlength : 0.0;
+
+  switch (opt_iddef)
+    {
+    case 0:
+      hit->id = hit->id0;
+      break;
+    case 1:
+      hit->id = hit->id1;
+      break;
+    case 2:
+      hit->id = hit->id2;
+      break;
+    case 3:
+      hit->id = hit->id3;
+      break;
+    case 4:
+      hit->id = hit->id4;
+      break;
+    }
+}
 
 void align_trim(struct hit * hit)
 {
@@ -366,63 +746,24 @@ void align_trim(struct hit * hit)
         }
     }
 
-  if (hit->trim_q_left >= hit->nwalignmentlength)
-    {
-      hit->trim_q_right = 0;
-    }
-
-  if (hit->trim_t_left >= hit->nwalignmentlength)
-    {
-      hit->trim_t_right = 0;
-    }
-
-  hit->internal_alignmentlength = hit->nwalignmentlength
-    - hit->trim_q_left - hit->trim_t_left
-    - hit->trim_q_right - hit->trim_t_right;
-
-  hit->internal_indels = hit->nwindels
-    - hit->trim_q_left - hit->trim_t_left
-    - hit->trim_q_right - hit->trim_t_right;
+  align_trim_finish(hit);
+}
 
-  hit->internal_gaps = hit->nwgaps
-    - ((hit->trim_q_left  + hit->trim_t_left)  > 0 ? 1 : 0)
-    - ((hit->trim_q_right + hit->trim_t_right) > 0 ? 1 : 0);
+void align_trim_counted(struct hit * hit, unsigned short * trims)
+{
+  /* fill in info from terminal gaps counted by search16_counts() */
 
-  /* CD-HIT */
-  hit->id0 = hit->shortest > 0 ? 100.0 * hit->matches / hit->shortest : 0.0;
-  /* all diffs */
-  hit->id1 = hit->nwalignmentlength > 0 ?
-    100.0 * hit->matches / hit->nwalignmentlength : 0.0;
-  /* internal diffs */
-  hit->id2 = hit->internal_alignmentlength > 0 ?
-    100.0 * hit->matches / hit->internal_alignmentlength : 0.0;
-  /* Marine Biology Lab */
-  hit->id3 = MAX(0.0, 100.0 * (1.0 - (1.0 * (hit->mismatches + hit->nwgaps) /
-                                      hit->longest)));
-  /* BLAST */
-  hit->id4 = hit->nwalignmentlength > 0 ?
-    100.0 * hit->matches / hit->nwalignmentlength : 0.0;
+  hit->trim_aln_left = 0;
+  hit->trim_aln_right = 0;
+  hit->trim_q_left = trims[0];
+  hit->trim_t_left = trims[1];
+  hit->trim_q_right = trims[2];
+  hit->trim_t_right = trims[3];
 
-  switch (opt_iddef)
-    {
-    case 0:
-      hit->id = hit->id0;
-      break;
-    case 1:
-      hit->id = hit->id1;
-      break;
-    case 2:
-      hit->id = hit->id2;
-      break;
-    case 3:
-      hit->id = hit->id3;
-      break;
-    case 4:
-      hit->id = hit->id4;
-      break;
-    }
+  align_trim_finish(hit);
 }
 
+
 auto search_acceptable_unaligned(struct searchinfo_s * si,
                                  int target) -> bool
 {
@@ -582,19 +923,50 @@ void align_delayed(struct searchinfo_s * si)
   unsigned short nwmismatches_list[MAXDELAYED];
   unsigned short nwgaps_list[MAXDELAYED];
   char * nwcigar_list[MAXDELAYED];
+  unsigned short nwtrims_list[4 * MAXDELAYED];
+
+  bool taken[MAXDELAYED];
 
   int target_count = 0;
 
+  /*
+    Consecutive hits to identical database sequences share a single
+    alignment. The second loop below finds the shared alignment of
+    each hit in the same way.
+  */
+
+  int64_t last_rep = -1;
+
   for(int x = si->finalized; x < si->hit_count; x++)
     {
       struct hit * hit = si->hits + x;
       if (! hit->rejected)
         {
-          target_list[target_count++] = hit->target;
+          int64_t rep = dbindex_duprep ? dbindex_duprep[hit->target] : hit->target;
+          if (rep != last_rep)
+            {
+              taken[target_count] = false;
+              target_list[target_count++] = hit->target;
+              last_rep = rep;
+            }
         }
     }
 
-  if (target_count)
+  if (target_count && si->counts_only)
+    {
+      /* no alignment strings needed, count instead of tracing back */
+      search16_counts(si->s,
+                      target_count,
+                      target_list,
+                      nwscore_list,
+                      nwalignmentlength_list,
+                      nwmatches_list,
+                      nwmismatches_list,
+                      nwgaps_list,
+                      nwtrims_list);
+      memset(nwcigar_list, 0, target_count * sizeof(char *));
+    }
+  else if (target_count)
     {
       search16(si->s,
                target_count,
@@ -607,15 +979,26 @@ void align_delayed(struct searchinfo_s * si)
                nwcigar_list);
     }
 
-  int i = 0;
+  int i = -1;
+  last_rep = -1;
 
   for(int x = si->finalized; x < si->hit_count; x++)
     {
+      struct hit * hit = si->hits + x;
+
+      if (! hit->rejected)
+        {
+          int64_t rep = dbindex_duprep ? dbindex_duprep[hit->target] : hit->target;
+          if (rep != last_rep)
+            {
+              i++;
+              last_rep = rep;
+            }
+        }
+
       /* maxrejects or maxaccepts reached - ignore remaining hits */
       if ((si->rejects < opt_maxrejects) && (si->accepts < opt_maxaccepts))
         {
-          struct hit * hit = si->hits + x;
-
           if (hit->rejected)
             {
               si->rejects++;
@@ -644,6 +1027,7 @@ void align_delayed(struct searchinfo_s * si)
                   if (nwcigar_list[i])
                     {
                       xfree(nwcigar_list[i]);
+                      nwcigar_list[i] = nullptr;
                     }
 
                   nwcigar = xstrdup(si->lma->align(si->qsequence,
@@ -666,7 +1050,19 @@ void align_delayed(struct searchinfo_s * si)
                   nwmatches = nwmatches_list[i];
                   nwmismatches = nwmismatches_list[i];
                   nwgaps = nwgaps_list[i];
-                  nwcigar = nwcigar_list[i];
+                  if (! nwcigar_list[i])
+                    {
+                      nwcigar = nullptr;
+                    }
+                  else if (taken[i])
+                    {
+                      nwcigar = xstrdup(nwcigar_list[i]);
+                    }
+                  else
+                    {
+                      nwcigar = nwcigar_list[i];
+                      taken[i] = true;
+                    }
                 }
 
               hit->aligned = true;
@@ -684,7 +1080,14 @@ void align_delayed(struct searchinfo_s * si)
               hit->mismatches = hit->nwdiff - hit->nwindels;
 
               /* trim alignment and compute numbers excluding terminal gaps */
-              align_trim(hit);
+              if (nwcigar)
+                {
+                  align_trim(hit);
+                }
+              else
+                {
+                  align_trim_counted(hit, nwtrims_list + 4 * i);
+                }
 
               /* test accept/reject criteria after alignment */
               if (search_acceptable_aligned(si, hit))
@@ -695,26 +1098,221 @@ void align_delayed(struct searchinfo_s * si)
                 {
                   si->rejects++;
                 }
-
-              i++;
             }
         }
     }
 
   /* free ignored alignments */
-  while (i < target_count)
+  for(i = 0; i < target_count; i++)
     {
-      xfree(nwcigar_list[i++]);
+      if ((! taken[i]) && nwcigar_list[i])
+        {
+          xfree(nwcigar_list[i]);
+        }
     }
 
   si->finalized = si->hit_count;
 }
 
+static bool search_diagonal_possible(struct searchinfo_s * si, int target)
+{
+  /*
+    Ungapped prefilter. Count the query positions covered by kmers
+    shared with the target and find the diagonal with the most shared
+    kmers. Each matching position not covered lies in a run of fewer
+    than k matches, and there can be at most one such run more than
+    the number of differences. An alignment of the overlap on the best
+    diagonal with identity id can have at most (1 - id) differences
+    per column, so it needs at least id * overlap - (k - 1) *
+    ((1 - id) * overlap + 1) covered positions. Targets with fewer are
+    rejected without alignment.
+  */
+
+  const int k = opt_wordlength;
+  const int qlen = si->qseqlen;
+  const int tlen = db_getsequencelen(target);
+
+  kh_find_coverage(si->kh, k, db_getsequence(target), tlen,
+                   si->diags, si->cover);
+
+  int best = 0;
+  for(int d = 1; d < qlen + tlen; d++)
+    {
+      if (si->diags[d] > si->diags[best])
+        {
+          best = d;
+        }
+    }
+
+  int covered = 0;
+  int depth = 0;
+  for(int i = 0; i < qlen; i++)
+    {
+      depth += si->cover[i];
+      if (depth > 0)
+        {
+          covered++;
+        }
+    }
+
+  /* query position minus target position on the best diagonal */
+  const int offset = best - tlen;
+  const int overlap = MIN(qlen, tlen + offset) - MAX(0, offset);
+  const double id = opt_weak_id;
+
+  return covered + (k - 1) * ((1.0 - id) * overlap + 1) >= id * overlap;
+}
+
+static void search_expand_duplicates(struct searchinfo_s * si)
+{
+  /*
+    Add the sequences identical to the candidates to the min heap with
+    the same count. A representative ranks above its duplicates, as it
+    has the same count and length and a lower seqno, so the heap ends
+    up with the same candidates as with all sequences indexed.
+    Duplicates without indexed words can only be in the heap with a
+    count of zero and are removed first.
+  */
+
+  minheap_t * m = si->m;
+  const int count = m->count;
+  auto * reps = (elem_t *) xmalloc(count * sizeof(elem_t));
+  int r = 0;
+
+  for(int i = 0; i < count; i++)
+    {
+      if (! dbindex_isduplicate(m->array[i].seqno))
+        {
+          reps[r++] = m->array[i];
+        }
+    }
+
+  minheap_empty(m);
+
+  for(int i = 0; i < r; i++)
+    {
+      minheap_add(m, reps + i);
+    }
+
+  for(int i = 0; i < r; i++)
+    {
+      elem_t e = reps[i];
+      e.seqno = dbindex_dupnext[e.seqno];
+      while (e.seqno)
+        {
+          minheap_add(m, & e);
+          e.seqno = dbindex_dupnext[e.seqno];
+        }
+    }
+
+  xfree(reps);
+
+  minheap_sort(m);
+}
+
+static double search_estimate_id(struct searchinfo_s * si, elem_t * e)
+{
+  /*
+    Estimate the identity from the fraction of the query words shared
+    with the target. A word survives a random substitution with
+    probability id^k, so the estimate is that fraction to the power
+    of 1/k. The fraction is relative to the number of words of the
+    shorter sequence.
+  */
+
+  const int64_t k = opt_wordlength;
+  const int64_t twords = (int64_t) e->length - k + 1;
+  int64_t words = si->kmersamplecount;
+  if (twords > 0)
+    {
+      words = MIN(words, twords);
+    }
+
+  if (words <= 0)
+    {
+      return 0.0;
+    }
+
+  return pow(MIN(1.0, 1.0 * e->count / words), 1.0 / k);
+}
+
+static bool search_approx(struct searchinfo_s * si)
+{
+  /*
+    Accept the candidate with the most shared words without alignment
+    if its estimated identity is at least --id and exceeds that of the
+    runner-up by at least --approx_margin. Identical copies of the top
+    candidate (see --db_dedup) are not counted as runner-up.
+  */
+
+  minheap_t * m = si->m;
+
+  if (m->count == 0)
+    {
+      return false;
+    }
+
+  elem_t * best = m->array + m->count - 1;
+
+  if (! search_acceptable_unaligned(si, best->seqno))
+    {
+      return false;
+    }
+
+  const double best_id = search_estimate_id(si, best);
+  double next_id = 0.0;
+
+  for(int i = m->count - 2; i >= 0; i--)
+    {
+      elem_t * e = m->array + i;
+      if ((! dbindex_duprep) ||
+          (dbindex_duprep[e->seqno] != dbindex_duprep[best->seqno]))
+        {
+          next_id = search_estimate_id(si, e);
+          break;
+        }
+    }
+
+  if ((best_id < opt_id) || (best_id - next_id < opt_approx_margin))
+    {
+      return false;
+    }
+
+  const int64_t tlen = best->length;
+
+  struct hit * hit = si->hits;
+  memset(hit, 0, sizeof(struct hit));
+  hit->target = best->seqno;
+  hit->strand = si->strand;
+  hit->count = best->count;
+  hit->accepted = true;
+  hit->aligned = true;
+  hit->nwalignment = xstrdup("*");
+  hit->nwalignmentlength = si->qseqlen;
+  hit->internal_alignmentlength = si->qseqlen;
+  hit->id = 100.0 * best_id;
+  hit->id0 = hit->id;
+  hit->id1 = hit->id;
+  hit->id2 = hit->id;
+  hit->id3 = hit->id;
+  hit->id4 = hit->id;
+  hit->nwid = hit->id;
+  hit->shortest = MIN(si->qseqlen, tlen);
+  hit->longest = MAX(si->qseqlen, tlen);
+
+  si->hit_count = 1;
+  si->accepts = 1;
+  si->rejects = 0;
+  si->finalized = 1;
+
+  return true;
+}
+
 void search_onequery(struct searchinfo_s * si, int seqmask)
 {
-  si->hit_count = 0;
+  /* the caller has prepared the query profile, see search16_qprep() */
 
-  search16_qprep(si->s, si->qsequence, si->qseqlen);
+  si->hit_count = 0;
 
   si->lma = new LinearMemoryAligner;
 
@@ -734,6 +1332,18 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
                           opt_gap_extension_query_right,
                           opt_gap_extension_target_right);
 
+  if (si->kh)
+    {
+      kh_insert_kmers(si->kh, opt_wordlength, si->qsequence, si->qseqlen);
+      const int needed = si->qseqlen + db_getlongestsequence() + 1;
+      if (si->diag_alloc < needed)
+        {
+          si->diag_alloc = needed;
+          si->diags = (int *) xrealloc(si->diags, needed * sizeof(int));
+          si->cover = (int *) xrealloc(si->cover, needed * sizeof(int));
+        }
+    }
+
   /* extract unique kmer samples from query*/
   unique_count(si->uh, opt_wordlength,
                si->qseqlen, si->qsequence,
@@ -742,6 +1352,18 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
   /* find database sequences with the most kmer hits */
   search_topscores(si);
 
+  if (dbindex_duprep)
+    {
+      search_expand_duplicates(si);
+    }
+
+  if (opt_approx && search_approx(si))
+    {
+      delete si->lma;
+      xfree(scorematrix);
+      return;
+    }
+
   /* analyse targets with the highest number of kmer hits */
   si->accepts = 0;
   si->rejects = 0;
@@ -768,7 +1390,8 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
       hit->nwalignment = nullptr;
 
       /* Test some accept/reject criteria before alignment */
-      if (search_acceptable_unaligned(si, e.seqno))
+      if (search_acceptable_unaligned(si, e.seqno) &&
+          ((! si->kh) || search_diagonal_possible(si, e.seqno)))
         {
           delayed++;
         }
@@ -893,7 +1516,7 @@ void search_joinhits(struct searchinfo_s * si_p,
             {
               hits[a++] = *h;
             }
-          else if (h->aligned)
+          else if (h->nwalignment)
             {
               xfree(h->nwalignment);
             }
@@ -140,6 +140,11 @@ struct searchinfo_s
   int rejects;                  /* number of rejects */
   minheap_t * m;                /* min heap with the top kmer db seqs */
   int finalized;
+  struct kh_handle_s * kh;      /* query kmers for the diagonal filter */
+  int diag_alloc;               /* number of elements in diags and cover */
+  int * diags;                  /* kmer matches on each diagonal */
+  int * cover;                  /* query positions covered by kmer matches */
+  bool counts_only;             /* no alignment strings are needed */
 };
 
 void search_topscores(struct searchinfo_s * si);
@@ -159,6 +164,9 @@ auto search_acceptable_aligned(struct searchinfo_s * si,
                                struct hit * hit) -> bool;
 
 void align_trim(struct hit * hit);
+void align_trim_counted(struct hit * hit, unsigned short * trims);
+
+int hit_compare_byid(const void * a, const void * b);
 
 void search_joinhits(struct searchinfo_s * si_p,
                      struct searchinfo_s * si_m,
@@ -0,0 +1,702 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2021, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+
+/*
+  Sharded database search.
+
+  With --db_shard i/N only every N'th sequence (starting with the i'th)
+  of the database is read and indexed. The sequences are numbered
+  before sharding, so the shard may translate its local target numbers
+  back into the numbers the sequences would have had in the complete
+  database. With --shardout, the accepted hits for each query are
+  written to a binary file, together with the query and target labels
+  and the alignment statistics needed for the final output.
+
+  The --merge_shards command reads the files from all N shards in
+  parallel, one query at a time, and performs a k-way merge of the hit
+  lists of each query, ordered with the same comparison function
+  (hit_compare_byid) as used when joining hits in an ordinary search.
+  The top hits are then written in blast6out or uc format in the
+  original order of the queries.
+
+  The queries are numbered consecutively from zero, but written to a
+  shard file in order of completion, which may differ slightly from
+  the input order when several threads are used. A cursor on each
+  shard file therefore keeps the few queries it had to read ahead
+  until they are needed, so only a small part of each file is in
+  memory at any time.
+*/
+
+constexpr uint32_t shard_magic = 0x56534844;
+constexpr uint32_t shard_version = 1;
+
+static uint64_t shard_index = 0;
+static uint64_t shard_count = 1;
+
+struct shard_hit_s
+{
+  struct hit h;                 /* must be first, used by hit_compare_byid */
+  uint64_t target_len;
+  char * target_head;
+};
+
+struct shard_query_s
+{
+  int query_no;
+  int qseqlen;
+  char * query_head;
+  int hit_count;
+  struct shard_hit_s * hits;
+};
+
+struct shard_cursor_s
+{
+  FILE * fp;
+  uint64_t index;
+  uint64_t count;
+  int64_t pending_count;
+  int64_t pending_alloc;
+  struct shard_query_s * pending;
+};
+
+void shard_init()
+{
+  if (! opt_db_shard)
+    {
+      shard_index = 0;
+      shard_count = 1;
+      return;
+    }
+
+  char * end = nullptr;
+  int64_t i = strtoll(opt_db_shard, & end, 10);
+  int64_t n = 0;
+  if (end && (*end == '/'))
+    {
+      char * start = end + 1;
+      n = strtoll(start, & end, 10);
+      if (end == start)
+        {
+          n = 0;
+        }
+    }
+
+  if ((! end) || (*end) || (n < 1) || (i < 1) || (i > n))
+    {
+      fatal("The argument to --db_shard must be of the form i/N, "
+            "where 1 <= i <= N");
+    }
+
+  shard_index = i - 1;
+  shard_count = n;
+}
+
+bool shard_select(uint64_t ordinal)
+{
+  return (ordinal % shard_count) == shard_index;
+}
+
+uint64_t shard_global_seqno(uint64_t seqno)
+{
+  return seqno * shard_count + shard_index;
+}
+
+static void shard_put(FILE * fp, const void * buf, size_t size)
+{
+  if (size && (fwrite(buf, 1, size, fp) != size))
+    {
+      fatal("Unable to write to shard output file");
+    }
+}
+
+static void shard_put_uint32(FILE * fp, uint32_t x)
+{
+  shard_put(fp, & x, sizeof(x));
+}
+
+static void shard_put_string(FILE * fp, const char * s)
+{
+  uint32_t len = s ? strlen(s) : 0;
+  shard_put_uint32(fp, len);
+  shard_put(fp, s, len);
+}
+
+FILE * shard_open_output(const char * filename)
+{
+  FILE * fp = checkpoint_fopen_output(filename);
+  if (! fp)
+    {
+      fatal("Unable to open shard output file for writing");
+    }
+
+  if (! checkpoint_resuming())
+    {
+      shard_put_uint32(fp, shard_magic);
+      shard_put_uint32(fp, shard_version);
+      shard_put_uint32(fp, shard_index);
+      shard_put_uint32(fp, shard_count);
+    }
+
+  return fp;
+}
+
+void shard_write_query(FILE * fp,
+                       int query_no,
+                       char * query_head,
+                       int qseqlen,
+                       struct hit * hits,
+                       int hit_count)
+{
+  /* called with the output mutex held */
+
+  shard_put_uint32(fp, query_no);
+  shard_put_uint32(fp, qseqlen);
+  shard_put_string(fp, query_head);
+  shard_put_uint32(fp, hit_count);
+
+  for(int i = 0; i < hit_count; i++)
+    {
+      struct hit * hp = hits + i;
+      shard_put_uint32(fp, shard_global_seqno(hp->target));
+      shard_put_uint32(fp, db_getsequencelen(hp->target));
+      shard_put_string(fp, db_getheader(hp->target));
+      shard_put_uint32(fp, hp->strand);
+      shard_put(fp, & hp->id, sizeof(hp->id));
+      shard_put_uint32(fp, hp->matches);
+      shard_put_uint32(fp, hp->mismatches);
+      shard_put_uint32(fp, hp->nwalignmentlength);
+      shard_put_uint32(fp, hp->internal_alignmentlength);
+      shard_put_uint32(fp, hp->internal_gaps);
+      shard_put_string(fp, hp->nwalignment);
+    }
+}
+
+static bool shard_get(FILE * fp, void * buf, size_t size, bool eof_ok)
+{
+  size_t got = fread(buf, 1, size, fp);
+  if (got == size)
+    {
+      return true;
+    }
+  if (eof_ok && (got == 0) && feof(fp))
+    {
+      return false;
+    }
+  fatal("Truncated or corrupt shard file");
+  return false;
+}
+
+static uint32_t shard_get_uint32(FILE * fp)
+{
+  uint32_t x = 0;
+  shard_get(fp, & x, sizeof(x), false);
+  return x;
+}
+
+static char * shard_get_string(FILE * fp)
+{
+  uint32_t len = shard_get_uint32(fp);
+  auto * s = (char *) xmalloc(len + 1);
+  if (len)
+    {
+      shard_get(fp, s, len, false);
+    }
+  s[len] = 0;
+  return s;
+}
+
+static bool shard_read_query(FILE * fp, struct shard_query_s * q)
+{
+  uint32_t query_no = 0;
+  if (! shard_get(fp, & query_no, sizeof(query_no), true))
+    {
+      return false;
+    }
+
+  q->query_no = query_no;
+  q->qseqlen = shard_get_uint32(fp);
+  q->query_head = shard_get_string(fp);
+  q->hit_count = shard_get_uint32(fp);
+  q->hits = (struct shard_hit_s *)
+    xmalloc(q->hit_count * sizeof(struct shard_hit_s));
+
+  for(int i = 0; i < q->hit_count; i++)
+    {
+      struct shard_hit_s * sh = q->hits + i;
+      struct hit * hp = & sh->h;
+      memset(hp, 0, sizeof(struct hit));
+      hp->target = shard_get_uint32(fp);
+      sh->target_len = shard_get_uint32(fp);
+      sh->target_head = shard_get_string(fp);
+      hp->strand = shard_get_uint32(fp);
+      shard_get(fp, & hp->id, sizeof(hp->id), false);
+      hp->matches = shard_get_uint32(fp);
+      hp->mismatches = shard_get_uint32(fp);
+      hp->nwalignmentlength = shard_get_uint32(fp);
+      hp->internal_alignmentlength = shard_get_uint32(fp);
+      hp->internal_gaps = shard_get_uint32(fp);
+      hp->nwalignment = shard_get_string(fp);
+      hp->accepted = true;
+      hp->aligned = true;
+    }
+
+  return true;
+}
+
+static void shard_free_query(struct shard_query_s * q)
+{
+  for(int h = 0; h < q->hit_count; h++)
+    {
+      xfree(q->hits[h].target_head);
+      xfree(q->hits[h].h.nwalignment);
+    }
+  xfree(q->hits);
+  xfree(q->query_head);
+}
+
+static void shard_cursor_open(const char * filename,
+                              struct shard_cursor_s * c)
+{
+  c->fp = fopen_input(filename);
+  if (! c->fp)
+    {
+      fatal("Unable to open shard file (%s) for reading", filename);
+    }
+
+  uint32_t header[4];
+  shard_get(c->fp, header, sizeof(header), false);
+  if ((header[0] != shard_magic) || (header[1] != shard_version))
+    {
+      fatal("Not a shard file or unsupported version (%s)", filename);
+    }
+
+  c->index = header[2];
+  c->count = header[3];
+  c->pending_count = 0;
+  c->pending_alloc = 0;
+  c->pending = nullptr;
+}
+
+static bool shard_cursor_take(struct shard_cursor_s * c,
+                              int query_no,
+                              struct shard_query_s * q)
+{
+  /*
+    Get the query with the given number, reading ahead as far as
+    necessary. Returns false at the end of the file.
+  */
+
+  for(int64_t j = 0; j < c->pending_count; j++)
+    {
+      if (c->pending[j].query_no == query_no)
+        {
+          *q = c->pending[j];
+          c->pending_count--;
+          c->pending[j] = c->pending[c->pending_count];
+          return true;
+        }
+    }
+
+  while (shard_read_query(c->fp, q))
+    {
+      if (q->query_no == query_no)
+        {
+          return true;
+        }
+
+      if (q->query_no < query_no)
+        {
+          fatal("Corrupt shard file");
+        }
+
+      if (c->pending_count >= c->pending_alloc)
+        {
+          c->pending_alloc += 64;
+          c->pending = (struct shard_query_s *)
+            xrealloc(c->pending,
+                     c->pending_alloc * sizeof(struct shard_query_s));
+        }
+      c->pending[c->pending_count++] = *q;
+    }
+
+  return false;
+}
+
+static void shard_show_blast6out(FILE * fp,
+                                 struct shard_query_s * q,
+                                 struct shard_hit_s * sh)
+{
+  /* same format as results_show_blast6out_one */
+
+  if (sh)
+    {
+      struct hit * hp = & sh->h;
+      fprintf(fp,
+              "%s\t%s\t%.1f\t%d\t%d\t%d\t%d\t%d\t%d\t%" PRIu64 "\t%d\t%d\n",
+              q->query_head,
+              sh->target_head,
+              hp->id,
+              hp->internal_alignmentlength,
+              hp->mismatches,
+              hp->internal_gaps,
+              hp->strand ? q->qseqlen : 1,
+              hp->strand ? 1 : q->qseqlen,
+              1,
+              sh->target_len,
+              -1,
+              0);
+    }
+  else
+    {
+      fprintf(fp, "%s\t*\t0.0\t0\t0\t0\t0\t0\t0\t0\t-1\t0\n", q->query_head);
+    }
+}
+
+static void shard_show_uc(FILE * fp,
+                          struct shard_query_s * q,
+                          struct shard_hit_s * sh)
+{
+  /* same format as results_show_uc_one for usearch_global */
+
+  if (sh)
+    {
+      struct hit * hp = & sh->h;
+      bool perfect = (hp->matches == hp->nwalignmentlength);
+      fprintf(fp,
+              "H\t%d\t%d\t%.1f\t%c\t0\t0\t%s\t",
+              hp->target,
+              q->qseqlen,
+              hp->id,
+              hp->strand ? '-' : '+',
+              perfect ? "=" : hp->nwalignment);
+      header_fprint_strip(fp,
+                          q->query_head,
+                          strlen(q->query_head),
+                          opt_xsize,
+                          opt_xee,
+                          opt_xlength);
+      fprintf(fp, "\t");
+      header_fprint_strip(fp,
+                          sh->target_head,
+                          strlen(sh->target_head),
+                          opt_xsize,
+                          opt_xee,
+                          opt_xlength);
+      fprintf(fp, "\n");
+    }
+  else
+    {
+      fprintf(fp, "N\t*\t*\t*\t.\t*\t*\t*\t%s\t*\n", q->query_head);
+    }
+}
+
+void merge_shards()
+{
+  FILE * fp_blast6out = nullptr;
+  FILE * fp_uc = nullptr;
+
+  if (opt_blast6out)
+    {
+      fp_blast6out = fopen_output(opt_blast6out);
+      if (! fp_blast6out)
+        {
+          fatal("Unable to open blast6-like output file for writing");
+        }
+    }
+
+  if (opt_uc)
+    {
+      fp_uc = fopen_output(opt_uc);
+      if (! fp_uc)
+        {
+          fatal("Unable to open uc output file for writing");
+        }
+    }
+
+  /* split comma separated list of shard files */
+
+  char * list = xstrdup(opt_merge_shards);
+  int file_count = 1;
+  for(char * p = list; *p; p++)
+    {
+      if (*p == ',')
+        {
+          file_count++;
+        }
+    }
+
+  auto * cursors = (struct shard_cursor_s *)
+    xmalloc(file_count * sizeof(struct shard_cursor_s));
+
+  char * filename = list;
+  for(int f = 0; f < file_count; f++)
+    {
+      char * comma = xstrchrnul(filename, ',');
+      *comma = 0;
+      shard_cursor_open(filename, cursors + f);
+      filename = comma + 1;
+    }
+  xfree(list);
+
+  /* check that each shard is present exactly once */
+
+  auto * seen = (bool *) xmalloc(file_count * sizeof(bool));
+  memset(seen, 0, file_count * sizeof(bool));
+  for(int f = 0; f < file_count; f++)
+    {
+      if (cursors[f].count != (uint64_t) file_count)
+        {
+          fatal("The number of shard files does not match the number of shards");
+        }
+      if (cursors[f].index >= cursors[f].count)
+        {
+          fatal("Corrupt shard file");
+        }
+      if (seen[cursors[f].index])
+        {
+          fatal("The same shard is specified more than once");
+        }
+      seen[cursors[f].index] = true;
+    }
+  xfree(seen);
+
+  /* progress is measured on the first shard file */
+
+  xstat_t fs;
+  uint64_t shard_size = 0;
+  if (xfstat(fileno(cursors[0].fp), & fs) == 0)
+    {
+      shard_size = fs.st_size;
+    }
+
+  int64_t maxaccepts = opt_maxaccepts ? opt_maxaccepts : LONG_MAX;
+  auto * fqs = (struct shard_query_s *)
+    xmalloc(file_count * sizeof(struct shard_query_s));
+  auto * pos = (int *) xmalloc(file_count * sizeof(int));
+  int64_t queries = 0;
+  int64_t qmatches = 0;
+
+  progress_init("Merging hits", shard_size);
+  while (true)
+    {
+      bool found = shard_cursor_take(cursors + 0, queries, fqs + 0);
+      for(int f = 1; f < file_count; f++)
+        {
+          if (shard_cursor_take(cursors + f, queries, fqs + f) != found)
+            {
+              fatal("The shard files contain different numbers of queries");
+            }
+        }
+
+      if (! found)
+        {
+          break;
+        }
+
+      struct shard_query_s * q = fqs + 0;
+
+      for(int f = 0; f < file_count; f++)
+        {
+          pos[f] = 0;
+        }
+
+      /* k-way merge of the sorted hit lists, respecting maxaccepts
+         per strand, as in an unsharded search */
+
+      int64_t accepts[2] = { 0, 0 };
+      int64_t reported = 0;
+      double top_hit_id = 0.0;
+
+      while (reported < opt_maxhits)
+        {
+          struct shard_hit_s * best = nullptr;
+          int best_f = -1;
+          for(int f = 0; f < file_count; f++)
+            {
+              struct shard_query_s * fq = fqs + f;
+              while ((pos[f] < fq->hit_count) &&
+                     (accepts[fq->hits[pos[f]].h.strand] >= maxaccepts))
+                {
+                  pos[f]++;
+                }
+              if (pos[f] < fq->hit_count)
+                {
+                  struct shard_hit_s * sh = fq->hits + pos[f];
+                  if ((! best) || (hit_compare_byid(sh, best) < 0))
+                    {
+                      best = sh;
+                      best_f = f;
+                    }
+                }
+            }
+
+          if (! best)
+            {
+              break;
+            }
+
+          pos[best_f]++;
+          accepts[best->h.strand]++;
+
+          if (reported == 0)
+            {
+              top_hit_id = best->h.id;
+            }
+          else if (opt_top_hits_only && (best->h.id < top_hit_id))
+            {
+              break;
+            }
+
+          if (fp_uc && ((reported == 0) || opt_uc_allhits))
+            {
+              shard_show_uc(fp_uc, q, best);
+            }
+
+          if (fp_blast6out)
+            {
+              shard_show_blast6out(fp_blast6out, q, best);
+            }
+
+          reported++;
+        }
+
+      if (reported)
+        {
+          qmatches++;
+        }
+      else
+        {
+          if (fp_uc)
+            {
+              shard_show_uc(fp_uc, q, nullptr);
+            }
+          if (fp_blast6out && opt_output_no_hits)
+            {
+              shard_show_blast6out(fp_blast6out, q, nullptr);
+            }
+        }
+
+      for(int f = 0; f < file_count; f++)
+        {
+          shard_free_query(fqs + f);
+        }
+
+      queries++;
+      progress_update(xftello(cursors[0].fp));
+    }
+  progress_done();
+
+  /* queries left behind were not numbered consecutively */
+
+  for(int f = 0; f < file_count; f++)
+    {
+      if (cursors[f].pending_count)
+        {
+          fatal("Corrupt shard file");
+        }
+    }
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Matching unique query sequences: %" PRId64 " of %"
+              PRId64, qmatches, queries);
+      if (queries > 0)
+        {
+          fprintf(stderr, " (%.2f%%)", 100.0 * qmatches / queries);
+        }
+      fprintf(stderr, "\n");
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Matching unique query sequences: %" PRId64 " of %"
+              PRId64, qmatches, queries);
+      if (queries > 0)
+        {
+          fprintf(fp_log, " (%.2f%%)", 100.0 * qmatches / queries);
+        }
+      fprintf(fp_log, "\n");
+    }
+
+  /* clean up */
+
+  xfree(pos);
+  xfree(fqs);
+  for(int f = 0; f < file_count; f++)
+    {
+      fclose(cursors[f].fp);
+      if (cursors[f].pending)
+        {
+          xfree(cursors[f].pending);
+        }
+    }
+  xfree(cursors);
+
+  if (fp_uc)
+    {
+      fclose(fp_uc);
+    }
+  if (fp_blast6out)
+    {
+      fclose(fp_blast6out);
+    }
+}
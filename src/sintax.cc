@@ -86,7 +86,7 @@ static pthread_attr_t attr;
 static fastx_handle query_fastx_h;
 
 const int subset_size = 32;
-const int bootstrap_count = 100;
+const int bootstrap_count = sintax_bootstrap_count;
 
 /* global data protected by mutex */
 static pthread_mutex_t mutex_input;
@@ -96,6 +96,50 @@ static int queries = 0;
 static int classified = 0;
 
 
+void sintax_levels(int best_seqno,
+                   int * all_seqno,
+                   int count,
+                   int * best_level_start,
+                   int * best_level_len,
+                   int * level_match)
+{
+  /* split the best hit into taxonomic levels and count how many of
+     the bootstrap hits agree with it at each level */
+
+  char * best_h = db_getheader(best_seqno);
+
+  tax_split(best_seqno, best_level_start, best_level_len);
+
+  for (int j = 0; j < tax_levels; j++)
+    {
+      level_match[j] = 0;
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      /* For each bootstrap experiment */
+
+      int level_start[tax_levels];
+      int level_len[tax_levels];
+      tax_split(all_seqno[i], level_start, level_len);
+
+      char * h = db_getheader(all_seqno[i]);
+
+      for (int j = 0; j < tax_levels; j++)
+        {
+          /* For each taxonomic level */
+
+          if ((level_len[j] == best_level_len[j]) &&
+              (strncmp(best_h + best_level_start[j],
+                       h + level_start[j],
+                       level_len[j]) == 0))
+            {
+              level_match[j]++;
+            }
+        }
+    }
+}
+
 void sintax_analyse(char * query_head,
                     int strand,
                     int best_seqno,
@@ -110,39 +154,8 @@ void sintax_analyse(char * query_head,
   /* check number of successful bootstraps */
   if (count >= (bootstrap_count+1) / 2)
     {
-      char * best_h = db_getheader(best_seqno);
-
-      tax_split(best_seqno, best_level_start, best_level_len);
-
-      for (int & j :
-             level_match)
-        {
-          j = 0;
-        }
-
-      for (int i = 0; i < count; i++)
-        {
-          /* For each bootstrap experiment */
-
-          int level_start[tax_levels];
-          int level_len[tax_levels];
-          tax_split(all_seqno[i], level_start, level_len);
-
-          char * h = db_getheader(all_seqno[i]);
-
-          for (int j = 0; j < tax_levels; j++)
-            {
-              /* For each taxonomic level */
-
-              if ((level_len[j] == best_level_len[j]) &&
-                  (strncmp(best_h + best_level_start[j],
-                           h + level_start[j],
-                           level_len[j]) == 0))
-                {
-                  level_match[j]++;
-                }
-            }
-        }
+      sintax_levels(best_seqno, all_seqno, count,
+                    best_level_start, best_level_len, level_match);
     }
 
   /* write to tabbedout file */
@@ -212,23 +225,32 @@ void sintax_analyse(char * query_head,
 #endif
 
   fprintf(fp_tabbedout, "\n");
+  stream_flush_due();
   xpthread_mutex_unlock(&mutex_output);
 }
 
-void sintax_query(int64_t t)
+void sintax_search(struct searchinfo_s * si_p,
+                   struct searchinfo_s * si_m,
+                   int * strand,
+                   int * best_seqno_out,
+                   int * best_count_out,
+                   int * all_seqno_out,
+                   int * count_out)
 {
+  /* run the bootstrap searches of one query on one or both strands
+     and report the hits of the best strand */
+
   int all_seqno[2][bootstrap_count];
   int best_seqno[2] = {0, 0};
   int boot_count[2] = {0, 0};
   unsigned int best_count[2] = {0, 0};
-  int qseqlen = si_plus[t].qseqlen;
-  char * query_head = si_plus[t].query_head;
+  int qseqlen = si_p->qseqlen;
 
   bitmap_t * b = bitmap_init(qseqlen);
 
   for (int s = 0; s < opt_strand; s++)
     {
-      struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+      struct searchinfo_s * si = s ? si_m : si_p;
 
       /* perform search */
 
@@ -310,16 +332,42 @@ void sintax_query(int64_t t)
         }
     }
 
-  sintax_analyse(query_head,
-                 best_strand,
-                 best_seqno[best_strand],
-                 best_count[best_strand],
-                 all_seqno[best_strand],
-                 boot_count[best_strand]);
+  * strand = best_strand;
+  * best_seqno_out = best_seqno[best_strand];
+  * best_count_out = best_count[best_strand];
+  * count_out = boot_count[best_strand];
+  for (int i = 0; i < boot_count[best_strand]; i++)
+    {
+      all_seqno_out[i] = all_seqno[best_strand][i];
+    }
 
   bitmap_free(b);
 }
 
+void sintax_query(int64_t t)
+{
+  int all_seqno[bootstrap_count];
+  int best_strand = 0;
+  int best_seqno = 0;
+  int best_count = 0;
+  int count = 0;
+
+  sintax_search(si_plus + t,
+                opt_strand > 1 ? si_minus + t : nullptr,
+                & best_strand,
+                & best_seqno,
+                & best_count,
+                all_seqno,
+                & count);
+
+  sintax_analyse(si_plus[t].query_head,
+                 best_strand,
+                 best_seqno,
+                 best_count,
+                 all_seqno,
+                 count);
+}
+
 void sintax_thread_run(int64_t t)
 {
   while (true)
@@ -473,32 +521,12 @@ void sintax_thread_worker_run()
   xpthread_attr_destroy(&attr);
 }
 
-void sintax()
+void sintax_prep_db()
 {
   /* tophits = the maximum number of hits we need to store */
 
   tophits = 1;
 
-  /* open output files */
-
-  if (! opt_db)
-    {
-      fatal("No database file specified with --db");
-    }
-
-  if (opt_tabbedout)
-    {
-      fp_tabbedout = fopen_output(opt_tabbedout);
-      if (! fp_tabbedout)
-        {
-          fatal("Unable to open tabbedout output file for writing");
-        }
-    }
-  else
-    {
-      fatal("No output file specified with --tabbedout");
-    }
-
   /* check if db may be an UDB file */
 
   bool is_udb = udb_detect_isudb(opt_db);
@@ -520,6 +548,36 @@ void sintax()
       dbindex_addallsequences(opt_dbmask);
     }
 
+  /* each thread needs word counts for each strand */
+
+  budget_threads(0, opt_strand * seqcount * sizeof(count_t));
+}
+
+void sintax()
+{
+  /* open output files */
+
+  if (! opt_db)
+    {
+      fatal("No database file specified with --db");
+    }
+
+  if (opt_tabbedout)
+    {
+      fp_tabbedout = fopen_output(opt_tabbedout);
+      if (! fp_tabbedout)
+        {
+          fatal("Unable to open tabbedout output file for writing");
+        }
+      stream_add(fp_tabbedout);
+    }
+  else
+    {
+      fatal("No output file specified with --tabbedout");
+    }
+
+  sintax_prep_db();
+
   /* prepare reading of queries */
 
   query_fastx_h = fastx_open(opt_sintax);
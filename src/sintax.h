@@ -58,5 +58,24 @@
 
 */
 
+const int sintax_bootstrap_count = 100;
+
+void sintax_prep_db();
+void sintax_thread_init(struct searchinfo_s * si);
+void sintax_thread_exit(struct searchinfo_s * si);
+void sintax_search(struct searchinfo_s * si_p,
+                   struct searchinfo_s * si_m,
+                   int * strand,
+                   int * best_seqno,
+                   int * best_count,
+                   int * all_seqno,
+                   int * count);
+void sintax_levels(int best_seqno,
+                   int * all_seqno,
+                   int count,
+                   int * best_level_start,
+                   int * best_level_len,
+                   int * level_match);
+
 void sintax();
 
@@ -67,6 +67,7 @@ static unsigned int udb_dbaccel = 0;
 typedef struct wordfreq
 {
   unsigned int kmer;
+  unsigned int slot;
   unsigned int count;
 } wordfreq_t;
 
@@ -193,6 +194,33 @@ auto udb_detect_isudb(const char * filename) -> bool
   return false;
 }
 
+bool udb_valid_pattern(unsigned int span,
+                       unsigned int bits,
+                       unsigned int wordlength)
+{
+  /* a span of zero means contiguous words */
+
+  if (span == 0)
+    {
+      return (bits == 0);
+    }
+
+  return ((span <= 32) &&
+          (span > wordlength) &&
+          ((span == 32) || ((bits >> span) == 0)) &&
+          (bits & 1U) &&
+          (bits & (1U << (span - 1))) &&
+          ((unsigned int) __builtin_popcount(bits) == wordlength));
+}
+
+void udb_fprint_pattern(FILE * f, unsigned int span, unsigned int bits)
+{
+  for(unsigned int i = 0; i < span; i++)
+    {
+      fputc((bits & (1U << i)) ? '1' : '0', f);
+    }
+}
+
 void udb_info()
 {
   /* Read UDB header and show basic info */
@@ -230,7 +258,25 @@ void udb_info()
       fprintf(stderr, "     SeqIx bits  %u\n", buffer[2]);
       fprintf(stderr, "          Alpha  nt (4)\n");
       fprintf(stderr, "     Word width  %u\n", buffer[4]);
+      if (buffer[7])
+        {
+          fprintf(stderr, "        Pattern  ");
+          udb_fprint_pattern(stderr, buffer[7], buffer[8]);
+          fprintf(stderr, "\n");
+        }
       fprintf(stderr, "          Slots  %u\n", buffer[11]);
+      if (buffer[15])
+        {
+          fprintf(stderr, "         Groups  %u\n", buffer[15]);
+        }
+      if (buffer[21])
+        {
+          fprintf(stderr, "         Layout  index order\n");
+        }
+      if (buffer[19])
+        {
+          fprintf(stderr, "     Duplicates  %u\n", buffer[19]);
+        }
       fprintf(stderr, "      Dict size  %u (%.1fk)\n",
               (1 << (2 * buffer[4])),
               (1 << (2 * buffer[4])) * 1.0 / 1000.0);
@@ -244,7 +290,25 @@ void udb_info()
       fprintf(fp_log, "     SeqIx bits  %u\n", buffer[2]);
       fprintf(fp_log, "          Alpha  nt (4)\n");
       fprintf(fp_log, "     Word width  %u\n", buffer[4]);
+      if (buffer[7])
+        {
+          fprintf(fp_log, "        Pattern  ");
+          udb_fprint_pattern(fp_log, buffer[7], buffer[8]);
+          fprintf(fp_log, "\n");
+        }
       fprintf(fp_log, "          Slots  %u\n", buffer[11]);
+      if (buffer[15])
+        {
+          fprintf(fp_log, "         Groups  %u\n", buffer[15]);
+        }
+      if (buffer[21])
+        {
+          fprintf(fp_log, "         Layout  index order\n");
+        }
+      if (buffer[19])
+        {
+          fprintf(fp_log, "     Duplicates  %u\n", buffer[19]);
+        }
       fprintf(fp_log, "      Dict size  %u (%.1fk)\n",
               (1 << (2 * buffer[4])),
               (1 << (2 * buffer[4])) * 1.0 / 1000.0);
@@ -320,6 +384,26 @@ void udb_read(const char * filename,
   udb_wordlength = buffer[4];
   seqcount = buffer[13];
   udb_dbaccel = buffer[6];
+  unsigned int udb_groups = buffer[15];
+  unsigned int udb_dupcount = buffer[19];
+  unsigned int udb_layout = buffer[21];
+
+  if ((udb_groups > seqcount) || (udb_dupcount >= seqcount) ||
+      (udb_groups && udb_dupcount) ||
+      (udb_layout > 1) || (udb_layout && udb_dupcount))
+    {
+      fatal("Invalid UDB file");
+    }
+
+  if (udb_dupcount && create_bitmaps && ! opt_usearch_global)
+    {
+      fatal("UDB files with duplicate sequences removed can only be used with --usearch_global");
+    }
+
+  if (! udb_valid_pattern(buffer[7], buffer[8], udb_wordlength))
+    {
+      fatal("Invalid UDB file");
+    }
 
   if (udb_wordlength != opt_wordlength)
     {
@@ -327,23 +411,60 @@ void udb_read(const char * filename,
       opt_wordlength = udb_wordlength;
     }
 
+  unsigned int pattern_bits = 0;
+  if ((unique_get_pattern(& pattern_bits) != buffer[7]) ||
+      (pattern_bits != buffer[8]))
+    {
+      fprintf(stderr, "\nWARNING: Word pattern adjusted as indicated in UDB file\n");
+      unique_set_pattern(buffer[7], buffer[8]);
+    }
+
   /* word match counts */
 
-  kmerhashsize = 1 << (2 * udb_wordlength);
-  kmercount = (unsigned int*) xmalloc(kmerhashsize * sizeof(unsigned int));
-  kmerhash = (uint64_t *) xmalloc(kmerhashsize * sizeof(uint64_t));
-  kmerbitmap = (bitmap_t * *) xmalloc(kmerhashsize * sizeof(bitmap_t**));
+  /*
+    A hashed directory is flagged separately, as files from other
+    programs may have any number in the slots field, which is then
+    ignored.
+  */
+
+  unsigned int udb_slots = (buffer[23] == 1) ? buffer[11] : 0;
 
-  memset(kmerbitmap, 0, kmerhashsize * sizeof(bitmap_t**));
+  if (udb_slots)
+    {
+      if ((udb_slots & (udb_slots - 1)) ||
+          (udb_slots < 1024) ||
+          (udb_slots >= (1U << (2 * udb_wordlength))))
+        {
+          fatal("Invalid UDB file");
+        }
+      dbindex_slots_init(udb_slots);
+    }
+  else
+    {
+      kmerhashsize = 1 << (2 * udb_wordlength);
+    }
+
+  kmercount = (unsigned int*) xmalloc((kmerhashsize+1) * sizeof(unsigned int));
+  kmerhash = (uint64_t *) xmalloc((kmerhashsize+1) * sizeof(uint64_t));
+  kmerbitmap = (bitmap_t * *) xmalloc((kmerhashsize+1) * sizeof(bitmap_t**));
+
+  memset(kmerbitmap, 0, (kmerhashsize+1) * sizeof(bitmap_t**));
 
   pos += largeread(fd_udb, kmercount, 4 * kmerhashsize, pos);
 
+  if (udb_slots)
+    {
+      pos += largeread(fd_udb, kmerslots, 4 * kmerhashsize, pos);
+    }
+
   kmerindexsize = 0;
   for(uint64_t i = 0; i < kmerhashsize; i++)
     {
       kmerhash[i] = kmerindexsize;
       kmerindexsize += kmercount[i];
     }
+  kmercount[kmerhashsize] = 0;
+  kmerhash[kmerhashsize] = kmerindexsize;
 
   /* signature */
 
@@ -463,6 +584,69 @@ void udb_read(const char * filename,
 
   pos += largeread(fd_udb, datap + udb_headerchars, nucleotides, pos);
 
+  /* index order of a two-level index or of a similarity layout */
+
+  dbindex_map = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
+  dbindex_count = seqcount;
+
+  if (udb_groups || udb_layout)
+    {
+      pos += largeread(fd_udb, buffer, 4, pos);
+
+      if (buffer[0] != 0x55444235)
+        {
+          fatal("Invalid UDB file");
+        }
+
+      pos += largeread(fd_udb, dbindex_map, 4 * seqcount, pos);
+
+      /* the map must be a permutation */
+
+      bitmap_t * seen = bitmap_init(seqcount);
+      bitmap_reset_all(seen);
+      for (unsigned int i = 0; i < seqcount; i++)
+        {
+          if ((dbindex_map[i] >= seqcount) || bitmap_get(seen, dbindex_map[i]))
+            {
+              fatal("Invalid UDB file");
+            }
+          bitmap_set(seen, dbindex_map[i]);
+        }
+      bitmap_free(seen);
+    }
+  else
+    {
+      for (unsigned int i = 0; i < seqcount; i++)
+        {
+          dbindex_map[i] = i;
+        }
+    }
+
+  /* groups of a two-level index */
+
+  if (udb_groups)
+    {
+      dbindex_groups = udb_groups;
+      dbindex_group_start =
+        (unsigned int *) xmalloc((udb_groups + 1) * sizeof(unsigned int));
+      pos += largeread(fd_udb, dbindex_group_start, 4 * (udb_groups + 1), pos);
+
+      /* the groups must be non-empty ranges */
+
+      if ((dbindex_group_start[0] != 0) ||
+          (dbindex_group_start[udb_groups] != seqcount))
+        {
+          fatal("Invalid UDB file");
+        }
+      for (unsigned int g = 0; g < udb_groups; g++)
+        {
+          if (dbindex_group_start[g] >= dbindex_group_start[g + 1])
+            {
+              fatal("Invalid UDB file");
+            }
+        }
+    }
+
   if (pos != filesize)
     {
       fatal("Incorrect UDB file size");
@@ -491,6 +675,19 @@ void udb_read(const char * filename,
   *(datap + seqindex[0].seq_p + seqindex[0].seqlen) = 0;
   progress_done();
 
+  /* sequences stored in index order: look them up by seqno */
+
+  if (udb_layout)
+    {
+      auto * stored = seqindex;
+      seqindex = (seqinfo_t *) xmalloc(seqcount * sizeof(seqinfo_t));
+      for (unsigned int i = 0; i < seqcount; i++)
+        {
+          seqindex[dbindex_map[i]] = stored[i];
+        }
+      xfree(stored);
+    }
+
   /* Create bitmaps for the most frequent words */
 
   if (create_bitmaps)
@@ -546,14 +743,22 @@ void udb_read(const char * filename,
              shortest,
              longestheader);
 
-  /* make mapping from indexno to seqno */
+  /* link the duplicates that were not indexed to their representative */
 
-  dbindex_map = (unsigned int *) xmalloc(seqcount * sizeof(unsigned int));
-  dbindex_count = seqcount;
+  if (udb_dupcount)
+    {
+      dbindex_dedup();
+      if (dbindex_dupcount != udb_dupcount)
+        {
+          fatal("Invalid UDB file");
+        }
+    }
 
-  for (unsigned int i = 0; i < seqcount; i++)
+  /* index the group representatives */
+
+  if (dbindex_groups)
     {
-      dbindex_map[i] = i;
+      dbindex_group_index(opt_dbmask);
     }
 
   /* done */
@@ -651,7 +856,8 @@ void udb_stats()
 
   for(unsigned int i = 0; i < kmerhashsize; i++)
     {
-      freqtable[i].kmer = i;
+      freqtable[i].kmer = kmerslots ? (kmerslots[i] ? kmerslots[i] - 1 : 0) : i;
+      freqtable[i].slot = i;
       freqtable[i].count = kmercount[i];
     }
 
@@ -666,13 +872,26 @@ void udb_stats()
 
   /* show stats */
 
+  unsigned int pattern_bits = 0;
+  unsigned int pattern_span = unique_get_pattern(& pattern_bits);
+
   if (opt_log)
     {
       fprintf(fp_log, "      Alphabet  nt\n");
-      fprintf(fp_log, "    Word width  %" PRIu64 "\n", opt_wordlength);
+      fprintf(fp_log, "    Word width  %" PRIu64 "\n",
+              pattern_span ? pattern_span : opt_wordlength);
       fprintf(fp_log, "     Word ones  %" PRIu64 "\n", opt_wordlength);
-      fprintf(fp_log, "        Spaced  No\n");
-      fprintf(fp_log, "        Hashed  No\n");
+      if (pattern_span)
+        {
+          fprintf(fp_log, "        Spaced  Yes (");
+          udb_fprint_pattern(fp_log, pattern_span, pattern_bits);
+          fprintf(fp_log, ")\n");
+        }
+      else
+        {
+          fprintf(fp_log, "        Spaced  No\n");
+        }
+      fprintf(fp_log, "        Hashed  %s\n", kmerslots ? "Yes" : "No");
       fprintf(fp_log, "         Coded  No\n");
       fprintf(fp_log, "       Stepped  No\n");
       fprintf(fp_log,
@@ -719,7 +938,7 @@ void udb_stats()
           for(unsigned j = 0; j < freqtable[kmerhashsize-1-i].count; j++)
             {
               fprintf(fp_log,
-                      " %u", kmerindex[kmerhash[freqtable[kmerhashsize-1-i].kmer]+j]);
+                      " %u", dbindex_getmapping(kmerindex[kmerhash[freqtable[kmerhashsize-1-i].slot]+j]));
 
               if (j == 7)
                 {
@@ -892,8 +1111,38 @@ void udb_make()
       hardmask_all();
     }
 
-  dbindex_prepare(1, opt_dbmask);
-  dbindex_addallsequences(opt_dbmask);
+  if (opt_db_dedup)
+    {
+      dbindex_dedup();
+    }
+
+  if (opt_group_id > 0.0)
+    {
+      /* group on a flat index without bitmaps, then index by group */
+      dbindex_prepare(0, opt_dbmask);
+      dbindex_addallsequences(opt_dbmask);
+      dbindex_group(opt_group_id, opt_dbmask);
+    }
+  else if (opt_similar_layout)
+    {
+      dbindex_prepare(1, opt_dbmask);
+      dbindex_addallsequences_similar(opt_dbmask);
+    }
+  else
+    {
+      dbindex_prepare(1, opt_dbmask);
+      dbindex_addallsequences(opt_dbmask);
+    }
+
+  /*
+    Store the headers and sequences in index order when the index
+    numbers differ from the sequence numbers, so that sequences with
+    adjacent index numbers are also adjacent in memory when the UDB
+    file is read. The map from index numbers to sequence numbers is
+    stored to restore the original order.
+  */
+
+  const bool layout = (dbindex_groups > 0) || opt_similar_layout;
 
   unsigned int seqcount = db_getsequencecount();
   uint64_t ntcount = db_getnucleotidecount();
@@ -904,8 +1153,6 @@ void udb_make()
       header_characters += db_getheaderlen(i) + 1;
     }
 
-  uint64_t kmerhashsize = 1 << (2 * opt_wordlength);
-
   /* count word matches */
   uint64_t wordmatches = 0;
   for(unsigned int i = 0; i < kmerhashsize; i++)
@@ -917,13 +1164,16 @@ void udb_make()
   uint64_t progress_all =
     4 * 50 +
     4 * kmerhashsize +
+    (kmerslots ? 4 * kmerhashsize : 0) +
     4 * 1 +
     4 * wordmatches +
     4 * 8 +
     4 * seqcount +
     header_characters +
     4 * seqcount +
-    ntcount;
+    ntcount +
+    (layout ? 4 * (1 + seqcount) : 0) +
+    (dbindex_groups ? 4 * (dbindex_groups + 1) : 0);
 
   progress_init("Writing UDB file", progress_all);
 
@@ -937,15 +1187,26 @@ void udb_make()
   buffer[4]  = opt_wordlength; /* default 8 */
   buffer[5]  = 1; /* dbstep */
   buffer[6]  = 100; /* dbaccelpct % */
-  buffer[11] = 0; /* slots */
+  buffer[7]  = unique_get_pattern(buffer + 8); /* pattern span and ones */
+  buffer[11] = kmerslots ? kmerhashsize : 0; /* slots, 0 if direct */
   buffer[13] = (unsigned int) seqcount; /* number of sequences */
+  buffer[15] = dbindex_groups; /* groups, 0 if flat */
+  buffer[19] = dbindex_dupcount; /* duplicates not indexed */
+  buffer[21] = layout ? 1 : 0; /* sequences stored in index order */
+  buffer[23] = kmerslots ? 1 : 0; /* slot table follows the word counts */
   buffer[17] = 0x0000746e; /* alphabet: "nt" */
   buffer[49] = 0x55444266; /* fBDU UDBf */
   pos += largewrite(fd_output, buffer, 50 * 4, 0);
 
-  /* write 4^wordlength uint32's with word match counts */
+  /* write 4^wordlength (or slots) uint32's with word match counts */
   pos += largewrite(fd_output, kmercount, 4 * kmerhashsize, pos);
 
+  /* write the slot table, kmer+1 in each used slot */
+  if (kmerslots)
+    {
+      pos += largewrite(fd_output, kmerslots, 4 * kmerhashsize, pos);
+    }
+
   /* 3BDU */
   buffer[0] = 0x55444233; /* 3BDU UDB3 */
   pos += largewrite(fd_output, buffer, 1 * 4, pos);
@@ -998,30 +1259,51 @@ void udb_make()
   unsigned int sum = 0;
   for (unsigned int i = 0; i < seqcount; i++)
     {
+      unsigned int seqno = layout ? dbindex_map[i] : i;
       buffer[i] = sum;
-      sum += db_getheaderlen(i) + 1;
+      sum += db_getheaderlen(seqno) + 1;
     }
   pos += largewrite(fd_output, buffer, 4 * seqcount, pos);
 
   /* headers (ascii, zero terminated, not padded) */
   for (unsigned int i = 0; i < seqcount; i++)
     {
-      unsigned int len = db_getheaderlen(i);
-      pos += largewrite(fd_output, db_getheader(i), len + 1, pos);
+      unsigned int seqno = layout ? dbindex_map[i] : i;
+      unsigned int len = db_getheaderlen(seqno);
+      pos += largewrite(fd_output, db_getheader(seqno), len + 1, pos);
     }
 
   /* sequence lengths (uint32) */
   for (unsigned int i = 0; i < seqcount; i++)
     {
-      buffer[i] = db_getsequencelen(i);
+      unsigned int seqno = layout ? dbindex_map[i] : i;
+      buffer[i] = db_getsequencelen(seqno);
     }
   pos += largewrite(fd_output, buffer, 4 * seqcount, pos);
 
   /* sequences (ascii, no term, no pad) */
   for (unsigned int i = 0; i < seqcount; i++)
     {
-      unsigned int len = db_getsequencelen(i);
-      pos += largewrite(fd_output, db_getsequence(i), len, pos);
+      unsigned int seqno = layout ? dbindex_map[i] : i;
+      unsigned int len = db_getsequencelen(seqno);
+      pos += largewrite(fd_output, db_getsequence(seqno), len, pos);
+    }
+
+  if (layout)
+    {
+      /* 5BDU */
+      buffer[0] = 0x55444235; /* 5BDU UDB5 */
+      pos += largewrite(fd_output, buffer, 1 * 4, pos);
+
+      /* seqno for each index no (uint32) */
+      pos += largewrite(fd_output, dbindex_map, 4 * seqcount, pos);
+    }
+
+  if (dbindex_groups)
+    {
+      /* first index no of each group, and the end (uint32) */
+      pos += largewrite(fd_output, dbindex_group_start,
+                        4 * (dbindex_groups + 1), pos);
     }
 
   if (close(fd_output) != 0)
@@ -87,6 +87,72 @@ struct uhandle_s
   uint64_t * bitmap;
 };
 
+/*
+  Spaced seed pattern. When a pattern is set, the words are made of
+  the nucleotides at the positions marked with a one in a window of
+  span positions, instead of k consecutive nucleotides. The runs of
+  consecutive ones are stored as shifts and masks into the 2-bit
+  encoded window, with the first position of the window in the most
+  significant bits. A span of zero means contiguous words.
+*/
+
+static unsigned int pattern_span = 0;
+static unsigned int pattern_bits = 0;
+static uint64_t pattern_window_mask = 0;
+static uint64_t pattern_ones_mask = 0;
+static int pattern_runs = 0;
+static unsigned int pattern_run_shift[16];
+static unsigned int pattern_run_length[16];
+static uint64_t pattern_run_mask[16];
+
+void unique_set_pattern(unsigned int span, unsigned int bits)
+{
+  /* bit i of bits is set if position i of the window is a one */
+
+  pattern_span = span;
+  pattern_bits = bits;
+  pattern_runs = 0;
+  pattern_ones_mask = 0;
+
+  if (span == 0)
+    {
+      return;
+    }
+
+  pattern_window_mask = (span == 32) ? ~0ULL : (1ULL << (2 * span)) - 1ULL;
+
+  unsigned int i = 0;
+  while (i < span)
+    {
+      if (bits & (1U << i))
+        {
+          unsigned int length = 0;
+          while ((i + length < span) && (bits & (1U << (i + length))))
+            {
+              length++;
+            }
+          unsigned int shift = 2 * (span - i - length);
+          uint64_t mask = (1ULL << (2 * length)) - 1ULL;
+          pattern_run_shift[pattern_runs] = shift;
+          pattern_run_length[pattern_runs] = 2 * length;
+          pattern_run_mask[pattern_runs] = mask;
+          pattern_ones_mask |= mask << shift;
+          pattern_runs++;
+          i += length;
+        }
+      else
+        {
+          i++;
+        }
+    }
+}
+
+unsigned int unique_get_pattern(unsigned int * bits)
+{
+  * bits = pattern_bits;
+  return pattern_span;
+}
+
 struct uhandle_s * unique_init()
 {
   auto * uh = (struct uhandle_s *) xmalloc(sizeof(struct uhandle_s));
@@ -317,6 +383,132 @@ void unique_count_hash(struct uhandle_s * uh,
   *list = uh->list;
 }
 
+void unique_count_spaced(struct uhandle_s * uh,
+                         int k,
+                         int seqlen,
+                         char * seq,
+                         unsigned int * listlen,
+                         unsigned int * * list,
+                         int seqmask)
+{
+  /* if necessary, reallocate hash table and list of unique kmers */
+
+  if (uh->alloc < 2*seqlen)
+    {
+      while (uh->alloc < 2*seqlen)
+        {
+          uh->alloc *= 2;
+        }
+      uh->hash = (struct bucket_s *)
+        xrealloc(uh->hash, sizeof(struct bucket_s) * uh->alloc);
+      uh->list = (unsigned int *)
+        xrealloc(uh->list, sizeof(unsigned int) * uh->alloc);
+    }
+
+  /* words shorter than 10 are kept track of in a bitmap, others in a hash */
+
+  bool use_bitmap = (k < 10);
+
+  if (use_bitmap)
+    {
+      uint64_t size = 1ULL << (k << 1ULL);
+      if (uh->bitmap_size < size)
+        {
+          uh->bitmap = (uint64_t *) xrealloc(uh->bitmap, size >> 3ULL);
+          uh->bitmap_size = size;
+        }
+      memset(uh->bitmap, 0, size >> 3ULL);
+    }
+  else
+    {
+      uh->size = 1;
+      while (uh->size < 2*seqlen)
+        {
+          uh->size *= 2;
+        }
+      uh->hash_mask = uh->size - 1;
+      memset(uh->hash, 0, sizeof(struct bucket_s) * uh->size);
+    }
+
+  uint64_t bad = 0;
+  uint64_t window = 0;
+  char * s = seq;
+  char * e1 = s + pattern_span - 1;
+  char * e2 = s + seqlen;
+  if (e2 < e1)
+    {
+      e1 = e2;
+    }
+
+  unsigned int * maskmap = (seqmask != MASK_NONE) ?
+    chrmap_mask_lower : chrmap_mask_ambig;
+
+  while (s < e1)
+    {
+      bad <<= 2ULL;
+      bad |= maskmap[(int)(*s)];
+
+      window <<= 2ULL;
+      window |= chrmap_2bit[(int)(*s++)];
+    }
+
+  unsigned int unique = 0;
+
+  while (s < e2)
+    {
+      bad <<= 2ULL;
+      bad |= maskmap[(int)(*s)];
+
+      window <<= 2ULL;
+      window |= chrmap_2bit[(int)(*s++)];
+      window &= pattern_window_mask;
+
+      /* only the positions of the ones need to be unambiguous */
+      if (bad & pattern_ones_mask)
+        {
+          continue;
+        }
+
+      unsigned int kmer = 0;
+      for(int r = 0; r < pattern_runs; r++)
+        {
+          kmer <<= pattern_run_length[r];
+          kmer |= (window >> pattern_run_shift[r]) & pattern_run_mask[r];
+        }
+
+      if (use_bitmap)
+        {
+          uint64_t x = kmer >> 6ULL;
+          uint64_t y = 1ULL << (kmer & 63ULL);
+          if (!(uh->bitmap[x] & y))
+            {
+              /* not seen before */
+              uh->list[unique++] = kmer;
+              uh->bitmap[x] |= y;
+            }
+        }
+      else
+        {
+          uint64_t j = HASH((char*)&kmer, (k+3)/4) & uh->hash_mask;
+          while((uh->hash[j].count) && (uh->hash[j].kmer != kmer))
+            {
+              j = (j + 1) & uh->hash_mask;
+            }
+
+          if (!(uh->hash[j].count))
+            {
+              /* not seen before */
+              uh->list[unique++] = kmer;
+              uh->hash[j].kmer = kmer;
+              uh->hash[j].count = 1;
+            }
+        }
+    }
+
+  *listlen = unique;
+  *list = uh->list;
+}
+
 void unique_count(struct uhandle_s * uh,
                   int k,
                   int seqlen,
@@ -325,7 +517,11 @@ void unique_count(struct uhandle_s * uh,
                   unsigned int * * list,
                   int seqmask)
 {
-  if (k<10)
+  if (pattern_span)
+    {
+      unique_count_spaced(uh, k, seqlen, seq, listlen, list, seqmask);
+    }
+  else if (k<10)
     {
       unique_count_bitmap(uh, k, seqlen, seq, listlen, list, seqmask);
     }
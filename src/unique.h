@@ -61,6 +61,10 @@
 struct bucket_s;
 struct uhandle_s;
 
+void unique_set_pattern(unsigned int span, unsigned int bits);
+
+unsigned int unique_get_pattern(unsigned int * bits);
+
 struct uhandle_s * unique_init();
 
 void unique_exit(struct uhandle_s * u);
@@ -68,6 +68,20 @@ static uint64_t progress_size;
 static uint64_t progress_pct;
 static bool progress_show;
 
+/* streaming mode: outputs flushed within the latency target */
+
+constexpr int stream_outputs_max = 16;
+static FILE * stream_outputs[stream_outputs_max];
+static int stream_output_count = 0;
+static int64_t stream_last_flush = 0;
+static bool stream_waiting = false;
+static pthread_mutex_t mutex_stream = PTHREAD_MUTEX_INITIALIZER;
+
+/* memory budget (--max_memory) */
+
+static const char * budget_hint = nullptr;
+static const uint64_t budget_thread_overhead = 1 << 20;
+
 void progress_init(const char * prompt, uint64_t size)
 {
   progress_show = isatty(fileno(stderr)) && (!opt_quiet) && (!opt_no_progress);
@@ -118,6 +132,138 @@ void progress_done()
     }
 }
 
+void stream_add(FILE * fp)
+{
+  /* register an output stream to be flushed in streaming mode */
+
+  if (opt_stream && fp && (stream_output_count < stream_outputs_max))
+    {
+      stream_outputs[stream_output_count++] = fp;
+      stream_last_flush = getusec();
+    }
+}
+
+static void stream_flush_all()
+{
+  for (int i = 0; i < stream_output_count; i++)
+    {
+      fflush(stream_outputs[i]);
+    }
+  stream_last_flush = getusec();
+}
+
+void stream_flush_due()
+{
+  /*
+    Called after the output of each record. Flush if the input is
+    idle, or if the oldest unflushed output is due.
+  */
+
+  if (! opt_stream)
+    {
+      return;
+    }
+
+  xpthread_mutex_lock(&mutex_stream);
+  if (stream_waiting ||
+      (getusec() - stream_last_flush >= opt_stream_latency * 1000))
+    {
+      stream_flush_all();
+    }
+  xpthread_mutex_unlock(&mutex_stream);
+}
+
+void stream_wait(bool waiting)
+{
+  /*
+    Called by the input reader before and after a read that may
+    block. While waiting for input, all output is flushed at once.
+  */
+
+  xpthread_mutex_lock(&mutex_stream);
+  stream_waiting = waiting;
+  if (waiting)
+    {
+      stream_flush_all();
+    }
+  xpthread_mutex_unlock(&mutex_stream);
+}
+
+uint64_t budget_available()
+{
+  /* memory left in the budget, after what is allocated now */
+
+  uint64_t total = opt_max_memory * 1024 * 1024;
+  uint64_t used = arch_get_allocated();
+  return (total > used) ? total - used : 0;
+}
+
+void budget_set_hint(const char * hint)
+{
+  /* advice shown if the budget is exceeded */
+  budget_hint = hint;
+}
+
+void budget_require(uint64_t size)
+{
+  /* fail fast if an allocation or estimate does not fit the budget */
+
+  if (opt_max_memory && (size > budget_available()))
+    {
+      /* no allocation here, we may be called from xmalloc */
+      static char msg[400];
+      snprintf(msg, sizeof(msg),
+               "Memory budget exceeded: %" PRIu64 " bytes needed with %"
+               PRIu64 " bytes allocated, but --max_memory is %" PRId64
+               " MB (%" PRIu64 " bytes)%s%s",
+               size,
+               arch_get_allocated(),
+               opt_max_memory,
+               (uint64_t) opt_max_memory * 1024 * 1024,
+               budget_hint ? ". Hint: " : "",
+               budget_hint ? budget_hint : "");
+      fatal(msg);
+    }
+}
+
+void budget_threads(uint64_t shared, uint64_t per_thread)
+{
+  /*
+    Reduce the number of threads if the memory needed by each of
+    them, in addition to the shared memory not yet in use, does not
+    fit in the budget.
+  */
+
+  if (! opt_max_memory)
+    {
+      return;
+    }
+
+  /* allow for the stack and buffers of each thread */
+  per_thread += budget_thread_overhead;
+
+  budget_require(shared + per_thread);
+
+  uint64_t fit = (budget_available() - shared) / per_thread;
+
+  if (fit < (uint64_t) opt_threads)
+    {
+      opt_threads = fit;
+
+      if (! opt_quiet)
+        {
+          fprintf(stderr, "Using %" PRId64 " threads to stay within --max_memory\n",
+                  opt_threads);
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log, "Using %" PRId64 " threads to stay within --max_memory\n",
+                  opt_threads);
+        }
+    }
+}
+
 void  __attribute__((noreturn)) fatal(const char * msg)
 {
   fprintf(stderr, "\n\n");
@@ -92,6 +92,15 @@ void progress_init(const char * prompt, uint64_t size);
 void progress_update(uint64_t progress);
 void progress_done();
 
+void stream_add(FILE * fp);
+void stream_flush_due();
+void stream_wait(bool waiting);
+
+uint64_t budget_available();
+void budget_set_hint(const char * hint);
+void budget_require(uint64_t size);
+void budget_threads(uint64_t shared, uint64_t per_thread);
+
 void random_init();
 int64_t random_int(int64_t n);
 uint64_t random_ulong(uint64_t n);
@@ -62,9 +62,12 @@
 
 /* options */
 
+bool opt_approx;
 bool opt_bzip2_decompress;
 bool opt_clusterout_id;
 bool opt_clusterout_sort;
+bool opt_db_dedup;
+bool opt_diag_prefilter;
 bool opt_eeout;
 bool opt_fasta_score;
 bool opt_fastq_allowmergestagger;
@@ -72,6 +75,7 @@ bool opt_fastq_eeout;
 bool opt_fastq_nostagger;
 bool opt_fastq_qout_max;
 bool opt_gzip_decompress;
+bool opt_idf;
 bool opt_label_substr_match;
 bool opt_lengthout;
 bool opt_no_progress;
@@ -80,11 +84,15 @@ bool opt_relabel_keep;
 bool opt_relabel_md5;
 bool opt_relabel_self;
 bool opt_relabel_sha1;
+bool opt_resume;
 bool opt_samheader;
 bool opt_sff_clip;
+bool opt_similar_layout;
 bool opt_sizein;
 bool opt_sizeorder;
 bool opt_sizeout;
+bool opt_stream;
+bool opt_uchime_cache;
 bool opt_xee;
 bool opt_xlength;
 bool opt_xsize;
@@ -94,6 +102,7 @@ char * opt_biomout;
 char * opt_blast6out;
 char * opt_borderline;
 char * opt_centroids;
+char * opt_checkpoint;
 char * opt_chimeras;
 char * opt_chimeras_alnout;
 char * opt_chimeras_denovo;
@@ -106,6 +115,7 @@ char * opt_consout;
 char * opt_cut;
 char * opt_cut_pattern;
 char * opt_db;
+char * opt_db_shard;
 char * opt_dbmatched;
 char * opt_dbnotmatched;
 char * opt_derep_fulllength;
@@ -156,6 +166,7 @@ char * opt_log;
 char * opt_makeudb_usearch;
 char * opt_maskfasta;
 char * opt_matched;
+char * opt_merge_shards;
 char * opt_mothur_shared_out;
 char * opt_msaout;
 char * opt_nonchimeras;
@@ -173,7 +184,9 @@ char * opt_reverse;
 char * opt_samout;
 char * opt_sample;
 char * opt_search_exact;
+char * opt_serve;
 char * opt_sff_convert;
+char * opt_shardout;
 char * opt_shuffle;
 char * opt_sintax;
 char * opt_sortbylength;
@@ -194,14 +207,17 @@ char * opt_usearch_global;
 char * opt_userout;
 double * opt_ee_cutoffs_values;
 double opt_abskew;
+double opt_approx_margin;
 double opt_dn;
 double opt_fastq_maxdiffpct;
 double opt_fastq_maxee;
 double opt_fastq_maxee_rate;
 double opt_fastq_truncee;
+double opt_group_id;
 double opt_id;
 double opt_lca_cutoff;
 double opt_max_unmasked_pct;
+double opt_max_word_freq;
 double opt_maxid;
 double opt_maxqt;
 double opt_maxsizeratio;
@@ -248,6 +264,7 @@ int opt_slots;
 int opt_uchimeout5;
 int opt_usersort;
 int opt_version;
+int64_t opt_checkpoint_interval;
 int64_t opt_dbmask;
 int64_t opt_fasta_width;
 int64_t opt_fastq_ascii;
@@ -275,7 +292,9 @@ int64_t opt_iddef;
 int64_t opt_idprefix;
 int64_t opt_idsuffix;
 int64_t opt_leftjust;
+int64_t opt_lsh_rows;
 int64_t opt_match;
+int64_t opt_max_memory;
 int64_t opt_maxaccepts;
 int64_t opt_maxdiffs;
 int64_t opt_maxgaps;
@@ -295,14 +314,19 @@ int64_t opt_minwordmatches;
 int64_t opt_mismatch;
 int64_t opt_notrunclabels;
 int64_t opt_output_no_hits;
+int64_t opt_probe_groups;
 int64_t opt_qmask;
 int64_t opt_randseed;
+int64_t opt_reorder_window;
 int64_t opt_rightjust;
 int64_t opt_rowlen;
 int64_t opt_sample_size;
 int64_t opt_self;
 int64_t opt_selfid;
+int64_t opt_serve_timeout;
+int64_t opt_sketch_size;
 int64_t opt_strand;
+int64_t opt_stream_latency;
 int64_t opt_subseq_end;
 int64_t opt_subseq_start;
 int64_t opt_threads;
@@ -331,8 +355,10 @@ int64_t avx2_present = 0;
 static char * progname;
 static char progheader[80];
 static char * cmdline;
+#ifndef LIBVSEARCH
 static time_t time_start;
 static time_t time_finish;
+#endif
 
 FILE * fp_log = nullptr;
 
@@ -748,11 +774,15 @@ void args_init(int argc, char **argv)
   opt_alignwidth = 80;
   opt_allpairs_global = nullptr;
   opt_alnout = nullptr;
+  opt_approx = false;
+  opt_approx_margin = 0.02;
   opt_biomout = nullptr;
   opt_blast6out = nullptr;
   opt_borderline = nullptr;
   opt_bzip2_decompress = false;
   opt_centroids = nullptr;
+  opt_checkpoint = nullptr;
+  opt_checkpoint_interval = 300;
   opt_chimeras = nullptr;
   opt_chimeras_denovo = nullptr;
   opt_chimeras_length_min = 10;
@@ -770,6 +800,8 @@ void args_init(int argc, char **argv)
   opt_cut = nullptr;
   opt_cut_pattern = nullptr;
   opt_db = nullptr;
+  opt_db_dedup = false;
+  opt_db_shard = nullptr;
   opt_dbmask = MASK_DUST;
   opt_dbmatched = nullptr;
   opt_dbnotmatched = nullptr;
@@ -777,6 +809,7 @@ void args_init(int argc, char **argv)
   opt_derep_id = nullptr;
   opt_derep_prefix = nullptr;
   opt_derep_smallmem = nullptr;
+  opt_diag_prefilter = false;
   opt_dn = 1.4;
   opt_ee_cutoffs_count = 3;
   opt_ee_cutoffs_values = (double*) xmalloc(opt_ee_cutoffs_count * sizeof(double));
@@ -856,11 +889,13 @@ void args_init(int argc, char **argv)
   opt_gap_open_target_interior=20;
   opt_gap_open_target_left=2;
   opt_gap_open_target_right=2;
+  opt_group_id = 0.0;
   opt_gzip_decompress = false;
   opt_hardmask = 0;
   opt_help = 0;
   opt_id = -1.0;
   opt_iddef = 2;
+  opt_idf = false;
   opt_idprefix = 0;
   opt_idsuffix = 0;
   opt_join_padgap = nullptr;
@@ -880,11 +915,14 @@ void args_init(int argc, char **argv)
   opt_length_cutoffs_shortest = 50;
   opt_lengthout = false;
   opt_log = nullptr;
+  opt_lsh_rows = 0;
   opt_makeudb_usearch = nullptr;
   opt_maskfasta = nullptr;
   opt_match = 2;
   opt_matched = nullptr;
+  opt_max_memory = 0;
   opt_max_unmasked_pct = 100.0;
+  opt_max_word_freq = 1.0;
   opt_maxaccepts = 1;
   opt_maxdiffs = INT_MAX;
   opt_maxgaps = INT_MAX;
@@ -899,6 +937,7 @@ void args_init(int argc, char **argv)
   opt_maxsl = DBL_MAX;
   opt_maxsubs = INT_MAX;
   opt_maxuniquesize = LONG_MAX;
+  opt_merge_shards = nullptr;
   opt_mid = 0.0;
   opt_min_unmasked_pct = 0.0;
   opt_mincols = 0;
@@ -926,6 +965,7 @@ void args_init(int argc, char **argv)
   opt_output = nullptr;
   opt_output_no_hits = 0;
   opt_pattern = nullptr;
+  opt_probe_groups = 0;
   opt_profile = nullptr;
   opt_qmask = MASK_DUST;
   opt_qsegout = nullptr;
@@ -937,7 +977,9 @@ void args_init(int argc, char **argv)
   opt_relabel_md5 = false;
   opt_relabel_self = false;
   opt_relabel_sha1 = false;
+  opt_reorder_window = 0;
   opt_rereplicate = nullptr;
+  opt_resume = false;
   opt_reverse = nullptr;
   opt_rightjust = 0;
   opt_rowlen = 64;
@@ -949,18 +991,25 @@ void args_init(int argc, char **argv)
   opt_search_exact = nullptr;
   opt_self = 0;
   opt_selfid = 0;
+  opt_serve = nullptr;
+  opt_serve_timeout = 60;
   opt_sff_clip = false;
   opt_sff_convert = nullptr;
+  opt_shardout = nullptr;
   opt_shuffle = nullptr;
+  opt_similar_layout = false;
   opt_sintax = nullptr;
   opt_sintax_cutoff = 0.0;
   opt_sizein = false;
   opt_sizeorder = false;
   opt_sizeout = false;
+  opt_sketch_size = 0;
   opt_slots = 0;
   opt_sortbylength = nullptr;
   opt_sortbysize = nullptr;
   opt_strand = 1;
+  opt_stream = false;
+  opt_stream_latency = 100;
   opt_subseq_end = LONG_MAX;
   opt_subseq_start = 1;
   opt_tabbedout = nullptr;
@@ -973,6 +1022,7 @@ void args_init(int argc, char **argv)
   opt_uc_allhits = 0;
   opt_uchime2_denovo = nullptr;
   opt_uchime3_denovo = nullptr;
+  opt_uchime_cache = false;
   opt_uchime_denovo = nullptr;
   opt_uchime_ref = nullptr;
   opt_uchimealns = nullptr;
@@ -1002,12 +1052,16 @@ void args_init(int argc, char **argv)
       option_alignwidth,
       option_allpairs_global,
       option_alnout,
+      option_approx,
+      option_approx_margin,
       option_band,
       option_biomout,
       option_blast6out,
       option_borderline,
       option_bzip2_decompress,
       option_centroids,
+      option_checkpoint,
+      option_checkpoint_interval,
       option_chimeras,
       option_chimeras_denovo,
       option_chimeras_length_min,
@@ -1025,6 +1079,8 @@ void args_init(int argc, char **argv)
       option_cut,
       option_cut_pattern,
       option_db,
+      option_db_dedup,
+      option_db_shard,
       option_dbmask,
       option_dbmatched,
       option_dbnotmatched,
@@ -1032,6 +1088,7 @@ void args_init(int argc, char **argv)
       option_derep_id,
       option_derep_prefix,
       option_derep_smallmem,
+      option_diag_prefilter,
       option_dn,
       option_ee_cutoffs,
       option_eeout,
@@ -1098,6 +1155,7 @@ void args_init(int argc, char **argv)
       option_fulldp,
       option_gapext,
       option_gapopen,
+      option_group_id,
       option_gzip_decompress,
       option_h,
       option_hardmask,
@@ -1105,6 +1163,7 @@ void args_init(int argc, char **argv)
       option_hspw,
       option_id,
       option_iddef,
+      option_idf,
       option_idprefix,
       option_idsuffix,
       option_join_padgap,
@@ -1122,11 +1181,14 @@ void args_init(int argc, char **argv)
       option_length_cutoffs,
       option_lengthout,
       option_log,
+      option_lsh_rows,
       option_makeudb_usearch,
       option_maskfasta,
       option_match,
       option_matched,
+      option_max_memory,
       option_max_unmasked_pct,
+      option_max_word_freq,
       option_maxaccepts,
       option_maxdiffs,
       option_maxgaps,
@@ -1141,6 +1203,7 @@ void args_init(int argc, char **argv)
       option_maxsl,
       option_maxsubs,
       option_maxuniquesize,
+      option_merge_shards,
       option_mid,
       option_min_unmasked_pct,
       option_mincols,
@@ -1169,6 +1232,7 @@ void args_init(int argc, char **argv)
       option_output,
       option_output_no_hits,
       option_pattern,
+      option_probe_groups,
       option_profile,
       option_qmask,
       option_qsegout,
@@ -1180,7 +1244,9 @@ void args_init(int argc, char **argv)
       option_relabel_md5,
       option_relabel_self,
       option_relabel_sha1,
+      option_reorder_window,
       option_rereplicate,
+      option_resume,
       option_reverse,
       option_rightjust,
       option_rowlen,
@@ -1192,18 +1258,25 @@ void args_init(int argc, char **argv)
       option_search_exact,
       option_self,
       option_selfid,
+      option_serve,
+      option_serve_timeout,
       option_sff_clip,
       option_sff_convert,
+      option_shardout,
       option_shuffle,
+      option_similar_layout,
       option_sintax,
       option_sintax_cutoff,
       option_sizein,
       option_sizeorder,
       option_sizeout,
+      option_sketch_size,
       option_slots,
       option_sortbylength,
       option_sortbysize,
       option_strand,
+      option_stream,
+      option_stream_latency,
       option_subseq_end,
       option_subseq_start,
       option_tabbedout,
@@ -1216,6 +1289,7 @@ void args_init(int argc, char **argv)
       option_uc_allhits,
       option_uchime2_denovo,
       option_uchime3_denovo,
+      option_uchime_cache,
       option_uchime_denovo,
       option_uchime_ref,
       option_uchimealns,
@@ -1247,12 +1321,16 @@ void args_init(int argc, char **argv)
       {"alignwidth",            required_argument, nullptr, 0 },
       {"allpairs_global",       required_argument, nullptr, 0 },
       {"alnout",                required_argument, nullptr, 0 },
+      {"approx",                no_argument,       nullptr, 0 },
+      {"approx_margin",         required_argument, nullptr, 0 },
       {"band",                  required_argument, nullptr, 0 },
       {"biomout",               required_argument, nullptr, 0 },
       {"blast6out",             required_argument, nullptr, 0 },
       {"borderline",            required_argument, nullptr, 0 },
       {"bzip2_decompress",      no_argument,       nullptr, 0 },
       {"centroids",             required_argument, nullptr, 0 },
+      {"checkpoint",            required_argument, nullptr, 0 },
+      {"checkpoint_interval",   required_argument, nullptr, 0 },
       {"chimeras",              required_argument, nullptr, 0 },
       {"chimeras_denovo",       required_argument, nullptr, 0 },
       {"chimeras_length_min",   required_argument, nullptr, 0 },
@@ -1270,6 +1348,8 @@ void args_init(int argc, char **argv)
       {"cut",                   required_argument, nullptr, 0 },
       {"cut_pattern",           required_argument, nullptr, 0 },
       {"db",                    required_argument, nullptr, 0 },
+      {"db_dedup",              no_argument,       nullptr, 0 },
+      {"db_shard",              required_argument, nullptr, 0 },
       {"dbmask",                required_argument, nullptr, 0 },
       {"dbmatched",             required_argument, nullptr, 0 },
       {"dbnotmatched",          required_argument, nullptr, 0 },
@@ -1277,6 +1357,7 @@ void args_init(int argc, char **argv)
       {"derep_id",              required_argument, nullptr, 0 },
       {"derep_prefix",          required_argument, nullptr, 0 },
       {"derep_smallmem",        required_argument, nullptr, 0 },
+      {"diag_prefilter",        no_argument,       nullptr, 0 },
       {"dn",                    required_argument, nullptr, 0 },
       {"ee_cutoffs",            required_argument, nullptr, 0 },
       {"eeout",                 no_argument,       nullptr, 0 },
@@ -1343,6 +1424,7 @@ void args_init(int argc, char **argv)
       {"fulldp",                no_argument,       nullptr, 0 },
       {"gapext",                required_argument, nullptr, 0 },
       {"gapopen",               required_argument, nullptr, 0 },
+      {"group_id",              required_argument, nullptr, 0 },
       {"gzip_decompress",       no_argument,       nullptr, 0 },
       {"h",                     no_argument,       nullptr, 0 },
       {"hardmask",              no_argument,       nullptr, 0 },
@@ -1350,6 +1432,7 @@ void args_init(int argc, char **argv)
       {"hspw",                  required_argument, nullptr, 0 },
       {"id",                    required_argument, nullptr, 0 },
       {"iddef",                 required_argument, nullptr, 0 },
+      {"idf",                   no_argument,       nullptr, 0 },
       {"idprefix",              required_argument, nullptr, 0 },
       {"idsuffix",              required_argument, nullptr, 0 },
       {"join_padgap",           required_argument, nullptr, 0 },
@@ -1367,11 +1450,14 @@ void args_init(int argc, char **argv)
       {"length_cutoffs",        required_argument, nullptr, 0 },
       {"lengthout",             no_argument,       nullptr, 0 },
       {"log",                   required_argument, nullptr, 0 },
+      {"lsh_rows",              required_argument, nullptr, 0 },
       {"makeudb_usearch",       required_argument, nullptr, 0 },
       {"maskfasta",             required_argument, nullptr, 0 },
       {"match",                 required_argument, nullptr, 0 },
       {"matched",               required_argument, nullptr, 0 },
+      {"max_memory",            required_argument, nullptr, 0 },
       {"max_unmasked_pct",      required_argument, nullptr, 0 },
+      {"max_word_freq",         required_argument, nullptr, 0 },
       {"maxaccepts",            required_argument, nullptr, 0 },
       {"maxdiffs",              required_argument, nullptr, 0 },
       {"maxgaps",               required_argument, nullptr, 0 },
@@ -1386,6 +1472,7 @@ void args_init(int argc, char **argv)
       {"maxsl",                 required_argument, nullptr, 0 },
       {"maxsubs",               required_argument, nullptr, 0 },
       {"maxuniquesize",         required_argument, nullptr, 0 },
+      {"merge_shards",          required_argument, nullptr, 0 },
       {"mid",                   required_argument, nullptr, 0 },
       {"min_unmasked_pct",      required_argument, nullptr, 0 },
       {"mincols",               required_argument, nullptr, 0 },
@@ -1414,6 +1501,7 @@ void args_init(int argc, char **argv)
       {"output",                required_argument, nullptr, 0 },
       {"output_no_hits",        no_argument,       nullptr, 0 },
       {"pattern",               required_argument, nullptr, 0 },
+      {"probe_groups",          required_argument, nullptr, 0 },
       {"profile",               required_argument, nullptr, 0 },
       {"qmask",                 required_argument, nullptr, 0 },
       {"qsegout",               required_argument, nullptr, 0 },
@@ -1425,7 +1513,9 @@ void args_init(int argc, char **argv)
       {"relabel_md5",           no_argument,       nullptr, 0 },
       {"relabel_self",          no_argument,       nullptr, 0 },
       {"relabel_sha1",          no_argument,       nullptr, 0 },
+      {"reorder_window",        required_argument, nullptr, 0 },
       {"rereplicate",           required_argument, nullptr, 0 },
+      {"resume",                no_argument,       nullptr, 0 },
       {"reverse",               required_argument, nullptr, 0 },
       {"rightjust",             no_argument,       nullptr, 0 },
       {"rowlen",                required_argument, nullptr, 0 },
@@ -1437,18 +1527,25 @@ void args_init(int argc, char **argv)
       {"search_exact",          required_argument, nullptr, 0 },
       {"self",                  no_argument,       nullptr, 0 },
       {"selfid",                no_argument,       nullptr, 0 },
+      {"serve",                 required_argument, nullptr, 0 },
+      {"serve_timeout",         required_argument, nullptr, 0 },
       {"sff_clip",              no_argument,       nullptr, 0 },
       {"sff_convert",           required_argument, nullptr, 0 },
+      {"shardout",              required_argument, nullptr, 0 },
       {"shuffle",               required_argument, nullptr, 0 },
+      {"similar_layout",        no_argument,       nullptr, 0 },
       {"sintax",                required_argument, nullptr, 0 },
       {"sintax_cutoff",         required_argument, nullptr, 0 },
       {"sizein",                no_argument,       nullptr, 0 },
       {"sizeorder",             no_argument,       nullptr, 0 },
       {"sizeout",               no_argument,       nullptr, 0 },
+      {"sketch_size",           required_argument, nullptr, 0 },
       {"slots",                 required_argument, nullptr, 0 },
       {"sortbylength",          required_argument, nullptr, 0 },
       {"sortbysize",            required_argument, nullptr, 0 },
       {"strand",                required_argument, nullptr, 0 },
+      {"stream",                no_argument,       nullptr, 0 },
+      {"stream_latency",        required_argument, nullptr, 0 },
       {"subseq_end",            required_argument, nullptr, 0 },
       {"subseq_start",          required_argument, nullptr, 0 },
       {"tabbedout",             required_argument, nullptr, 0 },
@@ -1461,6 +1558,7 @@ void args_init(int argc, char **argv)
       {"uc_allhits",            no_argument,       nullptr, 0 },
       {"uchime2_denovo",        required_argument, nullptr, 0 },
       {"uchime3_denovo",        required_argument, nullptr, 0 },
+      {"uchime_cache",          no_argument,       nullptr, 0 },
       {"uchime_denovo",         required_argument, nullptr, 0 },
       {"uchime_ref",            required_argument, nullptr, 0 },
       {"uchimealns",            required_argument, nullptr, 0 },
@@ -1899,12 +1997,10 @@ void args_init(int argc, char **argv)
           break;
 
         case option_slots:
-          fprintf(stderr, "WARNING: Option --slots is ignored\n");
           opt_slots = args_getlong(optarg);
           break;
 
         case option_pattern:
-          fprintf(stderr, "WARNING: Option --pattern is ignored\n");
           opt_pattern = optarg;
           break;
 
@@ -2536,6 +2632,102 @@ void args_init(int argc, char **argv)
           opt_chimeras_parents_max = args_getlong(optarg);
           break;
 
+        case option_db_shard:
+          opt_db_shard = optarg;
+          break;
+
+        case option_shardout:
+          opt_shardout = optarg;
+          break;
+
+        case option_merge_shards:
+          opt_merge_shards = optarg;
+          break;
+
+        case option_checkpoint:
+          opt_checkpoint = optarg;
+          break;
+
+        case option_checkpoint_interval:
+          opt_checkpoint_interval = args_getlong(optarg);
+          break;
+
+        case option_resume:
+          opt_resume = true;
+          break;
+
+        case option_serve:
+          opt_serve = optarg;
+          break;
+
+        case option_stream:
+          opt_stream = true;
+          break;
+
+        case option_stream_latency:
+          opt_stream_latency = args_getlong(optarg);
+          break;
+
+        case option_max_memory:
+          opt_max_memory = args_getlong(optarg);
+          break;
+
+        case option_uchime_cache:
+          opt_uchime_cache = true;
+          break;
+
+        case option_group_id:
+          opt_group_id = args_getdouble(optarg);
+          break;
+
+        case option_probe_groups:
+          opt_probe_groups = args_getlong(optarg);
+          break;
+
+        case option_max_word_freq:
+          opt_max_word_freq = args_getdouble(optarg);
+          break;
+
+        case option_idf:
+          opt_idf = true;
+          break;
+
+        case option_db_dedup:
+          opt_db_dedup = true;
+          break;
+
+        case option_diag_prefilter:
+          opt_diag_prefilter = true;
+          break;
+
+        case option_approx:
+          opt_approx = true;
+          break;
+
+        case option_approx_margin:
+          opt_approx_margin = args_getdouble(optarg);
+          break;
+
+        case option_sketch_size:
+          opt_sketch_size = args_getlong(optarg);
+          break;
+
+        case option_lsh_rows:
+          opt_lsh_rows = args_getlong(optarg);
+          break;
+
+        case option_reorder_window:
+          opt_reorder_window = args_getlong(optarg);
+          break;
+
+        case option_similar_layout:
+          opt_similar_layout = true;
+          break;
+
+        case option_serve_timeout:
+          opt_serve_timeout = args_getlong(optarg);
+          break;
+
         default:
           fatal("Internal error in option parsing");
         }
@@ -2589,6 +2781,7 @@ void args_init(int argc, char **argv)
       option_help,
       option_makeudb_usearch,
       option_maskfasta,
+      option_merge_shards,
       option_orient,
       option_rereplicate,
       option_search_exact,
@@ -2616,7 +2809,7 @@ void args_init(int argc, char **argv)
     The first line is the command and the lines below are the valid options.
   */
 
-  const int valid_options[][98] =
+  const int valid_options[][112] =
     {
       {
         option_allpairs_global,
@@ -2641,8 +2834,10 @@ void args_init(int argc, char **argv)
         option_leftjust,
         option_lengthout,
         option_log,
+        option_lsh_rows,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -2688,6 +2883,7 @@ void args_init(int argc, char **argv)
         option_selfid,
         option_sizein,
         option_sizeout,
+        option_sketch_size,
         option_slots,
         option_target_cov,
         option_threads,
@@ -2747,6 +2943,8 @@ void args_init(int argc, char **argv)
         option_blast6out,
         option_bzip2_decompress,
         option_centroids,
+        option_checkpoint,
+        option_checkpoint_interval,
         option_clusterout_id,
         option_clusterout_sort,
         option_clusters,
@@ -2770,6 +2968,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -2810,6 +3009,7 @@ void args_init(int argc, char **argv)
         option_relabel_md5,
         option_relabel_self,
         option_relabel_sha1,
+        option_resume,
         option_rightjust,
         option_rowlen,
         option_samheader,
@@ -2844,6 +3044,8 @@ void args_init(int argc, char **argv)
         option_blast6out,
         option_bzip2_decompress,
         option_centroids,
+        option_checkpoint,
+        option_checkpoint_interval,
         option_clusterout_id,
         option_clusterout_sort,
         option_clusters,
@@ -2867,6 +3069,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -2907,6 +3110,7 @@ void args_init(int argc, char **argv)
         option_relabel_md5,
         option_relabel_self,
         option_relabel_sha1,
+        option_resume,
         option_rightjust,
         option_rowlen,
         option_samheader,
@@ -2941,6 +3145,8 @@ void args_init(int argc, char **argv)
         option_blast6out,
         option_bzip2_decompress,
         option_centroids,
+        option_checkpoint,
+        option_checkpoint_interval,
         option_clusterout_id,
         option_clusterout_sort,
         option_clusters,
@@ -2964,6 +3170,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -3004,6 +3211,7 @@ void args_init(int argc, char **argv)
         option_relabel_md5,
         option_relabel_self,
         option_relabel_sha1,
+        option_resume,
         option_rightjust,
         option_rowlen,
         option_samheader,
@@ -3039,6 +3247,8 @@ void args_init(int argc, char **argv)
         option_blast6out,
         option_bzip2_decompress,
         option_centroids,
+        option_checkpoint,
+        option_checkpoint_interval,
         option_clusterout_id,
         option_clusterout_sort,
         option_clusters,
@@ -3062,6 +3272,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -3103,6 +3314,7 @@ void args_init(int argc, char **argv)
         option_relabel_md5,
         option_relabel_self,
         option_relabel_sha1,
+        option_resume,
         option_rightjust,
         option_rowlen,
         option_samheader,
@@ -3165,6 +3377,7 @@ void args_init(int argc, char **argv)
         option_gzip_decompress,
         option_lengthout,
         option_log,
+        option_max_memory,
         option_maxseqlength,
         option_maxuniquesize,
         option_minseqlength,
@@ -3229,6 +3442,7 @@ void args_init(int argc, char **argv)
         option_label_suffix,
         option_lengthout,
         option_log,
+        option_max_memory,
         option_maxseqlength,
         option_maxuniquesize,
         option_minseqlength,
@@ -3503,6 +3717,8 @@ void args_init(int argc, char **argv)
         option_sample,
         option_sizein,
         option_sizeout,
+        option_stream,
+        option_stream_latency,
         option_threads,
         option_xee,
         option_xlength,
@@ -3790,6 +4006,7 @@ void args_init(int argc, char **argv)
         option_label_suffix,
         option_lengthout,
         option_log,
+        option_max_memory,
         option_maxseqlength,
         option_maxuniquesize,
         option_minseqlength,
@@ -3829,16 +4046,22 @@ void args_init(int argc, char **argv)
 
       { option_makeudb_usearch,
         option_bzip2_decompress,
+        option_db_dedup,
         option_dbmask,
+        option_group_id,
         option_gzip_decompress,
         option_hardmask,
         option_log,
+        option_max_memory,
         option_maxseqlength,
         option_minseqlength,
         option_no_progress,
         option_notrunclabels,
         option_output,
+        option_pattern,
         option_quiet,
+        option_similar_layout,
+        option_slots,
         option_threads,
         option_wordlength,
         -1 },
@@ -3874,6 +4097,23 @@ void args_init(int argc, char **argv)
         option_xsize,
         -1 },
 
+      { option_merge_shards,
+        option_blast6out,
+        option_log,
+        option_maxaccepts,
+        option_maxhits,
+        option_no_progress,
+        option_output_no_hits,
+        option_quiet,
+        option_threads,
+        option_top_hits_only,
+        option_uc,
+        option_uc_allhits,
+        option_xee,
+        option_xlength,
+        option_xsize,
+        -1 },
+
       { option_orient,
         option_bzip2_decompress,
         option_db,
@@ -3885,6 +4125,7 @@ void args_init(int argc, char **argv)
         option_label_suffix,
         option_lengthout,
         option_log,
+        option_max_memory,
         option_no_progress,
         option_notmatched,
         option_notrunclabels,
@@ -3898,6 +4139,8 @@ void args_init(int argc, char **argv)
         option_sample,
         option_sizein,
         option_sizeout,
+        option_stream,
+        option_stream_latency,
         option_tabbedout,
         option_threads,
         option_wordlength,
@@ -3951,6 +4194,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
         option_maxhits,
         option_maxqsize,
         option_maxqt,
@@ -4061,14 +4305,18 @@ void args_init(int argc, char **argv)
         option_gzip_decompress,
         option_label_suffix,
         option_log,
+        option_max_memory,
         option_maxseqlength,
         option_minseqlength,
         option_no_progress,
         option_notrunclabels,
+        option_probe_groups,
         option_quiet,
         option_randseed,
         option_sintax_cutoff,
         option_strand,
+        option_stream,
+        option_stream_latency,
         option_tabbedout,
         option_threads,
         option_wordlength,
@@ -4288,6 +4536,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_nonchimeras,
         option_notrunclabels,
+        option_probe_groups,
         option_qmask,
         option_quiet,
         option_relabel,
@@ -4302,6 +4551,7 @@ void args_init(int argc, char **argv)
         option_sizeout,
         option_strand,
         option_threads,
+        option_uchime_cache,
         option_uchimealns,
         option_uchimeout,
         option_uchimeout5,
@@ -4348,14 +4598,21 @@ void args_init(int argc, char **argv)
 
       { option_usearch_global,
         option_alnout,
+        option_approx,
+        option_approx_margin,
         option_band,
         option_biomout,
         option_blast6out,
         option_bzip2_decompress,
+        option_checkpoint,
+        option_checkpoint_interval,
         option_db,
+        option_db_dedup,
+        option_db_shard,
         option_dbmask,
         option_dbmatched,
         option_dbnotmatched,
+        option_diag_prefilter,
         option_fasta_width,
         option_fastapairs,
         option_fulldp,
@@ -4366,6 +4623,7 @@ void args_init(int argc, char **argv)
         option_hspw,
         option_id,
         option_iddef,
+        option_idf,
         option_idprefix,
         option_idsuffix,
         option_label_suffix,
@@ -4376,6 +4634,8 @@ void args_init(int argc, char **argv)
         option_log,
         option_match,
         option_matched,
+        option_max_memory,
+        option_max_word_freq,
         option_maxaccepts,
         option_maxdiffs,
         option_maxgaps,
@@ -4405,6 +4665,7 @@ void args_init(int argc, char **argv)
         option_otutabout,
         option_output_no_hits,
         option_pattern,
+        option_probe_groups,
         option_qmask,
         option_qsegout,
         option_query_cov,
@@ -4414,6 +4675,8 @@ void args_init(int argc, char **argv)
         option_relabel_md5,
         option_relabel_self,
         option_relabel_sha1,
+        option_reorder_window,
+        option_resume,
         option_rightjust,
         option_rowlen,
         option_samheader,
@@ -4421,10 +4684,15 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_serve,
+        option_serve_timeout,
+        option_shardout,
         option_sizein,
         option_sizeout,
         option_slots,
         option_strand,
+        option_stream,
+        option_stream_latency,
         option_target_cov,
         option_threads,
         option_top_hits_only,
@@ -4605,6 +4873,204 @@ void args_init(int argc, char **argv)
       fatal("The argument to --maxrejects must not be negative");
     }
 
+  if (opt_resume && ! opt_checkpoint)
+    {
+      fatal("The --resume option requires --checkpoint");
+    }
+
+  if (opt_checkpoint_interval < 1)
+    {
+      fatal("The argument to --checkpoint_interval must be positive");
+    }
+
+  if (opt_checkpoint && (opt_otutabout || opt_mothur_shared_out || opt_biomout))
+    {
+      fatal("OTU table output cannot be used with --checkpoint");
+    }
+
+  if (opt_serve)
+    {
+      if (opt_checkpoint || opt_shardout)
+        {
+          fatal("The --serve option cannot be used with --checkpoint or --shardout");
+        }
+
+      if (opt_otutabout || opt_mothur_shared_out || opt_biomout ||
+          opt_dbmatched || opt_dbnotmatched)
+        {
+          fatal("OTU table and database outputs cannot be used with --serve");
+        }
+
+      if (! (opt_alnout || opt_blast6out || opt_fastapairs || opt_lcaout ||
+             opt_matched || opt_notmatched || opt_qsegout || opt_samout ||
+             opt_tsegout || opt_uc || opt_userout))
+        {
+          fatal("The --serve option requires at least one output option");
+        }
+    }
+
+  if (opt_serve_timeout < 1)
+    {
+      fatal("The argument to --serve_timeout must be at least 1");
+    }
+
+  if (opt_max_memory < 0)
+    {
+      fatal("The argument to --max_memory must not be negative");
+    }
+
+  if (opt_stream_latency < 0)
+    {
+      fatal("The argument to --stream_latency must not be negative");
+    }
+
+  if (opt_stream)
+    {
+      /* no meaningful progress when the input size is unknown */
+      opt_no_progress = true;
+    }
+
+  if (opt_slots < 0)
+    {
+      fatal("The argument to --slots must not be negative");
+    }
+
+  if ((opt_group_id < 0.0) || (opt_group_id > 1.0))
+    {
+      fatal("The argument to --group_id must be in the range 0.0 to 1.0");
+    }
+
+  if (opt_probe_groups < 0)
+    {
+      fatal("The argument to --probe_groups must not be negative");
+    }
+
+  if (opt_db_dedup && (opt_group_id > 0.0))
+    {
+      fatal("The --db_dedup and --group_id options cannot be combined");
+    }
+
+  if (opt_db_dedup && opt_similar_layout)
+    {
+      fatal("The --db_dedup and --similar_layout options cannot be combined");
+    }
+
+  if ((opt_sketch_size < 0) || (opt_sketch_size > 1024) ||
+      (opt_sketch_size % 8))
+    {
+      fatal("The argument to --sketch_size must be a multiple of 8 from 0 to 1024");
+    }
+
+  if ((opt_lsh_rows < 0) || (opt_lsh_rows > 16) ||
+      (opt_sketch_size && (opt_lsh_rows > opt_sketch_size)))
+    {
+      fatal("The argument to --lsh_rows must be in the range 0 to 16 and not exceed --sketch_size");
+    }
+
+  if (opt_reorder_window < 0)
+    {
+      fatal("The argument to --reorder_window must not be negative");
+    }
+
+  if (opt_reorder_window && opt_stream)
+    {
+      fatal("The --reorder_window and --stream options cannot be combined");
+    }
+
+  if ((opt_approx_margin < 0.0) || (opt_approx_margin > 1.0))
+    {
+      fatal("The argument to --approx_margin must be in the range 0.0 to 1.0");
+    }
+
+  if (opt_approx && opt_idf)
+    {
+      fatal("The --approx and --idf options cannot be combined");
+    }
+
+  if (opt_approx && (opt_alnout || opt_blast6out || opt_fastapairs ||
+                     opt_qsegout || opt_samout || opt_shardout ||
+                     opt_tsegout || opt_userout))
+    {
+      fatal("The --approx option cannot be used with output files that show alignments (--alnout, --blast6out, --fastapairs, --qsegout, --samout, --shardout, --tsegout or --userout)");
+    }
+
+  if (opt_approx && (options_selected[option_leftjust] ||
+                     options_selected[option_maxdiffs] ||
+                     options_selected[option_maxgaps] ||
+                     options_selected[option_maxid] ||
+                     options_selected[option_maxsubs] ||
+                     options_selected[option_mid] ||
+                     options_selected[option_mincols] ||
+                     options_selected[option_query_cov] ||
+                     options_selected[option_rightjust] ||
+                     options_selected[option_target_cov]))
+    {
+      fatal("The --approx option cannot be combined with criteria that need an alignment (--leftjust, --maxdiffs, --maxgaps, --maxid, --maxsubs, --mid, --mincols, --query_cov, --rightjust or --target_cov)");
+    }
+
+  if (opt_approx && ((opt_maxaccepts != 1) || opt_uc_allhits))
+    {
+      fatal("The --approx option reports only one hit per query and cannot be combined with --maxaccepts other than 1 or with --uc_allhits");
+    }
+
+  if ((opt_max_word_freq <= 0.0) || (opt_max_word_freq > 1.0))
+    {
+      fatal("The argument to --max_word_freq must be larger than 0.0 and at most 1.0");
+    }
+
+  if (opt_pattern)
+    {
+      /*
+        A spaced seed pattern of zeros and ones, starting and ending
+        with a one. The number of ones gives the word length.
+      */
+
+      unsigned int span = strlen(opt_pattern);
+      unsigned int bits = 0;
+      int64_t ones = 0;
+
+      if ((span < 1) || (span > 32))
+        {
+          fatal("The argument to --pattern must have 1 to 32 positions");
+        }
+
+      for(unsigned int i = 0; i < span; i++)
+        {
+          if (opt_pattern[i] == '1')
+            {
+              bits |= 1U << i;
+              ones++;
+            }
+          else if (opt_pattern[i] != '0')
+            {
+              fatal("The argument to --pattern may only contain zeros and ones");
+            }
+        }
+
+      if ((opt_pattern[0] != '1') || (opt_pattern[span - 1] != '1'))
+        {
+          fatal("The argument to --pattern must start and end with a one");
+        }
+
+      if (opt_wordlength && (opt_wordlength != ones))
+        {
+          fatal("The number of ones in --pattern must equal --wordlength");
+        }
+
+      opt_wordlength = ones;
+
+      if ((opt_wordlength < 3) || (opt_wordlength > 15))
+        {
+          fatal("The argument to --pattern must contain 3 to 15 ones");
+        }
+
+      /* a pattern of only ones is the same as contiguous words */
+      if (span > (unsigned int) ones)
+        {
+          unique_set_pattern(span, bits);
+        }
+    }
+
   if (opt_wordlength == 0)
     {
       /* set default word length */
@@ -4972,11 +5438,14 @@ void cmd_help()
               "  --gzip_decompress           decompress input with gzip (required if pipe)\n"
               "  --help | -h                 display help information\n"
               "  --log FILENAME              write messages, timing and memory info to file\n"
+              "  --max_memory INT            memory budget in MB, adapt or fail fast (0: none)\n"
               "  --maxseqlength INT          maximum sequence length (50000)\n"
               "  --minseqlength INT          min seq length (clust/derep/search: 32, other:1)\n"
               "  --no_progress               do not show progress indicator\n"
               "  --notrunclabels             do not truncate labels at first space\n"
               "  --quiet                     output just warnings and fatal errors to stderr\n"
+              "  --stream                    flush output promptly when reading from pipes\n"
+              "  --stream_latency INT        max delay in ms before output is flushed (100)\n"
               "  --threads INT               number of threads to use, zero for all cores (0)\n"
               "  --version | -v              display version information\n"
               "\n"
@@ -5018,6 +5487,7 @@ void cmd_help()
               "  --sizein                    propagate abundance annotation from input\n"
               "  --self                      exclude identical labels for --uchime_ref\n"
               "  --selfid                    exclude identical sequences for --uchime_ref\n"
+              "  --uchime_cache              reuse results for repeated query sequences\n"
               "  --xn REAL                   'no' vote weight (8.0)\n"
               " Output\n"
               "  --alignwidth INT            width of alignment in uchimealn output (80)\n"
@@ -5042,10 +5512,14 @@ void cmd_help()
               "  --cluster_smallmem FILENAME cluster already sorted sequences (see -usersort)\n"
               "  --cluster_unoise FILENAME   denoise Illumina amplicon reads\n"
               " Parameters (most searching options also apply)\n"
+              "  --checkpoint FILENAME       save state regularly to FILENAME for --resume\n"
+              "  --checkpoint_interval INT   seconds between checkpoints (300)\n"
               "  --cons_truncate             do not ignore terminal gaps in MSA for consensus\n"
               "  --id REAL                   reject if identity lower, accepted values: 0-1.0\n"
               "  --iddef INT                 id definition, 0-4=CD-HIT,all,int,MBL,BLAST (2)\n"
               "  --qmask none|dust|soft      mask seqs with dust, soft or no method (dust)\n"
+              "  --reorder_window INT        search queries in windows grouped by similarity\n"
+              "  --resume                    continue from last checkpoint, see --checkpoint\n"
               "  --sizein                    propagate abundance annotation from input\n"
               "  --strand plus|both          cluster using plus or both strands (plus)\n"
               "  --usersort                  indicate sequences not pre-sorted by length\n"
@@ -5236,6 +5710,9 @@ void cmd_help()
               " Output (most searching options also apply)\n"
               "  --alnout FILENAME           filename for human-readable alignment output\n"
               "  --acceptall                 output all pairwise alignments\n"
+              " Parameters\n"
+              "  --sketch_size INT           align only MinHash/LSH candidate pairs (0)\n"
+              "  --lsh_rows INT              sketch positions per LSH band (0 = auto)\n"
               "\n"
               "Restriction site cutting\n"
               "  --cut FILENAME              filename of FASTA formatted input sequences\n"
@@ -5259,23 +5736,33 @@ void cmd_help()
               "  --label_suffix STRING       label to append to identifier in the output\n"
               "\n"
               "Searching\n"
+              "  --merge_shards FILENAMES    merge comma-separated list of shard hit files\n"
               "  --search_exact FILENAME     filename of queries for exact match search\n"
               "  --usearch_global FILENAME   filename of queries for global alignment search\n"
               " Data\n"
               "  --db FILENAME               name of UDB or FASTA database for search\n"
               " Parameters\n"
+              "  --approx                    accept clear top candidates without alignment\n"
+              "  --approx_margin REAL        min. estimated id lead over runner-up (0.02)\n"
+              "  --checkpoint FILENAME       save state regularly to FILENAME for --resume\n"
+              "  --checkpoint_interval INT   seconds between checkpoints (300)\n"
+              "  --db_dedup                  index identical db seqs once, expand their hits\n"
+              "  --db_shard i/N              search only the i'th of N database shards\n"
               "  --dbmask none|dust|soft     mask db with dust, soft or no method (dust)\n"
+              "  --diag_prefilter            reject hopeless targets before alignment\n"
               "  --fulldp                    full dynamic programming alignment (always on)\n"
               "  --gapext STRING             penalties for gap extension (2I/1E)\n"
               "  --gapopen STRING            penalties for gap opening (20I/2E)\n"
               "  --hardmask                  mask by replacing with N instead of lower case\n"
               "  --id REAL                   reject if identity lower\n"
               "  --iddef INT                 id definition, 0-4=CD-HIT,all,int,MBL,BLAST (2)\n"
+              "  --idf                       weight word matches by inverse frequency\n"
               "  --idprefix INT              reject if first n nucleotides do not match\n"
               "  --idsuffix INT              reject if last n nucleotides do not match\n"
               "  --lca_cutoff REAL           fraction of matching hits required for LCA (1.0)\n"
               "  --leftjust                  reject if terminal gaps at alignment left end\n"
               "  --match INT                 score for match (2)\n"
+              "  --max_word_freq REAL        ignore words in larger fraction of db seqs (1.0)\n"
               "  --maxaccepts INT            number of hits to accept and show per strand (1)\n"
               "  --maxdiffs INT              reject if more substitutions or indels\n"
               "  --maxgaps INT               reject if more indels\n"
@@ -5295,14 +5782,18 @@ void cmd_help()
               "  --mintsize INT              reject if target abundance lower\n"
               "  --minwordmatches INT        minimum number of word matches required (12)\n"
               "  --mismatch INT              score for mismatch (-4)\n"
-              "  --pattern STRING            option is ignored\n"
+              "  --pattern STRING            spaced word pattern of 0s and 1s (contiguous)\n"
+              "  --probe_groups INT          groups of a grouped UDB to search, 0 for all (0)\n"
               "  --qmask none|dust|soft      mask query with dust, soft or no method (dust)\n"
               "  --query_cov REAL            reject if fraction of query seq. aligned lower\n"
+              "  --resume                    continue from last checkpoint, see --checkpoint\n"
               "  --rightjust                 reject if terminal gaps at alignment right end\n"
               "  --sizein                    propagate abundance annotation from input\n"
               "  --self                      reject if labels identical\n"
               "  --selfid                    reject if sequences identical\n"
-              "  --slots INT                 option is ignored\n"
+              "  --serve FILENAME            answer query batches on this Unix socket\n"
+              "  --serve_timeout INT         seconds to wait for a client request (60)\n"
+              "  --slots INT                 number of slots in hashed word index (auto)\n"
               "  --strand plus|both          search plus or both strands (plus)\n"
               "  --target_cov REAL           reject if fraction of target seq. aligned lower\n"
               "  --weak_id REAL              include aligned hits with >= id; continue search\n"
@@ -5323,6 +5814,7 @@ void cmd_help()
               "  --rowlen INT                width of alignment lines in alnout output (64)\n"
               "  --samheader                 include a header in the SAM output file\n"
               "  --samout FILENAME           filename for SAM format output\n"
+              "  --shardout FILENAME         filename for binary hit output of a db shard\n"
               "  --sizeout                   write abundance annotation to dbmatched file\n"
               "  --top_hits_only             output only hits with identity equal to the best\n"
               "  --uc FILENAME               filename for UCLUST-like output\n"
@@ -5427,8 +5919,13 @@ void cmd_help()
               "  --udbinfo FILENAME          show information about UDB file\n"
               "  --udbstats FILENAME         report statistics about indexed words in UDB file\n"
               " Parameters\n"
+              "  --db_dedup                  index identical sequences only once\n"
               "  --dbmask none|dust|soft     mask db with dust, soft or no method (dust)\n"
+              "  --group_id REAL             group seqs sharing this fraction of words (0: off)\n"
               "  --hardmask                  mask by replacing with N instead of lower case\n"
+              "  --pattern STRING            spaced word pattern of 0s and 1s (contiguous)\n"
+              "  --similar_layout            store similar sequences next to each other\n"
+              "  --slots INT                 number of slots in hashed word index (auto)\n"
               "  --wordlength INT            length of words for database index 3-15 (8)\n"
               " Output\n"
               "  --output FILENAME           UDB or FASTA output file\n"
@@ -5453,6 +5950,11 @@ void cmd_allpairs_global()
       fatal("Specify either --acceptall or --id with an identity from 0.0 to 1.0");
     }
 
+  if (opt_sketch_size && opt_acceptall)
+    {
+      fatal("Options --sketch_size and --acceptall cannot be combined");
+    }
+
   allpairs_global(cmdline, progheader);
 }
 
@@ -5466,7 +5968,8 @@ void cmd_usearch_global()
       (! opt_dbmatched) && (! opt_dbnotmatched) &&
       (! opt_samout) && (! opt_otutabout) &&
       (! opt_biomout) && (! opt_mothur_shared_out) &&
-      (! opt_fastapairs) && (! opt_lcaout))
+      (! opt_fastapairs) && (! opt_lcaout) &&
+      (! opt_shardout))
     {
       fatal("No output files specified");
     }
@@ -5481,9 +5984,23 @@ void cmd_usearch_global()
       fatal("Identity between 0.0 and 1.0 must be specified with --id");
     }
 
+  shard_init();
+
   usearch_global(cmdline, progheader);
 }
 
+void cmd_merge_shards()
+{
+  /* check options */
+
+  if ((! opt_uc) && (! opt_blast6out))
+    {
+      fatal("No output files specified");
+    }
+
+  merge_shards();
+}
+
 void cmd_search_exact()
 {
   /* check options */
@@ -5714,6 +6231,10 @@ void show_header()
     }
 }
 
+#ifndef LIBVSEARCH
+
+/* the library build (libvsearch.a) provides its own entry points */
+
 int main(int argc, char** argv)
 {
   fillheader();
@@ -5834,6 +6355,10 @@ int main(int argc, char** argv)
     {
       cmd_search_exact();
     }
+  else if (opt_merge_shards)
+    {
+      cmd_merge_shards();
+    }
   else if (opt_fastx_mask)
     {
       fastx_mask();
@@ -5958,3 +6483,5 @@ int main(int argc, char** argv)
   xfree(cmdline);
   dynlibs_close();
 }
+
+#endif
@@ -221,6 +221,7 @@
 #include "bitmap.h"
 #include "dbindex.h"
 #include "minheap.h"
+#include "minhash.h"
 #include "search.h"
 #include "linmemalign.h"
 #include "searchcore.h"
@@ -260,12 +261,17 @@
 #include "orient.h"
 #include "fa2fq.h"
 #include "derepsmallmem.h"
+#include "shard.h"
+#include "checkpoint.h"
 
 /* options */
 
+extern bool opt_approx;
 extern bool opt_bzip2_decompress;
 extern bool opt_clusterout_id;
 extern bool opt_clusterout_sort;
+extern bool opt_db_dedup;
+extern bool opt_diag_prefilter;
 extern bool opt_eeout;
 extern bool opt_fasta_score;
 extern bool opt_fastq_allowmergestagger;
@@ -273,6 +279,7 @@ extern bool opt_fastq_eeout;
 extern bool opt_fastq_nostagger;
 extern bool opt_fastq_qout_max;
 extern bool opt_gzip_decompress;
+extern bool opt_idf;
 extern bool opt_label_substr_match;
 extern bool opt_lengthout;
 extern bool opt_no_progress;
@@ -281,11 +288,15 @@ extern bool opt_relabel_keep;
 extern bool opt_relabel_md5;
 extern bool opt_relabel_self;
 extern bool opt_relabel_sha1;
+extern bool opt_resume;
 extern bool opt_samheader;
 extern bool opt_sff_clip;
+extern bool opt_similar_layout;
 extern bool opt_sizein;
 extern bool opt_sizeorder;
 extern bool opt_sizeout;
+extern bool opt_stream;
+extern bool opt_uchime_cache;
 extern bool opt_xee;
 extern bool opt_xlength;
 extern bool opt_xsize;
@@ -295,6 +306,7 @@ extern char * opt_biomout;
 extern char * opt_blast6out;
 extern char * opt_borderline;
 extern char * opt_centroids;
+extern char * opt_checkpoint;
 extern char * opt_chimeras;
 extern char * opt_chimeras_denovo;
 extern char * opt_cluster_fast;
@@ -306,6 +318,7 @@ extern char * opt_consout;
 extern char * opt_cut;
 extern char * opt_cut_pattern;
 extern char * opt_db;
+extern char * opt_db_shard;
 extern char * opt_dbmatched;
 extern char * opt_dbnotmatched;
 extern char * opt_derep_fulllength;
@@ -355,6 +368,7 @@ extern char * opt_log;
 extern char * opt_makeudb_usearch;
 extern char * opt_maskfasta;
 extern char * opt_matched;
+extern char * opt_merge_shards;
 extern char * opt_mothur_shared_out;
 extern char * opt_msaout;
 extern char * opt_nonchimeras;
@@ -372,7 +386,9 @@ extern char * opt_reverse;
 extern char * opt_samout;
 extern char * opt_sample;
 extern char * opt_search_exact;
+extern char * opt_serve;
 extern char * opt_sff_convert;
+extern char * opt_shardout;
 extern char * opt_shuffle;
 extern char * opt_sintax;
 extern char * opt_sortbylength;
@@ -393,14 +409,17 @@ extern char * opt_usearch_global;
 extern char * opt_userout;
 extern double * opt_ee_cutoffs_values;
 extern double opt_abskew;
+extern double opt_approx_margin;
 extern double opt_dn;
 extern double opt_fastq_maxdiffpct;
 extern double opt_fastq_maxee;
 extern double opt_fastq_maxee_rate;
 extern double opt_fastq_truncee;
+extern double opt_group_id;
 extern double opt_id;
 extern double opt_lca_cutoff;
 extern double opt_max_unmasked_pct;
+extern double opt_max_word_freq;
 extern double opt_maxid;
 extern double opt_maxqt;
 extern double opt_maxsizeratio;
@@ -447,6 +466,7 @@ extern int opt_slots;
 extern int opt_uchimeout5;
 extern int opt_usersort;
 extern int opt_version;
+extern int64_t opt_checkpoint_interval;
 extern int64_t opt_dbmask;
 extern int64_t opt_fasta_width;
 extern int64_t opt_fastq_ascii;
@@ -474,7 +494,9 @@ extern int64_t opt_iddef;
 extern int64_t opt_idprefix;
 extern int64_t opt_idsuffix;
 extern int64_t opt_leftjust;
+extern int64_t opt_lsh_rows;
 extern int64_t opt_match;
+extern int64_t opt_max_memory;
 extern int64_t opt_maxaccepts;
 extern int64_t opt_maxdiffs;
 extern int64_t opt_maxgaps;
@@ -494,14 +516,19 @@ extern int64_t opt_minwordmatches;
 extern int64_t opt_mismatch;
 extern int64_t opt_notrunclabels;
 extern int64_t opt_output_no_hits;
+extern int64_t opt_probe_groups;
 extern int64_t opt_qmask;
 extern int64_t opt_randseed;
+extern int64_t opt_reorder_window;
 extern int64_t opt_rightjust;
 extern int64_t opt_rowlen;
 extern int64_t opt_sample_size;
 extern int64_t opt_self;
 extern int64_t opt_selfid;
+extern int64_t opt_serve_timeout;
+extern int64_t opt_sketch_size;
 extern int64_t opt_strand;
+extern int64_t opt_stream_latency;
 extern int64_t opt_subseq_start;
 extern int64_t opt_subseq_end;
 extern int64_t opt_threads;
@@ -523,3 +550,6 @@ extern int64_t avx_present;
 extern int64_t avx2_present;
 
 extern FILE * fp_log;
+
+void cpu_features_detect();
+void args_init(int argc, char **argv);